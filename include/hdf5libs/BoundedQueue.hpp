@@ -0,0 +1,127 @@
+/**
+ * @file BoundedQueue.hpp
+ *
+ * Fixed-capacity, lock-free, multi-producer/multi-consumer queue that is
+ * used to hand records over to the background I/O thread of HDF5RawDataFile.
+ *
+ * The implementation follows the well-known array-based design in which
+ * every cell carries a sequence number that tells producers and consumers
+ * whether the cell is free or filled for the current lap around the ring.
+ *
+ * This is part of the DUNE DAQ Application Framework, copyright 2020.
+ * Licensing/copyright details are in the COPYING file that you should have
+ * received with this code.
+ */
+
+#ifndef HDF5LIBS_INCLUDE_HDF5LIBS_BOUNDEDQUEUE_HPP_
+#define HDF5LIBS_INCLUDE_HDF5LIBS_BOUNDEDQUEUE_HPP_
+
+#include <atomic>
+#include <cstddef>
+#include <memory>
+#include <utility>
+
+namespace dunedaq {
+namespace hdf5libs {
+
+template<typename T>
+class BoundedQueue
+{
+public:
+  explicit BoundedQueue(size_t capacity)
+    : m_capacity(capacity > 0 ? capacity : 1)
+    , m_cells(new Cell[m_capacity])
+    , m_enqueue_pos(0)
+    , m_dequeue_pos(0)
+  {
+    for (size_t idx = 0; idx < m_capacity; ++idx)
+      m_cells[idx].sequence.store(idx, std::memory_order_relaxed);
+  }
+
+  BoundedQueue(const BoundedQueue&) = delete;
+  BoundedQueue& operator=(const BoundedQueue&) = delete;
+  BoundedQueue(BoundedQueue&&) = delete;
+  BoundedQueue& operator=(BoundedQueue&&) = delete;
+
+  /**
+   * @brief Attempts to add an item to the queue.
+   * On failure (queue full) the item is left untouched.
+   */
+  bool try_push(T& item)
+  {
+    Cell* cell = nullptr;
+    size_t pos = m_enqueue_pos.load(std::memory_order_relaxed);
+    for (;;) {
+      cell = &m_cells[pos % m_capacity];
+      size_t seq = cell->sequence.load(std::memory_order_acquire);
+      auto diff = static_cast<std::ptrdiff_t>(seq) - static_cast<std::ptrdiff_t>(pos);
+      if (diff == 0) {
+        if (m_enqueue_pos.compare_exchange_weak(pos, pos + 1, std::memory_order_relaxed))
+          break;
+      } else if (diff < 0) {
+        return false;
+      } else {
+        pos = m_enqueue_pos.load(std::memory_order_relaxed);
+      }
+    }
+    cell->data = std::move(item);
+    cell->sequence.store(pos + 1, std::memory_order_release);
+    return true;
+  }
+
+  /**
+   * @brief Attempts to remove the oldest item from the queue.
+   */
+  bool try_pop(T& item)
+  {
+    Cell* cell = nullptr;
+    size_t pos = m_dequeue_pos.load(std::memory_order_relaxed);
+    for (;;) {
+      cell = &m_cells[pos % m_capacity];
+      size_t seq = cell->sequence.load(std::memory_order_acquire);
+      auto diff = static_cast<std::ptrdiff_t>(seq) - static_cast<std::ptrdiff_t>(pos + 1);
+      if (diff == 0) {
+        if (m_dequeue_pos.compare_exchange_weak(pos, pos + 1, std::memory_order_relaxed))
+          break;
+      } else if (diff < 0) {
+        return false;
+      } else {
+        pos = m_dequeue_pos.load(std::memory_order_relaxed);
+      }
+    }
+    item = std::move(cell->data);
+    cell->sequence.store(pos + m_capacity, std::memory_order_release);
+    return true;
+  }
+
+  /**
+   * @brief Number of items in the queue; only approximate while other threads are active.
+   */
+  size_t size_approx() const noexcept
+  {
+    size_t enq = m_enqueue_pos.load(std::memory_order_relaxed);
+    size_t deq = m_dequeue_pos.load(std::memory_order_relaxed);
+    return (enq > deq) ? (enq - deq) : 0;
+  }
+
+  size_t capacity() const noexcept { return m_capacity; }
+
+private:
+  struct Cell
+  {
+    std::atomic<size_t> sequence;
+    T data;
+  };
+
+  const size_t m_capacity;
+  std::unique_ptr<Cell[]> m_cells;
+
+  // keep the producer and consumer positions on separate cache lines
+  alignas(64) std::atomic<size_t> m_enqueue_pos;
+  alignas(64) std::atomic<size_t> m_dequeue_pos;
+};
+
+} // namespace hdf5libs
+} // namespace dunedaq
+
+#endif // HDF5LIBS_INCLUDE_HDF5LIBS_BOUNDEDQUEUE_HPP_
@@ -31,6 +31,7 @@
 #include <memory>
 #include <sstream>
 #include <string>
+#include <utility>
 #include <vector>
 
 namespace dunedaq {
@@ -63,6 +64,16 @@ ERS_DECLARE_ISSUE(hdf5libs,
                   "Requested File Layout for unconfigured subsystem type " << subsys_type << " (" << subsys_name << ")",
                   ((daqdataformats::SourceID::Subsystem)subsys_type)((std::string)subsys_name))
 
+ERS_DECLARE_ISSUE(hdf5libs,
+                  FileLayoutInvalidStorageParams,
+                  "Bad File Layout configuration: storage parameters for " << group_name << " are invalid: " << message,
+                  ((std::string)group_name)((std::string)message))
+
+ERS_DECLARE_ISSUE(hdf5libs,
+                  FileLayoutInvalidFileProperties,
+                  "Bad File Layout configuration: file properties are invalid: " << message,
+                  ((std::string)message))
+
 namespace hdf5libs {
 
 class HDF5FileLayout
@@ -71,7 +82,7 @@ public:
   /**
    * @brief Constructor from json conf, used in DataWriter. Version always most recent.
    */
-  explicit HDF5FileLayout(hdf5filelayout::FileLayoutParams conf, uint32_t version = 5); // NOLINT(build/unsigned)
+  explicit HDF5FileLayout(hdf5filelayout::FileLayoutParams conf, uint32_t version = 7); // NOLINT(build/unsigned)
 
   uint32_t get_version() const noexcept // NOLINT(build/unsigned)
   {
@@ -86,21 +97,68 @@ public:
 
   std::string get_record_header_dataset_name() const noexcept { return m_conf_params.record_header_dataset_name; }
 
-  std::map<daqdataformats::SourceID::Subsystem, hdf5filelayout::PathParams> get_path_params_map() const
+  bool is_packed_fragment_store() const noexcept { return m_version >= 6 && m_conf_params.packed_fragment_store; }
+
+  std::string get_file_level_group_name() const noexcept { return m_conf_params.file_level_group_name; }
+
+  // the number of record numbers per bucket group, 0 if the records are directly in the root group
+  uint64_t get_records_per_bucket() const noexcept // NOLINT(build/unsigned)
+  {
+    return (m_version >= 9) ? m_conf_params.records_per_bucket : 0;
+  }
+
+  // bucket groups are named after the record name prefix, followed by this suffix and the first record number
+  static constexpr char BUCKET_NAME_SUFFIX[] = "Bucket";
+
+  std::string get_bucket_name_prefix() const { return m_conf_params.record_name_prefix + BUCKET_NAME_SUFFIX; }
+
+  // the largest raw data that fit in the object header of a dataset, with room for its other messages
+  static constexpr size_t MAX_COMPACT_DATASET_BYTES = 64512;
+
+  size_t get_compact_dataset_threshold_bytes() const noexcept { return m_conf_params.compact_dataset_threshold_bytes; }
+
+  /**
+   * @brief get the file layout version that is needed to write files with the given parameters
+   */
+  static uint32_t get_required_version(const hdf5filelayout::FileLayoutParams& conf); // NOLINT(build/unsigned)
+
+  const std::map<daqdataformats::SourceID::Subsystem, hdf5filelayout::PathParams>& get_path_params_map() const
   {
     return m_path_params_map;
   }
 
-  hdf5filelayout::PathParams get_path_params(daqdataformats::SourceID::Subsystem type) const;
+  const hdf5filelayout::PathParams& get_path_params(daqdataformats::SourceID::Subsystem type) const;
 
   hdf5filelayout::FileLayoutParams get_file_layout_params() const { return m_conf_params; }
 
   /**
-   * @brief get string for record number
+   * @brief get the file properties, starting from the selected preset and applying the fields that are set
+   */
+  hdf5filelayout::FileProperties get_file_properties() const;
+
+  /**
+   * @brief get the file properties of a named preset ("lustre", "local-nvme"; "" for the HDF5 defaults)
+   */
+  static hdf5filelayout::FileProperties get_file_properties_preset(const std::string& preset_name);
+
+  /**
+   * @brief get the name of the bucket group of a record number
+   */
+  std::string get_bucket_name(uint64_t record_number) const; // NOLINT(build/unsigned)
+
+  /**
+   * @brief get string for record number, which starts with the bucket group name when records are bucketed
    */
   std::string get_record_number_string(uint64_t record_number, // NOLINT(build/unsigned)
                                        daqdataformats::sequence_number_t seq_num = 0) const;
 
+  /**
+   * @brief append the string for a record number to a string, which only allocates if it runs out of capacity
+   */
+  void append_record_number_string(std::string& record_number_string,
+                                   uint64_t record_number, // NOLINT(build/unsigned)
+                                   daqdataformats::sequence_number_t seq_num = 0) const;
+
   /**
    * @brief get string for Trigger number
    */
@@ -127,6 +185,13 @@ public:
    */
   std::vector<std::string> get_path_elements(const daqdataformats::FragmentHeader& fh) const;
 
+  /**
+   * @brief get the path for a record header, given its record number, sequence number and SourceID
+   */
+  std::vector<std::string> get_record_header_path_elements(uint64_t rec_num, // NOLINT(build/unsigned)
+                                                           daqdataformats::sequence_number_t seq_num,
+                                                           const daqdataformats::SourceID& source_id) const;
+
   /**
    * @brief extract Fragment GeoID given path elements
    */
@@ -245,6 +310,44 @@ private:
    * @brief Check configuration for any errors.
    */
   void check_config();
+
+  /**
+   * @brief append the name of the bucket group of a record number to a string
+   */
+  void append_bucket_name(std::string& bucket_name, uint64_t record_number) const; // NOLINT(build/unsigned)
+};
+
+/**
+ * @brief Builds the path elements of the record header and fragment datasets of a writer, in strings that are
+ * reused from one dataset to the next, so that no memory is allocated per dataset in the steady state. The record
+ * group name is formatted once per record, and the dataset name of each SourceID and fragment type once per file.
+ * The returned path elements are overwritten by the next call.
+ */
+class DatasetPathBuilder
+{
+public:
+  explicit DatasetPathBuilder(const HDF5FileLayout& file_layout);
+
+  const std::vector<std::string>& get_path_elements(const daqdataformats::TriggerRecordHeader& trh);
+  const std::vector<std::string>& get_path_elements(const daqdataformats::TimeSliceHeader& tsh);
+  const std::vector<std::string>& get_path_elements(const daqdataformats::FragmentHeader& fh);
+
+private:
+  void set_record(uint64_t rec_num, daqdataformats::sequence_number_t seq_num); // NOLINT(build/unsigned)
+  const std::vector<std::string>& set_record_header_dataset(uint64_t rec_num, // NOLINT(build/unsigned)
+                                                            daqdataformats::sequence_number_t seq_num,
+                                                            const daqdataformats::SourceID& source_id);
+
+  const HDF5FileLayout& m_file_layout;
+
+  // record group, raw data group and dataset names
+  std::vector<std::string> m_path_elements;
+  bool m_record_is_set = false;
+  uint64_t m_record_number = 0; // NOLINT(build/unsigned)
+  daqdataformats::sequence_number_t m_sequence_number = 0;
+
+  std::map<daqdataformats::SourceID, std::string> m_record_header_dataset_names;
+  std::map<std::pair<daqdataformats::SourceID, daqdataformats::fragment_type_t>, std::string> m_fragment_dataset_names;
 };
 
 } // namespace hdf5libs
@@ -0,0 +1,111 @@
+/**
+ * @file HDF5PackedFragmentStore.hpp
+ *
+ * Storage of record headers and Fragments as byte ranges of a few large,
+ * extendible datasets (one per subsystem), described by an index dataset
+ * with one row per record header or Fragment. This replaces the
+ * per-Fragment datasets in the packed file layout.
+ *
+ * This is part of the DUNE DAQ Application Framework, copyright 2020.
+ * Licensing/copyright details are in the COPYING file that you should have
+ * received with this code.
+ */
+
+#ifndef HDF5LIBS_INCLUDE_HDF5LIBS_HDF5PACKEDFRAGMENTSTORE_HPP_
+#define HDF5LIBS_INCLUDE_HDF5LIBS_HDF5PACKEDFRAGMENTSTORE_HPP_
+
+#include "daqdataformats/SourceID.hpp"
+
+#include <highfive/H5DataSet.hpp>
+#include <highfive/H5Group.hpp>
+#include <highfive/H5PropertyList.hpp>
+
+#include <cstdint>
+#include <functional>
+#include <map>
+#include <memory>
+#include <string>
+#include <utility>
+#include <vector>
+
+namespace dunedaq {
+namespace hdf5libs {
+
+/**
+ * @brief One row of the index of the packed store: where the bytes of a record header or Fragment are,
+ * and what is needed to rebuild its (logical) dataset path.
+ */
+struct PackedStoreEntry
+{
+  uint64_t record_number = 0;    // NOLINT(build/unsigned)
+  uint64_t offset = 0;           // NOLINT(build/unsigned)
+  uint64_t size = 0;             // NOLINT(build/unsigned)
+  uint32_t subsystem = 0;        // NOLINT(build/unsigned)
+  uint32_t source_id = 0;        // NOLINT(build/unsigned)
+  uint16_t sequence_number = 0;  // NOLINT(build/unsigned)
+  uint16_t fragment_type = 0;    // NOLINT(build/unsigned)
+  uint8_t is_record_header = 0;  // NOLINT(build/unsigned)
+};
+
+class HDF5PackedFragmentStore
+{
+public:
+  typedef std::function<HighFive::DataSetCreateProps(daqdataformats::SourceID::Subsystem)> create_props_function_t;
+
+  /**
+   * @brief Constructor for writing. The index dataset is created in the specified group right away,
+   * the per-subsystem store datasets when they are first needed, with the properties from the given function.
+   */
+  HDF5PackedFragmentStore(const HighFive::Group& store_group, create_props_function_t create_props_function);
+
+  /**
+   * @brief Constructor for reading
+   */
+  explicit HDF5PackedFragmentStore(const HighFive::Group& store_group);
+
+  /**
+   * @brief Adds the bytes of a record header or Fragment to the store. The offset of the entry is filled in here.
+   * The data are kept in memory until write_pending() is called.
+   */
+  void append(PackedStoreEntry entry, const char* data_ptr);
+
+  /**
+   * @brief Same as above, for data that are spread over several buffers, given as (pointer, size) pieces.
+   * The size of the entry is the sum of the sizes of the pieces.
+   */
+  void append(PackedStoreEntry entry, const std::vector<std::pair<const void*, size_t>>& data_pieces);
+
+  /**
+   * @brief Appends the pending data to the store datasets, and the pending entries to the index.
+   */
+  void write_pending();
+
+  // the index entries from the given one onwards
+  std::vector<PackedStoreEntry> read_index(size_t first_entry = 0) const;
+
+  // continues in the same group of a reopened file; nothing may be pending
+  void reopen(const HighFive::Group& store_group);
+
+  std::unique_ptr<char[]> read(const PackedStoreEntry& entry);
+
+  static std::string get_store_dataset_name(daqdataformats::SourceID::Subsystem subsystem);
+
+  static constexpr const char* s_index_dataset_name = "PackedStoreIndex";
+
+private:
+  HighFive::DataSet get_store_dataset(uint32_t subsystem, bool create_if_needed); // NOLINT(build/unsigned)
+
+  HighFive::Group m_store_group;
+  create_props_function_t m_create_props_function;
+
+  std::map<uint32_t, HighFive::DataSet> m_store_datasets; // NOLINT(build/unsigned)
+  std::map<uint32_t, size_t> m_store_sizes;               // NOLINT(build/unsigned)
+  std::map<uint32_t, std::vector<char>> m_pending_data;   // NOLINT(build/unsigned)
+  std::vector<PackedStoreEntry> m_pending_entries;
+  size_t m_index_size = 0;
+};
+
+} // namespace hdf5libs
+} // namespace dunedaq
+
+#endif // HDF5LIBS_INCLUDE_HDF5LIBS_HDF5PACKEDFRAGMENTSTORE_HPP_
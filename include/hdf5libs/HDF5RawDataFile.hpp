@@ -12,8 +12,12 @@
 #define HDF5LIBS_INCLUDE_HDF5LIBS_HDF5RAWDATAFILE_HPP_
 
 // DUNE-DAQ
+#include "hdf5libs/BoundedQueue.hpp"
 #include "hdf5libs/HDF5FileLayout.hpp"
+#include "hdf5libs/HDF5PackedFragmentStore.hpp"
 #include "hdf5libs/HDF5SourceIDHandler.hpp"
+#include "hdf5libs/HDF5WriteStatistics.hpp"
+#include "hdf5libs/WorkStealingThreadPool.hpp"
 #include "hdf5libs/hdf5filelayout/Structs.hpp"
 #include "hdf5libs/hdf5rawdatafile/Structs.hpp"
 
@@ -29,14 +33,23 @@
 #include <nlohmann/json.hpp>
 
 // System
+#include <atomic>
+#include <chrono>
+#include <condition_variable>
 #include <filesystem>
 #include <functional>
+#include <future>
 #include <iostream>
+#include <list>
 #include <map>
 #include <memory>
+#include <mutex>
 #include <set>
+#include <shared_mutex>
 #include <string>
 #include <sys/statvfs.h>
+#include <thread>
+#include <unordered_map>
 #include <utility>
 #include <variant>
 #include <vector>
@@ -53,6 +66,17 @@ ERS_DECLARE_ISSUE(hdf5libs,
                   "Issue when opening file " << file << ": " << message,
                   ((std::string)file)((std::string)message))
 
+ERS_DECLARE_ISSUE(hdf5libs,
+                  FileCloseFailed,
+                  "Issue when closing file " << file << ": " << message,
+                  ((std::string)file)((std::string)message))
+
+ERS_DECLARE_ISSUE(hdf5libs,
+                  FileClosed,
+                  "Record " << rec_num << "." << seq_num << " cannot be written to file " << file
+                            << ", which is closed or being closed",
+                  ((uint64_t)rec_num)((uint16_t)seq_num)((std::string)file)) // NOLINT(build/unsigned)
+
 ERS_DECLARE_ISSUE(hdf5libs,
                   IncompatibleOpenFlags,
                   "Issue when opening file " << file << ": "
@@ -101,8 +125,154 @@ ERS_DECLARE_ISSUE(hdf5libs, InvalidHDF5Attribute, "Attribute " << name << " not
 
 ERS_DECLARE_ISSUE(hdf5libs, HDF5AttributeExists, "Attribute " << name << " already exists.", ((std::string)name))
 
+ERS_DECLARE_ISSUE(hdf5libs,
+                  HDF5PropertyFailed,
+                  "Unable to apply HDF5 property \"" << property << "\"",
+                  ((std::string)property))
+
+ERS_DECLARE_ISSUE(hdf5libs,
+                  HDF5FilterNotAvailable,
+                  "HDF5 filter " << filter_id << " requested for " << group_name
+                                 << " is not available. Data will be written without it.",
+                  ((int)filter_id)((std::string)group_name))
+
+ERS_DECLARE_ISSUE(hdf5libs,
+                  AsyncWritingNotEnabled,
+                  "Asynchronous write requested for file " << file
+                                                           << ", but the file was opened with an async_write_queue_depth of 0.",
+                  ((std::string)file))
+
+ERS_DECLARE_ISSUE(hdf5libs,
+                  InvalidFlushPolicy,
+                  "Flush policy \"" << policy << "\" is not known. Valid policies are per_dataset, per_record,"
+                                     << " every_n_records, every_n_bytes, time_interval and on_close.",
+                  ((std::string)policy))
+
+ERS_DECLARE_ISSUE(hdf5libs,
+                  HDF5LibraryNotThreadSafe,
+                  "Background HDF5 I/O was requested for file "
+                    << file << ", but the HDF5 library was not built thread-safe."
+                    << " HDF5 calls from other threads must be serialized by the application.",
+                  ((std::string)file))
+
+ERS_DECLARE_ISSUE(hdf5libs,
+                  AsyncWriteFailed,
+                  "Background write of record " << rec_num << "." << seq_num << " to file " << file
+                                                << " failed: " << message,
+                  ((uint64_t)rec_num)((uint16_t)seq_num)((std::string)file)((std::string)message)) // NOLINT(build/unsigned)
+
+ERS_DECLARE_ISSUE(hdf5libs,
+                  InvalidFreeSpacePolicy,
+                  "Free space policy \"" << policy << "\" is not known. Valid policies are reject and wait.",
+                  ((std::string)policy))
+
+ERS_DECLARE_ISSUE(hdf5libs,
+                  InsufficientDiskSpace,
+                  "Record " << rec_num << "." << seq_num << " was not written to file " << file << ": "
+                            << free_bytes << " bytes are free on its file system, and the record needs "
+                            << record_bytes << " bytes on top of the reserve of " << reserve_bytes << " bytes",
+                  ((uint64_t)rec_num)((uint16_t)seq_num)                                  // NOLINT(build/unsigned)
+                  ((std::string)file)((size_t)free_bytes)((size_t)record_bytes)((size_t)reserve_bytes))
+
+ERS_DECLARE_ISSUE(hdf5libs,
+                  DiskSpaceQueryFailed,
+                  "Unable to get the free space on the file system of file " << file << ": " << message,
+                  ((std::string)file)((std::string)message))
+
+ERS_DECLARE_ISSUE(hdf5libs,
+                  PreallocationFailed,
+                  "Unable to preallocate space for file " << file << ": " << message
+                                                          << ". Space will no longer be preallocated for it.",
+                  ((std::string)file)((std::string)message))
+
+ERS_DECLARE_ISSUE(hdf5libs,
+                  CoreStagingUnavailable,
+                  "File " << file << " cannot be built in memory: " << reason << ". It is written on disk instead.",
+                  ((std::string)file)((std::string)reason))
+
+ERS_DECLARE_ISSUE(hdf5libs,
+                  InvalidMetadataCacheConfig,
+                  "Invalid metadata cache configuration for file " << file << ": " << message,
+                  ((std::string)file)((std::string)message))
+
+ERS_DECLARE_ISSUE(hdf5libs,
+                  FileImageWriteFailed,
+                  "Unable to write the in-memory image of file " << file << " to disk: " << message,
+                  ((std::string)file)((std::string)message))
+
+ERS_DECLARE_ISSUE(hdf5libs,
+                  ScatteredFragmentSizeMismatch,
+                  "Fragment with SourceID " << source_id << " has a size of " << header_size
+                                            << " bytes in its header, but its header and pieces add up to "
+                                            << pieces_size << " bytes",
+                  ((std::string)source_id)((size_t)header_size)((size_t)pieces_size))
+
+ERS_DECLARE_ISSUE(hdf5libs,
+                  PackedStoreNeedsUncompressedFragments,
+                  "Fragment with SourceID " << source_id << " cannot be written to file " << file
+                                            << ": the packed fragment store only takes uncompressed fragments.",
+                  ((std::string)source_id)((std::string)file))
+
 namespace hdf5libs {
 
+/**
+ * @brief A Fragment whose bytes (header included) have already been passed through the HDF5 filters
+ * that are configured for its subsystem, ready to be stored as the single chunk of its dataset.
+ * Bit i of the filter mask is set when filter i of the dataset's filter pipeline was not applied.
+ */
+struct PrecompressedFragment
+{
+  daqdataformats::FragmentHeader header; // header of the uncompressed Fragment; header.size is its full size
+  std::vector<char> data;
+  uint32_t filter_mask = 0; // NOLINT(build/unsigned)
+};
+
+/**
+ * @brief A Fragment whose payload is spread over several buffers (for example DMA buffers), which is written
+ * piece by piece into its dataset rather than being copied into a contiguous Fragment first.
+ * header.size is the full size of the Fragment: the size of the header plus the sizes of the pieces.
+ */
+struct ScatteredFragment
+{
+  daqdataformats::FragmentHeader header;
+  std::vector<std::pair<const void*, size_t>> payload_pieces; // (pointer, size); the buffers are not copied
+};
+
+// a Fragment of a record that is written with the compression pool, compressed on the pool or not
+struct PooledFragment;
+
+/**
+ * @brief Interface of the pools that the Fragments of a record are handed back to once the record is written,
+ * so that their buffers can be reused for the next records instead of being freed. A pool would typically
+ * hand out Fragments that were constructed in kReadOnlyMode over its own buffers, and take the buffers back
+ * with get_storage_location() when they are released.
+ */
+class FragmentBufferPool
+{
+public:
+  virtual ~FragmentBufferPool() = default;
+
+  // called in the writing thread (the I/O thread for write_async()) once the data of the Fragment is in the
+  // HDF5 library, or when the writing of its record failed. It must not throw.
+  virtual void release(std::unique_ptr<daqdataformats::Fragment> frag_ptr) = 0;
+};
+
+/**
+ * @brief One element of the record directory, the file-level dataset that lists the records in the file.
+ * The record header dataset path follows from the record ID and the SourceID of the header. The size
+ * counts the record header and fragments; the trigger timestamp is 0 for TimeSlices.
+ */
+struct RecordDirectoryEntry
+{
+  uint64_t record_number = 0;        // NOLINT(build/unsigned)
+  uint64_t trigger_timestamp = 0;    // NOLINT(build/unsigned)
+  uint64_t size_bytes = 0;           // NOLINT(build/unsigned)
+  uint32_t header_source_subsys = 0; // NOLINT(build/unsigned)
+  uint32_t header_source_id = 0;     // NOLINT(build/unsigned)
+  uint32_t fragment_count = 0;       // NOLINT(build/unsigned)
+  uint16_t sequence_number = 0;      // NOLINT(build/unsigned)
+};
+
 /**
  * @brief HDF5RawDataFile is the class responsible
  * for interfacing the DAQ format with the HDF5 file format.
@@ -117,6 +287,55 @@ public:
     TLVL_FILE_SIZE = 5
   };
 
+  // when the writer calls H5Fflush
+  enum class FlushPolicy
+  {
+    kPerDataset,    // after every dataset (the historical behaviour)
+    kPerRecord,     // after every record
+    kEveryNRecords, // after every flush_interval_records records
+    kEveryNBytes,   // once flush_interval_bytes bytes have been written since the last flush
+    kTimeInterval,  // at the end of a record, if flush_interval_ms have passed since the last flush
+    kOnClose        // only when the file is closed
+  };
+
+  // cumulative time spent in each stage of the writing pipeline, to size the compression thread pool
+  // against the time that is spent writing to the file
+  struct PipelineStageTimings
+  {
+    size_t compressed_fragment_count = 0;
+    size_t compression_input_bytes = 0;
+    size_t compression_output_bytes = 0;
+    double compression_seconds = 0;      // summed over the compression threads
+    double compression_wait_seconds = 0; // time that the writing thread waited for compressed fragments
+    size_t written_record_count = 0;
+    double write_seconds = 0; // time spent writing records to the file
+  };
+
+  static FlushPolicy string_to_flush_policy(const std::string& policy_name);
+  static std::string flush_policy_to_string(FlushPolicy policy);
+
+  // what happens to a record that would take the free space on the file system below the reserve
+  enum class FreeSpacePolicy
+  {
+    kReject, // throw InsufficientDiskSpace
+    kWait    // wait for space to be freed, up to the free_space_wait_timeout_ms, then reject
+  };
+
+  struct DiskSpaceStatus
+  {
+    std::string file_name;
+    size_t free_bytes = 0;
+    size_t reserve_bytes = 0;
+    size_t record_bytes = 0;
+    std::chrono::steady_clock::duration wait_time{ 0 }; // time that the record has waited so far
+  };
+
+  // called, in the writing thread, whenever a record finds the free space below the reserve; returns whether
+  // the record should (keep) wait(ing) for space to be freed. It replaces the decision of the FreeSpacePolicy.
+  typedef std::function<bool(const DiskSpaceStatus&)> low_disk_space_callback_t;
+
+  static FreeSpacePolicy string_to_free_space_policy(const std::string& policy_name);
+
   // define a record number type
   // that is a pair of the trigger record or timeslice number and sequence number
   typedef std::pair<uint64_t, daqdataformats::sequence_number_t> record_id_t; // NOLINT(build/unsigned)
@@ -130,16 +349,46 @@ public:
                   const hdf5filelayout::FileLayoutParams& fl_params,
                   hdf5rawdatafile::SrcIDGeoIDMap srcid_geoid_map,
                   std::string inprogress_filename_suffix = ".writing",
-                  unsigned open_flags = HighFive::File::Create);
+                  unsigned open_flags = HighFive::File::Create,
+                  const hdf5rawdatafile::WriterParams& writer_params = hdf5rawdatafile::WriterParams());
 
-  // constructor for reading
-  explicit HDF5RawDataFile(const std::string& file_name);
+  // constructor for reading. A file that is being written with the live_tail writer parameter can be
+  // followed with refresh(), if follow_live_file is set. Split files are recognized, and opened by the file name.
+  explicit HDF5RawDataFile(const std::string& file_name, bool follow_live_file = false);
 
+  // closes the file, or waits for a close_async() that is still in progress
   ~HDF5RawDataFile();
 
-  std::string get_file_name() const { return m_file_ptr->getName(); }
+  // closes the file on a background finalizer thread, which is shared by all files: queued records are written,
+  // then the closing attributes and the record directory, and the file is flushed, closed and renamed.
+  // Records cannot be written once it is called. The future carries any exception of the closing.
+  std::shared_future<void> close_async();
+
+  // closes the file in the calling thread, or waits for a close_async() in progress, and rethrows its failures
+  void finalize();
+
+  bool is_closed() const noexcept { return m_close_requested.load(); }
+
+  std::string get_file_name() const { return m_file_ptr ? m_file_ptr->getName() : m_bare_file_name; }
+
+  // the suffixes of the metadata and raw data files of a file that is written with split_files
+  static constexpr const char* SPLIT_METADATA_SUFFIX = "-m.h5";
+  static constexpr const char* SPLIT_RAW_DATA_SUFFIX = "-r.h5";
 
-  size_t get_recorded_size() const noexcept { return m_recorded_size; }
+  // whether the file with that name was written with split_files: there is no file with that name, but there are
+  // metadata and raw data files next to it. Such files are opened for reading by that name.
+  static bool is_split_file(const std::string& file_name);
+
+  bool is_split() const noexcept { return m_split_files; }
+
+  // the name of the file once it is closed; also valid after the closing
+  const std::string& get_bare_file_name() const noexcept { return m_bare_file_name; }
+
+  // the files that make up the file on disk once it is closed: the file itself, or the raw data file, the metadata
+  // file and, for a metadata file in another directory, the link to it
+  std::vector<std::string> get_final_file_names() const;
+
+  size_t get_recorded_size() const noexcept { return m_recorded_size.load(); }
 
   std::string get_record_type() const noexcept { return m_record_type; }
 
@@ -148,6 +397,8 @@ public:
 
   const HDF5FileLayout& get_file_layout() const { return *(m_file_layout_ptr.get()); }
 
+  FlushPolicy get_flush_policy() const noexcept { return m_flush_policy; }
+
   uint32_t get_version() const // NOLINT(build/unsigned)
   {
     return m_file_layout_ptr->get_version();
@@ -158,12 +409,79 @@ public:
   void write(const daqdataformats::TriggerRecord& tr);
   void write(const daqdataformats::TimeSlice& ts);
 
+  // writing of records whose fragments were compressed beforehand, for example with compress_fragment()
+  // on worker threads. Their datasets are written with direct chunk writes, bypassing the HDF5 filter pipeline.
+  void write(const daqdataformats::TriggerRecordHeader& trh,
+             const std::vector<PrecompressedFragment>& precompressed_frags);
+  void write(const daqdataformats::TimeSliceHeader& tsh, const std::vector<PrecompressedFragment>& precompressed_frags);
+
+  // scatter-gather writing of records whose fragment payloads are spread over several buffers. The header and
+  // pieces of each fragment are written at their offsets in its dataset, without assembling them first.
+  void write(const daqdataformats::TriggerRecordHeader& trh, const std::vector<ScatteredFragment>& scattered_frags);
+  void write(const daqdataformats::TimeSliceHeader& tsh, const std::vector<ScatteredFragment>& scattered_frags);
+
+  // writing of records that are handed over, whose Fragments are handed back to the pool once the record
+  // is written (or failed to be written). The pool has to outlive the writing.
+  void write(std::unique_ptr<daqdataformats::TriggerRecord> tr, FragmentBufferPool& buffer_pool);
+  void write(std::unique_ptr<daqdataformats::TimeSlice> ts, FragmentBufferPool& buffer_pool);
+
+  // applies the compression that is configured for the subsystem of the fragment; safe to call from any thread
+  PrecompressedFragment compress_fragment(const daqdataformats::Fragment& frag) const;
+
+  // asynchronous writing, available when the file was opened with a non-zero async_write_queue_depth.
+  // write_async() blocks while the queue is full; try_write_async() returns false instead, in which
+  // case the record is left with the caller. The returned future completes once the record is in the file.
+  std::future<void> write_async(std::unique_ptr<daqdataformats::TriggerRecord> tr);
+  std::future<void> write_async(std::unique_ptr<daqdataformats::TimeSlice> ts);
+  std::future<void> write_async(std::unique_ptr<daqdataformats::TriggerRecord> tr, FragmentBufferPool& buffer_pool);
+  std::future<void> write_async(std::unique_ptr<daqdataformats::TimeSlice> ts, FragmentBufferPool& buffer_pool);
+  bool try_write_async(std::unique_ptr<daqdataformats::TriggerRecord>& tr, std::future<void>& completion);
+  bool try_write_async(std::unique_ptr<daqdataformats::TimeSlice>& ts, std::future<void>& completion);
+
+  bool is_async() const noexcept { return m_write_queue_ptr != nullptr; }
+  size_t get_write_queue_depth() const noexcept { return m_write_queue_ptr ? m_write_queue_ptr->size_approx() : 0; }
+  size_t get_write_queue_capacity() const noexcept { return m_write_queue_ptr ? m_write_queue_ptr->capacity() : 0; }
+
+  // blocks until all records handed to write_async() have been written
+  void drain();
+
+  size_t get_compression_thread_count() const noexcept
+  {
+    return m_compression_pool_ptr ? m_compression_pool_ptr->get_thread_count() : 0;
+  }
+  PipelineStageTimings get_pipeline_stage_timings() const;
+
+  // latency histograms of the phases of the writing, throughput averages, and the largest and slowest records.
+  // May be called from any thread while records are being written.
+  WriteStatistics get_write_statistics() const;
+
+  // size and hit rate of the HDF5 metadata cache of the file
+  struct MetadataCacheStatus
+  {
+    size_t max_size_bytes = 0; // the current maximum, which the cache adapts between its configured bounds
+    size_t min_clean_size_bytes = 0;
+    size_t current_size_bytes = 0;
+    size_t entry_count = 0;
+    double hit_rate = 0; // since the file was opened
+  };
+
+  // waits for the record that is being written, if any
+  MetadataCacheStatus get_metadata_cache_status();
+
+  // free space on the file system of the file, as available to unprivileged users
+  size_t get_free_disk_space() const;
+
+  void set_low_disk_space_callback(low_disk_space_callback_t callback);
+
 private:
   HighFive::Group write(const daqdataformats::TriggerRecordHeader& trh,
                         HDF5SourceIDHandler::source_id_path_map_t& path_map);
   HighFive::Group write(const daqdataformats::TimeSliceHeader& tsh,
                         HDF5SourceIDHandler::source_id_path_map_t& path_map);
   void write(const daqdataformats::Fragment& frag, HDF5SourceIDHandler::source_id_path_map_t& path_map);
+  void write(const PrecompressedFragment& precompressed_frag, HDF5SourceIDHandler::source_id_path_map_t& path_map);
+  void write(const ScatteredFragment& scattered_frag, HDF5SourceIDHandler::source_id_path_map_t& path_map);
+  void write(const PooledFragment& pooled_frag, HDF5SourceIDHandler::source_id_path_map_t& path_map);
 
 public:
   // attribute writers/getters
@@ -184,6 +502,18 @@ public:
 
   std::vector<std::string> get_dataset_paths(std::string top_level_group_name = "");
 
+  // the records in the file, in the order in which they were written. When reading files that were written
+  // without a record directory (or were not closed properly), this is empty. A copy, since the I/O thread may
+  // be adding records.
+  std::vector<RecordDirectoryEntry> get_record_directory();
+
+  // picks up the records that were written since the file was opened for reading, or last refreshed,
+  // and returns their number. Only for files that were opened with follow_live_file.
+  size_t refresh();
+
+  // whether the writer has not closed the file yet (as of the opening, or the last refresh)
+  bool is_being_written() const { return !m_file_ptr->hasAttribute("closing_timestamp"); }
+
   record_id_set get_all_record_ids();
   record_id_set get_all_trigger_record_ids();
   record_id_set get_all_timeslice_ids();
@@ -436,13 +766,169 @@ private:
 
   std::unique_ptr<HighFive::File> m_file_ptr;
   std::unique_ptr<HDF5FileLayout> m_file_layout_ptr;
+  std::unique_ptr<DatasetPathBuilder> m_path_builder_ptr; // when writing
   const std::string m_bare_file_name;
   const unsigned m_open_flags;
 
   // Total size of data being written
-  size_t m_recorded_size;
+  std::atomic<size_t> m_recorded_size;
   std::string m_record_type;
 
+  // asynchronous writing: records are handed to the I/O thread through a bounded queue
+  struct PendingWrite
+  {
+    std::variant<std::unique_ptr<daqdataformats::TriggerRecord>, std::unique_ptr<daqdataformats::TimeSlice>> record;
+    std::promise<void> completion;
+    std::vector<std::future<PrecompressedFragment>> compressed_frags; // when the compression pool is used
+    FragmentBufferPool* buffer_pool = nullptr;                         // where the Fragments go once written
+  };
+  typedef BoundedQueue<std::unique_ptr<PendingWrite>> write_queue_t;
+
+  std::unique_ptr<write_queue_t> m_write_queue_ptr;
+  std::thread m_io_thread;
+  std::atomic<bool> m_io_thread_stop_requested{ false };
+  std::atomic<size_t> m_pending_write_count{ 0 };
+  std::mutex m_write_mutex; // serializes access to m_file_ptr between the I/O thread and the caller
+  std::mutex m_queue_wait_mutex;
+  std::condition_variable m_queue_not_empty_cv;
+  std::condition_variable m_queue_not_full_cv;
+  std::condition_variable m_writes_drained_cv;
+
+  std::future<void> enqueue_write(std::unique_ptr<PendingWrite> pending_write);
+  bool try_enqueue_write(std::unique_ptr<PendingWrite>& pending_write);
+  void check_io_thread_running(PendingWrite& pending_write);
+  void run_io_thread();
+  void stop_io_thread();
+
+  // closing, possibly on the finalizer thread. Queueing a record holds m_close_mutex shared, from the check that
+  // the file is open until the record is in the queue, so that the closing waits for it.
+  std::atomic<bool> m_close_requested{ false };
+  std::shared_future<void> m_close_future;
+  std::shared_mutex m_close_mutex;
+
+  std::shared_future<void> start_close(bool in_background);
+  void do_close();
+  void check_open_for_writing(uint64_t rec_num, daqdataformats::sequence_number_t seq_num) const; // NOLINT
+
+  void do_write_record(const daqdataformats::TriggerRecord& tr);
+  void do_write_record(const daqdataformats::TimeSlice& ts);
+  void do_write_record(const daqdataformats::TriggerRecord& tr,
+                       std::vector<std::future<PrecompressedFragment>>& compressed_frags);
+  void do_write_record(const daqdataformats::TimeSlice& ts,
+                       std::vector<std::future<PrecompressedFragment>>& compressed_frags);
+  template<typename RecordHeaderT, typename FragmentContainerT>
+  void do_write_record(const RecordHeaderT& record_header, const FragmentContainerT& fragments);
+  template<typename RecordT>
+  void do_write_and_hand_back(RecordT& record, FragmentBufferPool& buffer_pool);
+
+  // compression of fragments on a thread pool, ahead of the writing
+  std::unique_ptr<WorkStealingThreadPool> m_compression_pool_ptr;
+  std::atomic<size_t> m_compressed_fragment_count{ 0 };
+  std::atomic<size_t> m_compression_input_bytes{ 0 };
+  std::atomic<size_t> m_compression_output_bytes{ 0 };
+  std::atomic<int64_t> m_compression_time_ns{ 0 };
+  std::atomic<int64_t> m_compression_wait_time_ns{ 0 };
+  std::atomic<size_t> m_written_record_count{ 0 };
+  std::atomic<int64_t> m_write_time_ns{ 0 };
+
+  // write statistics, which are cheap enough to be always collected
+  WriteStatisticsCollector m_write_statistics{ std::chrono::milliseconds(10000) };
+
+  // the subsystems whose fragments are compressed on the pool: those with deflate (and optionally shuffle) as their
+  // only filters, and a single chunk per dataset. The others go through the HDF5 filter pipeline.
+  std::set<daqdataformats::SourceID::Subsystem> m_pool_compressed_subsystems;
+
+  // the futures of the fragments that are not compressed on the pool are left invalid
+  std::vector<std::future<PrecompressedFragment>> submit_compression(
+    const std::vector<std::unique_ptr<daqdataformats::Fragment>>& fragments);
+  std::vector<PooledFragment> collect_compressed_fragments(
+    const std::vector<std::unique_ptr<daqdataformats::Fragment>>& fragments,
+    std::vector<std::future<PrecompressedFragment>>& compressed_frags);
+
+  // flush control
+  FlushPolicy m_flush_policy = FlushPolicy::kPerDataset;
+  size_t m_flush_interval_records = 1;
+  size_t m_flush_interval_bytes = 0;
+  std::chrono::milliseconds m_flush_interval_time{ 0 };
+  size_t m_records_since_flush = 0;
+  size_t m_bytes_since_flush = 0;
+  std::chrono::steady_clock::time_point m_last_flush_time;
+
+  void flush_file();
+  void flush_dataset(); // H5Fflush only, for the per_dataset flush policy
+
+  // disk space management
+  size_t m_preallocation_extent_bytes = 0;
+  int m_preallocation_fd = -1; // owned by the HDF5 library
+  size_t m_preallocated_end = 0;
+  size_t m_free_space_reserve_bytes = 0;
+  FreeSpacePolicy m_free_space_policy = FreeSpacePolicy::kReject;
+  std::chrono::milliseconds m_free_space_wait_timeout{ 0 };
+  low_disk_space_callback_t m_low_disk_space_callback;
+  size_t m_last_free_space_bytes = 0;
+  size_t m_recorded_size_at_free_space_check = 0;
+  std::chrono::steady_clock::time_point m_last_free_space_check_time;
+
+  // in-memory building of the file with the core driver
+  size_t m_core_staging_max_bytes = 0;
+  bool m_core_staging_direct_io = false;
+  bool m_core_staging = false; // the file is still in memory
+  std::string m_inprogress_file_name;
+
+  void spill_core_image_if_needed(size_t record_size_bytes);
+  void write_core_image();
+
+  // bounds of the metadata cache, and eviction of the metadata of each record once it is written
+  size_t m_metadata_cache_max_bytes = 0;
+  size_t m_metadata_cache_initial_bytes = 0;
+  bool m_evict_on_close = false;
+
+  void add_metadata_cache_properties(HighFive::FileAccessProps& file_access_props) const;
+  void evict_record_groups(const std::string& record_group_path);
+
+  // metadata and raw data in separate files, with the split driver; the metadata file may be in another directory
+  bool m_split_files = false;
+  std::string m_split_metadata_directory;
+
+  std::string get_split_metadata_file_name(const std::string& file_name) const;
+  void rename_split_files();
+
+  void setup_preallocation();
+  void preallocate_if_needed(size_t record_size_bytes);
+  void check_free_space(const record_id_t& rid, size_t record_size_bytes);
+  void release_unused_preallocation();
+  void flush_after_record_if_needed(size_t record_size_bytes);
+
+  // record directory: filled while writing, stored when the file is closed, and loaded on opening for reading
+  std::vector<RecordDirectoryEntry> m_record_directory;
+  std::map<record_id_t, size_t> m_record_directory_index;
+
+  void write_record_directory();
+  bool load_record_directory();
+
+  // record layout dictionary: the distinct sets of record-level SourceID maps, keyed by
+  // HDF5SourceIDHandler::get_record_layout_key(), with the index of their group in the file-level group
+  bool m_record_layout_dictionary = false;
+  std::unordered_map<std::string, uint32_t> m_record_layout_indices; // NOLINT(build/unsigned)
+
+  bool store_record_layout(HighFive::Group& record_group,
+                           const daqdataformats::SourceID& record_header_source_id,
+                           const HDF5SourceIDHandler::source_id_path_map_t& source_id_path_map,
+                           const HDF5SourceIDHandler::fragment_type_source_id_map_t& fragment_type_source_id_map,
+                           const HDF5SourceIDHandler::subdetector_source_id_map_t& subdetector_source_id_map,
+                           HDF5SourceIDHandler& sid_handler);
+
+  // live tail: the writer adds each record to the record directory dataset as it is written, and readers
+  // read the new entries of the directory (and of the packed store index) on refresh()
+  bool m_live_tail = false;
+  bool m_follow_live_file = false;
+  std::string m_read_file_name;
+  bool m_record_directory_loaded = false;
+
+  void setup_live_tail();
+  void append_to_record_directory(const RecordDirectoryEntry& directory_entry);
+  std::unique_ptr<HighFive::File> open_for_reading(const std::string& file_name) const;
+
   // file layout writing/reading
   void write_file_layout();
   void read_file_layout();
@@ -452,27 +938,96 @@ private:
   void check_record_type(std::string);
 
   // writing to datasets
-  std::tuple<size_t, std::string, HighFive::Group> do_write(std::vector<std::string> const&, const char*, size_t);
+  std::pair<HighFive::DataSet, HighFive::Group> create_dataset(std::vector<std::string> const&,
+                                                               size_t,
+                                                               const HighFive::DataSetCreateProps&,
+                                                               size_t chunk_cache_bytes = 0);
+  std::tuple<size_t, std::string, HighFive::Group> do_write(std::vector<std::string> const&,
+                                                            const char*,
+                                                            size_t,
+                                                            const hdf5filelayout::PathParams* storage_params = nullptr);
+  std::tuple<size_t, std::string, HighFive::Group> do_write_precompressed(std::vector<std::string> const&,
+                                                                          const PrecompressedFragment&,
+                                                                          const hdf5filelayout::PathParams&);
+  std::tuple<size_t, std::string, HighFive::Group> do_write_scattered(
+    std::vector<std::string> const&,
+    const ScatteredFragment&,
+    const hdf5filelayout::PathParams* storage_params = nullptr);
+
+  // packed fragment store: record headers and fragments are appended to a few large datasets, and are
+  // known by their (logical) dataset paths, which are keys into the index when reading
+  std::unique_ptr<HDF5PackedFragmentStore> m_packed_store_ptr;
+  std::map<std::string, PackedStoreEntry> m_packed_store_entries;
+  size_t m_packed_store_index_size = 0; // when reading
+
+  std::tuple<size_t, std::string, HighFive::Group> do_write_packed(std::vector<std::string> const&,
+                                                                   const char*,
+                                                                   const PackedStoreEntry&);
+  std::tuple<size_t, std::string, HighFive::Group> do_write_packed(
+    std::vector<std::string> const&,
+    const std::vector<std::pair<const void*, size_t>>&,
+    const PackedStoreEntry&);
+  HighFive::DataSetCreateProps get_packed_store_create_props(daqdataformats::SourceID::Subsystem subsystem) const;
+  void load_packed_store_index();
+
+  // recently used groups in the write path, most recent first, keyed by their path in the file.
+  // The record group and its subgroups are only looked up or created when they are not in this cache.
+  typedef std::list<std::pair<std::string, HighFive::Group>> group_cache_list_t;
+  group_cache_list_t m_group_cache;
+  std::unordered_map<std::string, group_cache_list_t::iterator> m_group_cache_index;
+  std::string m_group_path_buffer;
+
+  HighFive::Group get_or_create_group(std::vector<std::string> const& path_elements, size_t depth);
+  HighFive::Group get_or_create_bucket_group(std::string const& bucket_name);
+  void add_to_group_cache(std::string const& group_path, HighFive::Group const& group);
+  void clear_group_cache();
+
+  // dataset storage (chunking/compression) settings for the subsystems that have any
+  std::map<daqdataformats::SourceID::Subsystem, hdf5filelayout::PathParams> m_dataset_storage_params;
+
+  void fill_dataset_storage_params();
+  HighFive::DataSetCreateProps get_dataset_create_props(const hdf5filelayout::PathParams* storage_params,
+                                                        size_t raw_data_size_bytes,
+                                                        bool single_chunk = false) const;
+  void add_filter_props(const hdf5filelayout::PathParams& storage_params,
+                        HighFive::DataSetCreateProps& data_set_create_props) const;
 
   // unpacking groups when reading
   void explore_subgroup(const HighFive::Group& parent_group,
                         std::string relative_path,
                         std::vector<std::string>& path_list);
 
+  // the record-level SourceID information of a record, and of the other records with the same record layout
+  struct RecordLayoutInfo
+  {
+    std::set<daqdataformats::SourceID> source_ids;
+    daqdataformats::SourceID record_header_source_id;
+    std::set<daqdataformats::SourceID> fragment_source_ids;
+    HDF5SourceIDHandler::source_id_geo_id_map_t source_id_geo_id_map;
+    HDF5SourceIDHandler::source_id_path_map_t source_id_path_map;
+    HDF5SourceIDHandler::subsystem_source_id_map_t subsystem_source_id_map;
+    HDF5SourceIDHandler::fragment_type_source_id_map_t fragment_type_source_id_map;
+    HDF5SourceIDHandler::subdetector_source_id_map_t subdetector_source_id_map;
+  };
+  struct RecordLevelInfo
+  {
+    std::shared_ptr<const RecordLayoutInfo> layout_ptr;
+    std::string path_prefix; // the record group, for the paths of a shared record layout, which are relative to it
+  };
+
   // adds record-level information to caches, if needed
   void add_record_level_info_to_caches_if_needed(record_id_t rid);
+  std::shared_ptr<const RecordLayoutInfo> read_record_layout(const HighFive::Group& group,
+                                                             HDF5SourceIDHandler& sid_handler) const;
+  const RecordLayoutInfo& get_record_layout(const record_id_t& rid);
+  std::string get_source_id_path(const record_id_t& rid, const daqdataformats::SourceID& source_id);
 
-  // caches of full-file and record-specific information
+  // caches of full-file and record-specific information. The records with the same record layout share its
+  // parsed maps.
   record_id_set m_all_record_ids_in_file;
   HDF5SourceIDHandler::source_id_geo_id_map_t m_file_level_source_id_geo_id_map;
-  std::map<record_id_t, std::set<daqdataformats::SourceID>> m_source_id_cache;
-  std::map<record_id_t, daqdataformats::SourceID> m_record_header_source_id_cache;
-  std::map<record_id_t, std::set<daqdataformats::SourceID>> m_fragment_source_id_cache;
-  std::map<record_id_t, HDF5SourceIDHandler::source_id_path_map_t> m_source_id_path_cache;
-  std::map<record_id_t, HDF5SourceIDHandler::source_id_geo_id_map_t> m_source_id_geo_id_cache;
-  std::map<record_id_t, HDF5SourceIDHandler::subsystem_source_id_map_t> m_subsystem_source_id_cache;
-  std::map<record_id_t, HDF5SourceIDHandler::fragment_type_source_id_map_t> m_fragment_type_source_id_cache;
-  std::map<record_id_t, HDF5SourceIDHandler::subdetector_source_id_map_t> m_subdetector_source_id_cache;
+  std::map<record_id_t, RecordLevelInfo> m_record_level_info_cache;
+  std::map<uint32_t, std::shared_ptr<const RecordLayoutInfo>> m_record_layout_cache; // NOLINT(build/unsigned)
 };
 
 // HDF5RawDataFile attribute writers/getters definitions
@@ -0,0 +1,129 @@
+/**
+ * @file HDF5RawDataFileSequence.hpp
+ *
+ * Writer of a sequence of HDF5RawDataFiles, which moves on to a new file
+ * when the current one reaches a size, record count or duration limit.
+ * The next file is created and initialized on a background thread before
+ * it is needed, and the previous one is finalized (attributes, record
+ * directory, flush and rename) with HDF5RawDataFile::close_async(), so
+ * that neither is on the path of the records.
+ *
+ * This is part of the DUNE DAQ Application Framework, copyright 2020.
+ * Licensing/copyright details are in the COPYING file that you should have
+ * received with this code.
+ */
+
+#ifndef HDF5LIBS_INCLUDE_HDF5LIBS_HDF5RAWDATAFILESEQUENCE_HPP_
+#define HDF5LIBS_INCLUDE_HDF5LIBS_HDF5RAWDATAFILESEQUENCE_HPP_
+
+#include "hdf5libs/HDF5RawDataFile.hpp"
+#include "hdf5libs/WorkStealingThreadPool.hpp"
+#include "hdf5libs/hdf5filelayout/Structs.hpp"
+#include "hdf5libs/hdf5rawdatafile/Structs.hpp"
+
+#include "daqdataformats/TimeSlice.hpp"
+#include "daqdataformats/TriggerRecord.hpp"
+
+#include <chrono>
+#include <functional>
+#include <future>
+#include <list>
+#include <memory>
+#include <string>
+
+namespace dunedaq {
+
+ERS_DECLARE_ISSUE(hdf5libs,
+                  FileSequenceClosed,
+                  "Record " << rec_num << " cannot be written: the file sequence of " << application_name
+                            << " is closed",
+                  ((uint64_t)rec_num)((std::string)application_name)) // NOLINT(build/unsigned)
+
+namespace hdf5libs {
+
+class HDF5RawDataFileSequence
+{
+public:
+  // gives the (final) name of the file with the given index
+  typedef std::function<std::string(size_t file_index)> file_name_function_t;
+
+  HDF5RawDataFileSequence(file_name_function_t file_name_function,
+                          daqdataformats::run_number_t run_number,
+                          size_t first_file_index,
+                          std::string application_name,
+                          const hdf5filelayout::FileLayoutParams& fl_params,
+                          hdf5rawdatafile::SrcIDGeoIDMap srcid_geoid_map,
+                          const hdf5rawdatafile::FileSequenceParams& sequence_params,
+                          const hdf5rawdatafile::WriterParams& writer_params = hdf5rawdatafile::WriterParams(),
+                          std::string inprogress_filename_suffix = ".writing");
+
+  // closes the sequence, if that was not done already
+  ~HDF5RawDataFileSequence();
+
+  HDF5RawDataFileSequence(const HDF5RawDataFileSequence&) = delete;
+  HDF5RawDataFileSequence& operator=(const HDF5RawDataFileSequence&) = delete;
+  HDF5RawDataFileSequence(HDF5RawDataFileSequence&&) = delete;
+  HDF5RawDataFileSequence& operator=(HDF5RawDataFileSequence&&) = delete;
+
+  // writes the record to the current file, after moving on to the next file if a limit is reached.
+  // A record always goes to a single file; a file holds at least one record.
+  void write(const daqdataformats::TriggerRecord& tr);
+  void write(const daqdataformats::TimeSlice& ts);
+
+  // moves on to the next file now (if the current file holds any records)
+  void roll_over();
+
+  // finalizes the current file, removes the pre-opened one, and waits until all files are finalized
+  void close();
+
+  bool is_closed() const noexcept { return m_closed; }
+
+  // the file that records are currently written to
+  HDF5RawDataFile& get_current_file() { return *m_current_file_ptr; }
+  size_t get_current_file_index() const noexcept { return m_current_file_index; }
+  size_t get_records_in_current_file() const noexcept { return m_records_in_current_file; }
+
+  // the number of files that were started, including the current one
+  size_t get_file_count() const noexcept { return m_file_count; }
+
+  bool is_next_file_preopened() const noexcept { return m_background_pool_ptr != nullptr; }
+
+private:
+  std::unique_ptr<HDF5RawDataFile> open_file(size_t file_index) const;
+  void preopen_next_file();
+  void switch_file();
+  void finalize_file(std::unique_ptr<HDF5RawDataFile> file_ptr);
+  void wait_for_closing(HDF5RawDataFile& file);
+  bool roll_over_needed(size_t record_size_bytes) const;
+
+  template<typename RecordT>
+  void do_write(const RecordT& record, uint64_t record_number, size_t record_size_bytes); // NOLINT(build/unsigned)
+
+  const file_name_function_t m_file_name_function;
+  const daqdataformats::run_number_t m_run_number;
+  const std::string m_application_name;
+  const hdf5filelayout::FileLayoutParams m_fl_params;
+  const hdf5rawdatafile::SrcIDGeoIDMap m_srcid_geoid_map;
+  const hdf5rawdatafile::FileSequenceParams m_sequence_params;
+  const hdf5rawdatafile::WriterParams m_writer_params;
+  const std::string m_inprogress_filename_suffix;
+
+  std::unique_ptr<HDF5RawDataFile> m_current_file_ptr;
+  size_t m_current_file_index;
+  size_t m_records_in_current_file = 0;
+  std::chrono::steady_clock::time_point m_current_file_start_time;
+  size_t m_file_count = 0;
+  bool m_closed = false;
+
+  // background creation of the next file, on a single thread
+  std::unique_ptr<WorkStealingThreadPool> m_background_pool_ptr;
+  std::future<std::unique_ptr<HDF5RawDataFile>> m_next_file;
+
+  // the previous files, until they are closed
+  std::list<std::unique_ptr<HDF5RawDataFile>> m_closing_files;
+};
+
+} // namespace hdf5libs
+} // namespace dunedaq
+
+#endif // HDF5LIBS_INCLUDE_HDF5LIBS_HDF5RAWDATAFILESEQUENCE_HPP_
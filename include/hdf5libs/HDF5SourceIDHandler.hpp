@@ -35,11 +35,15 @@ namespace dunedaq {
 namespace hdf5libs {
 
 /**
- * At the moment, this class is designed to handle different versions of
- * translation (to/from strings) when *reading* data.  For writing data,
- * the interface is currently designed to only support the current version
- * of the translation.  If we ever decide to add support for writing of
- * different versions, then the 'store' methods would become non-static.
+ * This class handles the different versions of the translation of the
+ * SourceID-related maps when *reading* data.  Up to version 6 of the file
+ * layout, the record-level maps are JSON strings; from version 7 on, they
+ * are arrays of compound (binary) elements.  Since records can be written
+ * with either encoding, the record-level 'store' methods are non-static.
+ * The file-level map is always a JSON string.  From version 8 on, records
+ * may instead refer to a record layout: a group in the file-level group
+ * that holds the binary maps, with paths that are relative to the record
+ * group, and that is shared by all the records with the same maps.
  */
 
 class HDF5SourceIDHandler
@@ -51,6 +55,34 @@ public:
   typedef std::map<daqdataformats::FragmentType, std::set<daqdataformats::SourceID>> fragment_type_source_id_map_t;
   typedef std::map<detdataformats::DetID::Subdetector, std::set<daqdataformats::SourceID>> subdetector_source_id_map_t;
 
+  // elements of the binary encoding of the record-level maps
+  struct SourceIDElement
+  {
+    uint32_t subsys = 0; // NOLINT(build/unsigned)
+    uint32_t id = 0;     // NOLINT(build/unsigned)
+  };
+  // the paths are concatenated in a separate string attribute
+  struct SourceIDPathElement
+  {
+    uint32_t subsys = 0;      // NOLINT(build/unsigned)
+    uint32_t id = 0;          // NOLINT(build/unsigned)
+    uint32_t path_offset = 0; // NOLINT(build/unsigned)
+    uint32_t path_size = 0;   // NOLINT(build/unsigned)
+  };
+  // one element per SourceID; the key is the FragmentType or the Subdetector
+  struct KeyedSourceIDElement
+  {
+    uint32_t key = 0;    // NOLINT(build/unsigned)
+    uint32_t subsys = 0; // NOLINT(build/unsigned)
+    uint32_t id = 0;     // NOLINT(build/unsigned)
+  };
+
+  // first version of the file layout with binary record-level maps
+  static constexpr uint32_t s_first_binary_map_version = 7; // NOLINT(build/unsigned)
+
+  // first version of the file layout in which records may refer to a record layout
+  static constexpr uint32_t s_first_record_layout_version = 8; // NOLINT(build/unsigned)
+
   /**
    * Populates the specified source_id_geo_id map with information contained in the
    * specified Hardware Map.
@@ -67,32 +99,45 @@ public:
    */
   static void store_file_level_geo_id_info(HighFive::File& h5_file, const source_id_geo_id_map_t& the_map);
 
+  /**
+   * @brief Constructor.
+   */
+  explicit HDF5SourceIDHandler(const uint32_t version); // NOLINT(build/unsigned)
+
   /**
    * Stores the SourceID of the record header DataSet in the specified HighFive::Group.
    */
-  static void store_record_header_source_id(HighFive::Group& record_group, const daqdataformats::SourceID& source_id);
+  void store_record_header_source_id(HighFive::Group& record_group, const daqdataformats::SourceID& source_id);
 
   /**
    * Stores the map from SourceID to HDF5 Path in the specified HighFive::Group.
    */
-  static void store_record_level_path_info(HighFive::Group& record_group, const source_id_path_map_t& the_map);
+  void store_record_level_path_info(HighFive::Group& record_group, const source_id_path_map_t& the_map);
 
   /**
    * Stores the map from FragmentType to SourceID in the specified HighFive::Group.
    */
-  static void store_record_level_fragment_type_map(HighFive::Group& record_group,
-                                                   const fragment_type_source_id_map_t& the_map);
+  void store_record_level_fragment_type_map(HighFive::Group& record_group,
+                                            const fragment_type_source_id_map_t& the_map);
 
   /**
    * Stores the map from DetID::Subdetector to SourceID in the specified HighFive::Group.
    */
-  static void store_record_level_subdetector_map(HighFive::Group& record_group,
-                                                 const subdetector_source_id_map_t& the_map);
+  void store_record_level_subdetector_map(HighFive::Group& record_group, const subdetector_source_id_map_t& the_map);
 
   /**
-   * @brief Constructor.
+   * Stores the index of the record layout that holds the maps of the record in the specified HighFive::Group.
    */
-  explicit HDF5SourceIDHandler(const uint32_t version); // NOLINT(build/unsigned)
+  void store_record_layout_index(HighFive::Group& record_group, uint32_t layout_index); // NOLINT(build/unsigned)
+
+  /**
+   * Produces a key that identifies the record-level maps of a record, with the paths relative
+   * to the record group, so that the records with the same maps have the same key.
+   */
+  static std::string get_record_layout_key(const daqdataformats::SourceID& record_header_source_id,
+                                           const source_id_path_map_t& relative_path_map,
+                                           const fragment_type_source_id_map_t& fragment_type_map,
+                                           const subdetector_source_id_map_t& subdetector_map);
 
   /**
    * Adds entries to the specified SourceID-to-GeoID map using information
@@ -112,6 +157,13 @@ public:
    */
   daqdataformats::SourceID fetch_record_header_source_id(const HighFive::Group& record_group);
 
+  /**
+   * Fetches the index of the record layout that the specified HighFive::Group refers to.
+   * Returns false if it does not refer to one, and the maps are stored in the group itself.
+   */
+  bool fetch_record_layout_index(const HighFive::Group& record_group,
+                                 uint32_t& layout_index); // NOLINT(build/unsigned)
+
   /**
    * Adds entries to the specified SourceID-to-HDF5-Path map using information
    * stored at the record level in the specified HighFive::Group.
@@ -221,11 +273,25 @@ private:
    */
   static void parse_json_string(const std::string& json_string, subdetector_source_id_map_t& subdetector_source_id_map);
 
+  /**
+   * Produces the binary elements that correspond to the specified FragmentType or Subdetector map
+   */
+  template<typename K>
+  static std::vector<KeyedSourceIDElement> get_binary_elements(
+    const std::map<K, std::set<daqdataformats::SourceID>>& keyed_source_id_map);
+
+  /**
+   * Adds the specified binary elements to the specified FragmentType or Subdetector map
+   */
+  template<typename K>
+  static void parse_binary_elements(const std::vector<KeyedSourceIDElement>& elements,
+                                    std::map<K, std::set<daqdataformats::SourceID>>& keyed_source_id_map);
+
   /**
    * Writes the specified attribute name and value to the specified HightFive File or Group.
    */
   template<typename C, typename T>
-  static void write_attribute(HighFive::AnnotateTraits<C>& h5annt, const std::string& name, T value);
+  static void write_attribute(HighFive::AnnotateTraits<C>& h5annt, const std::string& name, const T& value);
 
   /**
    * Fetches the attribute with the specified name from the specified HightFive File or Group.
@@ -236,7 +302,7 @@ private:
 
 template<typename C, typename T>
 void
-HDF5SourceIDHandler::write_attribute(HighFive::AnnotateTraits<C>& h5annt, const std::string& name, T value)
+HDF5SourceIDHandler::write_attribute(HighFive::AnnotateTraits<C>& h5annt, const std::string& name, const T& value)
 {
   if (!(h5annt.hasAttribute(name)))
     h5annt.createAttribute(name, value);
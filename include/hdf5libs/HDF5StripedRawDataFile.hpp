@@ -0,0 +1,158 @@
+/**
+ * @file HDF5StripedRawDataFile.hpp
+ *
+ * Writer and reader of a set of HDF5RawDataFiles that are written concurrently,
+ * typically on different file systems, with whole records distributed over them.
+ * Each file (stripe) is written by its own background I/O thread, and a small
+ * JSON manifest lists the files and the stripe of each record, in the order in
+ * which the records were written, so that the reader can put them back in order.
+ *
+ * This is part of the DUNE DAQ Application Framework, copyright 2020.
+ * Licensing/copyright details are in the COPYING file that you should have
+ * received with this code.
+ */
+
+#ifndef HDF5LIBS_INCLUDE_HDF5LIBS_HDF5STRIPEDRAWDATAFILE_HPP_
+#define HDF5LIBS_INCLUDE_HDF5LIBS_HDF5STRIPEDRAWDATAFILE_HPP_
+
+#include "hdf5libs/HDF5RawDataFile.hpp"
+#include "hdf5libs/hdf5filelayout/Structs.hpp"
+#include "hdf5libs/hdf5rawdatafile/Structs.hpp"
+
+#include "daqdataformats/TimeSlice.hpp"
+#include "daqdataformats/TriggerRecord.hpp"
+
+#include <future>
+#include <map>
+#include <memory>
+#include <string>
+#include <utility>
+#include <vector>
+
+namespace dunedaq {
+
+ERS_DECLARE_ISSUE(hdf5libs,
+                  InvalidStripePlacementPolicy,
+                  "Stripe placement policy \"" << policy << "\" is not known. Valid policies are round_robin and"
+                                                << " least_loaded.",
+                  ((std::string)policy))
+
+ERS_DECLARE_ISSUE(hdf5libs,
+                  StripedFileClosed,
+                  "Record " << rec_num << " cannot be written: the striped file with manifest " << manifest_file
+                            << " is closed",
+                  ((uint64_t)rec_num)((std::string)manifest_file)) // NOLINT(build/unsigned)
+
+ERS_DECLARE_ISSUE(hdf5libs,
+                  StripeManifestFailed,
+                  "Issue with the stripe manifest " << manifest_file << ": " << message,
+                  ((std::string)manifest_file)((std::string)message))
+
+namespace hdf5libs {
+
+class HDF5StripedRawDataFile
+{
+public:
+  // how the stripe of each record is chosen
+  enum class PlacementPolicy
+  {
+    kRoundRobin, // the stripes in turn
+    kLeastLoaded // the stripe with the fewest records waiting for its I/O thread, then the fewest bytes written
+  };
+
+  static PlacementPolicy string_to_placement_policy(const std::string& policy_name);
+
+  typedef HDF5RawDataFile::record_id_t record_id_t;
+
+  // constructor for writing, with one file name per stripe. All stripes are written with the same writer
+  // parameters, except that an async_write_queue_depth of 0 is raised to DEFAULT_STRIPE_QUEUE_DEPTH.
+  HDF5StripedRawDataFile(std::string manifest_file_name,
+                         const std::vector<std::string>& file_names,
+                         daqdataformats::run_number_t run_number,
+                         size_t file_index,
+                         std::string application_name,
+                         const hdf5filelayout::FileLayoutParams& fl_params,
+                         const hdf5rawdatafile::SrcIDGeoIDMap& srcid_geoid_map,
+                         const hdf5rawdatafile::StripeParams& stripe_params = hdf5rawdatafile::StripeParams(),
+                         const hdf5rawdatafile::WriterParams& writer_params = hdf5rawdatafile::WriterParams(),
+                         std::string inprogress_filename_suffix = ".writing");
+
+  // constructor for reading: opens the manifest and all of the files that it lists
+  explicit HDF5StripedRawDataFile(const std::string& manifest_file_name);
+
+  // closes the files and writes the manifest, if that was not done already
+  ~HDF5StripedRawDataFile();
+
+  HDF5StripedRawDataFile(const HDF5StripedRawDataFile&) = delete;
+  HDF5StripedRawDataFile& operator=(const HDF5StripedRawDataFile&) = delete;
+  HDF5StripedRawDataFile(HDF5StripedRawDataFile&&) = delete;
+  HDF5StripedRawDataFile& operator=(HDF5StripedRawDataFile&&) = delete;
+
+  static constexpr size_t DEFAULT_STRIPE_QUEUE_DEPTH = 4;
+
+  // queues the record on the I/O thread of one of the stripes, and returns the future of its writing.
+  // Records are to be written from a single thread.
+  std::future<void> write(std::unique_ptr<daqdataformats::TriggerRecord> tr);
+  std::future<void> write(std::unique_ptr<daqdataformats::TimeSlice> ts);
+
+  // closes all the files concurrently, waits for them, and writes the manifest, which lists the records
+  // that made it into the files. Failures are reported as ERS errors.
+  void close();
+
+  bool is_closed() const noexcept { return m_closed; }
+
+  const std::string& get_manifest_file_name() const noexcept { return m_manifest_file_name; }
+
+  // the files of the stripes, until close()
+  size_t get_stripe_count() const noexcept { return m_stripes.size(); }
+  HDF5RawDataFile& get_stripe(size_t stripe_index) { return *m_stripes.at(stripe_index); }
+  PlacementPolicy get_placement_policy() const noexcept { return m_placement_policy; }
+
+  // the records in the order in which they were written; when writing, the records that were handed over so far
+  const std::vector<record_id_t>& get_record_ids() const noexcept { return m_record_ids; }
+
+  // the stripe that holds a record; throws RecordIDNotFound if there is no such record
+  size_t get_stripe_index(const record_id_t& rid) const;
+  HDF5RawDataFile& get_file_for_record(const record_id_t& rid) { return *m_stripes[get_stripe_index(rid)]; }
+
+  daqdataformats::TriggerRecord get_trigger_record(const record_id_t& rid)
+  {
+    return get_file_for_record(rid).get_trigger_record(rid);
+  }
+  daqdataformats::TimeSlice get_timeslice(const record_id_t& rid)
+  {
+    return get_file_for_record(rid).get_timeslice(rid);
+  }
+
+private:
+  size_t choose_stripe() const;
+  void add_record(const record_id_t& rid, size_t stripe_index);
+  void write_manifest();
+  void read_manifest();
+
+  template<typename RecordT>
+  std::future<void> do_write(std::unique_ptr<RecordT> record_ptr, const record_id_t& rid);
+
+  std::string m_manifest_file_name;
+  std::string m_inprogress_filename_suffix;
+  PlacementPolicy m_placement_policy = PlacementPolicy::kRoundRobin;
+  bool m_writing = false;
+  bool m_closed = false;
+
+  // when writing: whether the records are queued on the I/O threads of the stripes, or written in the calling thread
+  bool m_async = true;
+
+  std::vector<std::unique_ptr<HDF5RawDataFile>> m_stripes;
+  std::vector<std::string> m_file_names;
+  size_t m_next_stripe = 0;
+
+  // the records in order, and the stripe that holds each of them
+  std::vector<record_id_t> m_record_ids;
+  std::vector<size_t> m_record_stripes;
+  std::map<record_id_t, size_t> m_record_stripe_index;
+};
+
+} // namespace hdf5libs
+} // namespace dunedaq
+
+#endif // HDF5LIBS_INCLUDE_HDF5LIBS_HDF5STRIPEDRAWDATAFILE_HPP_
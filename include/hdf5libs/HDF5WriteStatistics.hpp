@@ -0,0 +1,224 @@
+/**
+ * @file HDF5WriteStatistics.hpp
+ *
+ * Counters and latency histograms of the writing of records to an HDF5 file.
+ * They are updated with relaxed atomic operations only, so that they can be
+ * left enabled in the write path, and read at any time from other threads.
+ *
+ * This is part of the DUNE DAQ Application Framework, copyright 2020.
+ * Licensing/copyright details are in the COPYING file that you should have
+ * received with this code.
+ */
+
+#ifndef HDF5LIBS_INCLUDE_HDF5LIBS_HDF5WRITESTATISTICS_HPP_
+#define HDF5LIBS_INCLUDE_HDF5LIBS_HDF5WRITESTATISTICS_HPP_
+
+#include <array>
+#include <atomic>
+#include <chrono>
+#include <cstddef>
+#include <cstdint>
+
+namespace dunedaq {
+namespace hdf5libs {
+
+// the phases of the writing of a record whose latencies are histogrammed separately
+enum class WritePhase
+{
+  kGroupCreation,   // opening or creating a group that was not in the group cache
+  kDatasetCreation, // creating a dataset
+  kRawWrite,        // writing the bytes of a dataset, a direct chunk write, or appending to the packed store
+  kFlush,           // H5Fflush
+  kAttributeStore,  // storing the record-level SourceID maps as attributes
+  kPreallocation,   // allocating file space ahead of the write cursor
+  kFileImageWrite,  // writing the image of a file that was built in memory to disk
+  kRecordDirectory, // appending the entry of a record to the record directory of a file that is read while written
+  kCount
+};
+
+/**
+ * @brief A copy of the contents of a Log2Histogram. Bucket 0 counts the values that are 0,
+ * bucket i>0 the values in [2^(i-1), 2^i).
+ */
+struct HistogramSnapshot
+{
+  static constexpr size_t s_bucket_count = 48;
+
+  uint64_t count = 0; // NOLINT(build/unsigned)
+  uint64_t sum = 0;   // NOLINT(build/unsigned)
+  uint64_t max = 0;   // NOLINT(build/unsigned)
+  std::array<uint64_t, s_bucket_count> bucket_counts{}; // NOLINT(build/unsigned)
+
+  double get_mean() const noexcept { return (count > 0) ? static_cast<double>(sum) / count : 0; }
+
+  // upper edge of the bucket that holds the requested quantile (between 0 and 1), capped at the maximum
+  uint64_t get_quantile(double quantile) const noexcept; // NOLINT(build/unsigned)
+};
+
+/**
+ * @brief Histogram with power-of-two buckets, which may be filled and read concurrently without locks
+ */
+class Log2Histogram
+{
+public:
+  void add(uint64_t value) noexcept; // NOLINT(build/unsigned)
+  HistogramSnapshot get_snapshot() const noexcept;
+
+private:
+  std::array<std::atomic<uint64_t>, HistogramSnapshot::s_bucket_count> m_bucket_counts{}; // NOLINT(build/unsigned)
+  std::atomic<uint64_t> m_count{ 0 };                                                      // NOLINT(build/unsigned)
+  std::atomic<uint64_t> m_sum{ 0 };                                                        // NOLINT(build/unsigned)
+  std::atomic<uint64_t> m_max{ 0 };                                                        // NOLINT(build/unsigned)
+};
+
+// a record that stands out, with the number of bytes that were written for it and the time that its writing took
+struct RecordWriteSummary
+{
+  uint64_t record_number = 0;   // NOLINT(build/unsigned)
+  uint16_t sequence_number = 0; // NOLINT(build/unsigned)
+  uint64_t size_bytes = 0;      // NOLINT(build/unsigned)
+  uint64_t write_time_ns = 0;   // NOLINT(build/unsigned)
+  uint32_t fragment_count = 0;  // NOLINT(build/unsigned)
+};
+
+/**
+ * @brief The statistics that are returned by HDF5RawDataFile::get_write_statistics(). The histograms
+ * are read one after the other while records may be being written, so their counts may differ by a record.
+ */
+struct WriteStatistics
+{
+  std::array<HistogramSnapshot, static_cast<size_t>(WritePhase::kCount)> phase_latency_ns;
+  HistogramSnapshot record_write_time_ns;
+  HistogramSnapshot fragments_per_record;
+
+  size_t record_count = 0;
+  size_t bytes_written = 0;
+
+  // exponentially-weighted moving averages over the averaging interval of the writer
+  double bytes_per_second = 0;
+  double records_per_second = 0;
+
+  RecordWriteSummary largest_record;
+  RecordWriteSummary slowest_record;
+
+  // disk space management
+  size_t preallocated_bytes = 0;    // allocated ahead of the write cursor
+  size_t free_disk_space_bytes = 0; // at the last check of the free space; 0 if it is not checked
+  size_t delayed_record_count = 0;  // records that waited for free space
+  size_t rejected_record_count = 0; // records that were not written for lack of free space
+  double free_space_wait_seconds = 0;
+
+  // bytes of in-memory file images that were written to disk
+  size_t file_image_bytes = 0;
+
+  const HistogramSnapshot& get_phase_latency_ns(WritePhase phase) const
+  {
+    return phase_latency_ns[static_cast<size_t>(phase)];
+  }
+};
+
+/**
+ * @brief Collects the write statistics of a file. The add_*() methods are meant to be called by the one thread
+ * that writes to the file at a given time, get_statistics() from any thread.
+ */
+class WriteStatisticsCollector
+{
+public:
+  explicit WriteStatisticsCollector(std::chrono::milliseconds averaging_interval);
+
+  void add_phase_latency(WritePhase phase, std::chrono::steady_clock::duration latency) noexcept
+  {
+    m_phase_latency_ns[static_cast<size_t>(phase)].add(
+      std::chrono::duration_cast<std::chrono::nanoseconds>(latency).count());
+  }
+
+  void add_record(const RecordWriteSummary& record_summary, std::chrono::steady_clock::time_point end_time) noexcept;
+
+  void add_preallocation(size_t size_bytes) noexcept
+  {
+    m_preallocated_bytes.fetch_add(size_bytes, std::memory_order_relaxed);
+  }
+  void set_free_disk_space(size_t free_bytes) noexcept
+  {
+    m_free_disk_space_bytes.store(free_bytes, std::memory_order_relaxed);
+  }
+  void add_delayed_record(std::chrono::steady_clock::duration wait_time) noexcept
+  {
+    m_delayed_record_count.fetch_add(1, std::memory_order_relaxed);
+    m_free_space_wait_ns.fetch_add(std::chrono::duration_cast<std::chrono::nanoseconds>(wait_time).count(),
+                                   std::memory_order_relaxed);
+  }
+  void add_rejected_record() noexcept { m_rejected_record_count.fetch_add(1, std::memory_order_relaxed); }
+  void add_file_image(size_t size_bytes) noexcept
+  {
+    m_file_image_bytes.fetch_add(size_bytes, std::memory_order_relaxed);
+  }
+
+  WriteStatistics get_statistics() const;
+
+private:
+  struct AtomicRecordWriteSummary
+  {
+    std::atomic<uint64_t> record_number{ 0 };   // NOLINT(build/unsigned)
+    std::atomic<uint16_t> sequence_number{ 0 }; // NOLINT(build/unsigned)
+    std::atomic<uint64_t> size_bytes{ 0 };      // NOLINT(build/unsigned)
+    std::atomic<uint64_t> write_time_ns{ 0 };   // NOLINT(build/unsigned)
+    std::atomic<uint32_t> fragment_count{ 0 };  // NOLINT(build/unsigned)
+
+    void store(const RecordWriteSummary& record_summary) noexcept;
+    RecordWriteSummary load() const noexcept;
+  };
+
+  const double m_averaging_interval_s;
+
+  std::array<Log2Histogram, static_cast<size_t>(WritePhase::kCount)> m_phase_latency_ns;
+  Log2Histogram m_record_write_time_ns;
+  Log2Histogram m_fragments_per_record;
+
+  std::atomic<size_t> m_record_count{ 0 };
+  std::atomic<size_t> m_bytes_written{ 0 };
+
+  std::atomic<double> m_bytes_per_second{ 0 };
+  std::atomic<double> m_records_per_second{ 0 };
+  std::atomic<int64_t> m_last_record_end_ns; // steady_clock time since epoch
+
+  std::atomic<size_t> m_preallocated_bytes{ 0 };
+  std::atomic<size_t> m_free_disk_space_bytes{ 0 };
+  std::atomic<size_t> m_delayed_record_count{ 0 };
+  std::atomic<size_t> m_rejected_record_count{ 0 };
+  std::atomic<int64_t> m_free_space_wait_ns{ 0 };
+  std::atomic<size_t> m_file_image_bytes{ 0 };
+
+  // the largest and slowest records, published with a sequence lock: the counter is odd while they are updated
+  std::atomic<uint64_t> m_summary_sequence{ 0 }; // NOLINT(build/unsigned)
+  AtomicRecordWriteSummary m_largest_record;
+  AtomicRecordWriteSummary m_slowest_record;
+};
+
+/**
+ * @brief Adds the time between its construction and its destruction to the histogram of a write phase
+ */
+class ScopedWritePhaseTimer
+{
+public:
+  ScopedWritePhaseTimer(WriteStatisticsCollector& collector, WritePhase phase) noexcept
+    : m_collector(collector)
+    , m_phase(phase)
+    , m_start_time(std::chrono::steady_clock::now())
+  {}
+
+  ~ScopedWritePhaseTimer() { m_collector.add_phase_latency(m_phase, std::chrono::steady_clock::now() - m_start_time); }
+
+  ScopedWritePhaseTimer(const ScopedWritePhaseTimer&) = delete;
+  ScopedWritePhaseTimer& operator=(const ScopedWritePhaseTimer&) = delete;
+
+private:
+  WriteStatisticsCollector& m_collector;
+  WritePhase m_phase;
+  std::chrono::steady_clock::time_point m_start_time;
+};
+
+} // namespace hdf5libs
+} // namespace dunedaq
+
+#endif // HDF5LIBS_INCLUDE_HDF5LIBS_HDF5WRITESTATISTICS_HPP_
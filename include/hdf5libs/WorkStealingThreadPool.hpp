@@ -0,0 +1,86 @@
+/**
+ * @file WorkStealingThreadPool.hpp
+ *
+ * Small thread pool in which every worker has its own task queue and
+ * takes tasks from the queues of the other workers when its own is empty.
+ * HDF5RawDataFile uses it to compress fragments ahead of the (single
+ * threaded) HDF5 writing.
+ *
+ * This is part of the DUNE DAQ Application Framework, copyright 2020.
+ * Licensing/copyright details are in the COPYING file that you should have
+ * received with this code.
+ */
+
+#ifndef HDF5LIBS_INCLUDE_HDF5LIBS_WORKSTEALINGTHREADPOOL_HPP_
+#define HDF5LIBS_INCLUDE_HDF5LIBS_WORKSTEALINGTHREADPOOL_HPP_
+
+#include <atomic>
+#include <condition_variable>
+#include <cstddef>
+#include <deque>
+#include <functional>
+#include <future>
+#include <memory>
+#include <mutex>
+#include <thread>
+#include <type_traits>
+#include <utility>
+#include <vector>
+
+namespace dunedaq {
+namespace hdf5libs {
+
+class WorkStealingThreadPool
+{
+public:
+  explicit WorkStealingThreadPool(size_t thread_count);
+
+  // tasks that were already submitted are run before the workers are stopped
+  ~WorkStealingThreadPool();
+
+  WorkStealingThreadPool(const WorkStealingThreadPool&) = delete;
+  WorkStealingThreadPool& operator=(const WorkStealingThreadPool&) = delete;
+  WorkStealingThreadPool(WorkStealingThreadPool&&) = delete;
+  WorkStealingThreadPool& operator=(WorkStealingThreadPool&&) = delete;
+
+  /**
+   * @brief Queues a task. The returned future holds its result, or the exception that it threw.
+   */
+  template<typename F>
+  std::future<std::invoke_result_t<F>> submit(F&& task)
+  {
+    typedef std::invoke_result_t<F> result_t;
+    auto packaged_task = std::make_shared<std::packaged_task<result_t()>>(std::forward<F>(task));
+    std::future<result_t> result = packaged_task->get_future();
+    push_task([packaged_task]() { (*packaged_task)(); });
+    return result;
+  }
+
+  size_t get_thread_count() const noexcept { return m_workers.size(); }
+
+private:
+  struct TaskQueue
+  {
+    std::mutex mutex;
+    std::deque<std::function<void()>> tasks;
+  };
+
+  void push_task(std::function<void()> task);
+  bool try_pop_task(size_t worker_index, std::function<void()>& task);
+  void run_worker(size_t worker_index);
+
+  std::vector<std::unique_ptr<TaskQueue>> m_task_queues;
+  std::vector<std::thread> m_workers;
+  std::atomic<size_t> m_next_queue_index{ 0 };
+
+  // number of tasks waiting in any of the queues; workers sleep while it is zero
+  size_t m_queued_task_count = 0;
+  bool m_stop_requested = false;
+  std::mutex m_wait_mutex;
+  std::condition_variable m_task_available_cv;
+};
+
+} // namespace hdf5libs
+} // namespace dunedaq
+
+#endif // HDF5LIBS_INCLUDE_HDF5LIBS_WORKSTEALINGTHREADPOOL_HPP_
@@ -7,13 +7,33 @@
 
 #include "hdf5libs/HDF5FileLayout.hpp"
 
+#include <charconv>
+#include <limits>
+#include <set>
 #include <stdexcept>
 #include <string>
+#include <utility>
 #include <vector>
 
 namespace dunedaq {
 namespace hdf5libs {
 
+namespace {
+
+// appends the decimal digits of the value, padded with zeros to the width
+void
+append_zero_padded(std::string& output, uint64_t value, int width) // NOLINT(build/unsigned)
+{
+  char digits[std::numeric_limits<uint64_t>::digits10 + 1]; // NOLINT(build/unsigned)
+  char* digits_end = std::to_chars(digits, digits + sizeof(digits), value).ptr; // 20 digits always fit
+  size_t digit_count = digits_end - digits;
+  if (width > 0 && static_cast<size_t>(width) > digit_count)
+    output.append(width - digit_count, '0');
+  output.append(digits, digit_count);
+}
+
+} // namespace
+
 HDF5FileLayout::HDF5FileLayout(hdf5filelayout::FileLayoutParams conf, uint32_t version) // NOLINT(build/unsigned)
   : m_conf_params(conf)
   , m_version(version)
@@ -46,24 +66,168 @@ HDF5FileLayout::check_config()
   } else {
     throw InvalidRecordName(ERS_HERE, m_conf_params.record_name_prefix);
   }
+
+  // check the dataset storage (chunking/compression) settings
+  for (auto const& path_param : m_conf_params.path_param_list) {
+    if (path_param.deflate_level < 0 || path_param.deflate_level > 9) {
+      throw FileLayoutInvalidStorageParams(
+        ERS_HERE, path_param.detector_group_name, "deflate_level must be between 0 and 9");
+    }
+    if (path_param.szip_pixels_per_block < 0 || path_param.szip_pixels_per_block > 32 ||
+        (path_param.szip_pixels_per_block % 2) != 0) {
+      throw FileLayoutInvalidStorageParams(
+        ERS_HERE, path_param.detector_group_name, "szip_pixels_per_block must be an even number no larger than 32");
+    }
+    if (path_param.filter_id < 0) {
+      throw FileLayoutInvalidStorageParams(ERS_HERE, path_param.detector_group_name, "filter_id must not be negative");
+    }
+  }
+
+  if (m_conf_params.compact_dataset_threshold_bytes > MAX_COMPACT_DATASET_BYTES) {
+    throw FileLayoutInvalidStorageParams(ERS_HERE,
+                                         "compact datasets",
+                                         "compact_dataset_threshold_bytes must not be larger than " +
+                                           std::to_string(MAX_COMPACT_DATASET_BYTES));
+  }
+
+  // the file-level group sits next to the record groups, so it must not look like one of them
+  if (m_conf_params.file_level_group_name.empty() ||
+      m_conf_params.file_level_group_name.find(m_conf_params.record_name_prefix) != std::string::npos) {
+    throw FileLayoutInvalidStorageParams(ERS_HERE,
+                                         m_conf_params.file_level_group_name,
+                                         "file_level_group_name must be set and must not contain the record prefix");
+  }
+
+  // check the file properties (unknown presets are reported by get_file_properties_preset)
+  auto file_properties = get_file_properties();
+  static const std::set<std::string> file_space_strategies = { "", "fsm_aggr", "page", "aggr", "none" };
+  if (file_space_strategies.count(file_properties.file_space_strategy) == 0) {
+    throw FileLayoutInvalidFileProperties(ERS_HERE,
+                                          "unknown file_space_strategy " + file_properties.file_space_strategy);
+  }
+  static const std::set<std::string> libver_bounds = { "", "earliest", "v18", "v110", "latest" };
+  if (libver_bounds.count(file_properties.libver_low_bound) == 0) {
+    throw FileLayoutInvalidFileProperties(ERS_HERE, "unknown libver_low_bound " + file_properties.libver_low_bound);
+  }
+  if (file_properties.file_space_page_size_bytes > 0 && file_properties.file_space_page_size_bytes < 512) {
+    throw FileLayoutInvalidFileProperties(ERS_HERE, "file_space_page_size_bytes must be at least 512");
+  }
+}
+
+hdf5filelayout::FileProperties
+HDF5FileLayout::get_file_properties() const
+{
+  auto const& configured = m_conf_params.file_properties;
+  hdf5filelayout::FileProperties file_properties = get_file_properties_preset(configured.preset);
+
+  if (configured.alignment_bytes > 0) {
+    file_properties.alignment_threshold_bytes = configured.alignment_threshold_bytes;
+    file_properties.alignment_bytes = configured.alignment_bytes;
+  }
+  if (configured.meta_block_size_bytes > 0)
+    file_properties.meta_block_size_bytes = configured.meta_block_size_bytes;
+  if (configured.small_data_block_size_bytes > 0)
+    file_properties.small_data_block_size_bytes = configured.small_data_block_size_bytes;
+  if (!configured.file_space_strategy.empty())
+    file_properties.file_space_strategy = configured.file_space_strategy;
+  if (configured.file_space_page_size_bytes > 0)
+    file_properties.file_space_page_size_bytes = configured.file_space_page_size_bytes;
+  if (!configured.libver_low_bound.empty())
+    file_properties.libver_low_bound = configured.libver_low_bound;
+
+  return file_properties;
 }
 
-hdf5filelayout::PathParams
+hdf5filelayout::FileProperties
+HDF5FileLayout::get_file_properties_preset(const std::string& preset_name)
+{
+  constexpr size_t kib = 1024;
+  constexpr size_t mib = 1024 * kib;
+
+  hdf5filelayout::FileProperties file_properties;
+  file_properties.preset = preset_name;
+  if (preset_name.empty()) {
+    return file_properties;
+  } else if (preset_name == "lustre") {
+    // large raw data start on stripe (1 MiB) boundaries, and metadata and small raw data are
+    // aggregated in stripe-sized blocks, so that they do not share stripes with the large raw data
+    file_properties.alignment_threshold_bytes = 1 * mib;
+    file_properties.alignment_bytes = 1 * mib;
+    file_properties.meta_block_size_bytes = 1 * mib;
+    file_properties.small_data_block_size_bytes = 1 * mib;
+    file_properties.libver_low_bound = "latest";
+  } else if (preset_name == "local-nvme") {
+    // paged aggregation keeps metadata together in a few pages and writes raw data in page-sized pieces
+    file_properties.file_space_strategy = "page";
+    file_properties.file_space_page_size_bytes = 64 * kib;
+    file_properties.libver_low_bound = "latest";
+  } else {
+    throw FileLayoutInvalidFileProperties(ERS_HERE, "unknown preset " + preset_name);
+  }
+  return file_properties;
+}
+
+uint32_t // NOLINT(build/unsigned)
+HDF5FileLayout::get_required_version(const hdf5filelayout::FileLayoutParams& conf)
+{
+  // version 6 introduced the (optional) packed fragment store,
+  // version 7 the binary record-level SourceID maps, which are always written,
+  // version 8 the (optional) dictionary of record layouts,
+  // and version 9 the (optional) bucket groups of records
+  if (conf.records_per_bucket > 0)
+    return 9;
+  if (conf.record_layout_dictionary)
+    return 8;
+  return 7;
+}
+
+const hdf5filelayout::PathParams&
 HDF5FileLayout::get_path_params(daqdataformats::SourceID::Subsystem type) const
 {
-  try {
-    return m_path_params_map.at(type);
-  } catch (std::out_of_range&) {
+  auto path_params_iter = m_path_params_map.find(type);
+  if (path_params_iter == m_path_params_map.end())
     throw FileLayoutUnconfiguredSubsystem(ERS_HERE, type, daqdataformats::SourceID::subsystem_to_string(type));
-  }
+  return path_params_iter->second;
+}
+
+std::string
+HDF5FileLayout::get_bucket_name(uint64_t record_number) const // NOLINT(build/unsigned)
+{
+  std::string bucket_name;
+  append_bucket_name(bucket_name, record_number);
+  return bucket_name;
+}
+
+void
+HDF5FileLayout::append_bucket_name(std::string& bucket_name, uint64_t record_number) const // NOLINT(build/unsigned)
+{
+  uint64_t records_per_bucket = get_records_per_bucket(); // NOLINT(build/unsigned)
+  uint64_t bucket_start = 0;                              // NOLINT(build/unsigned)
+  if (records_per_bucket > 0)
+    bucket_start = record_number - record_number % records_per_bucket;
+  int width = (bucket_start < m_powers_ten[m_conf_params.digits_for_record_number])
+                ? m_conf_params.digits_for_record_number
+                : 0; // the record number itself warns about the missing digits
+
+  bucket_name += m_conf_params.record_name_prefix;
+  bucket_name += BUCKET_NAME_SUFFIX;
+  append_zero_padded(bucket_name, bucket_start, width);
 }
 
 std::string
 HDF5FileLayout::get_record_number_string(uint64_t record_number, // NOLINT(build/unsigned)
                                          daqdataformats::sequence_number_t seq_num) const
 {
-  std::ostringstream record_number_string;
+  std::string record_number_string;
+  append_record_number_string(record_number_string, record_number, seq_num);
+  return record_number_string;
+}
 
+void
+HDF5FileLayout::append_record_number_string(std::string& record_number_string,
+                                            uint64_t record_number, // NOLINT(build/unsigned)
+                                            daqdataformats::sequence_number_t seq_num) const
+{
   int width = m_conf_params.digits_for_record_number;
 
   if (record_number >= m_powers_ten[m_conf_params.digits_for_record_number]) {
@@ -71,7 +235,14 @@ HDF5FileLayout::get_record_number_string(uint64_t record_number, // NOLINT(build
     width = 0; // tells it to revert to normal width
   }
 
-  record_number_string << m_conf_params.record_name_prefix << std::setw(width) << std::setfill('0') << record_number;
+  // records in buckets are in the group of their bucket
+  if (get_records_per_bucket() > 0) {
+    append_bucket_name(record_number_string, record_number);
+    record_number_string += '/';
+  }
+
+  record_number_string += m_conf_params.record_name_prefix;
+  append_zero_padded(record_number_string, record_number, width);
 
   if (m_conf_params.digits_for_sequence_number > 0) {
 
@@ -80,10 +251,9 @@ HDF5FileLayout::get_record_number_string(uint64_t record_number, // NOLINT(build
       ers::warning(FileLayoutNotEnoughDigitsForPath(ERS_HERE, seq_num, m_conf_params.digits_for_sequence_number));
       width = 0; // tells it to revert to normal width
     }
-    record_number_string << "." << std::setw(width) << std::setfill('0') << seq_num;
+    record_number_string += '.';
+    append_zero_padded(record_number_string, seq_num, width);
   }
-
-  return record_number_string.str();
 }
 
 std::string
@@ -105,19 +275,8 @@ HDF5FileLayout::get_timeslice_number_string(daqdataformats::timeslice_number_t t
 std::vector<std::string>
 HDF5FileLayout::get_path_elements(const daqdataformats::TriggerRecordHeader& trh) const
 {
-
-  std::vector<std::string> path_elements;
-
-  // first the Trigger string
-  path_elements.push_back(get_trigger_number_string(trh.get_trigger_number(), trh.get_sequence_number()));
-
-  // then the RawData group name
-  path_elements.push_back(m_conf_params.raw_data_group_name);
-
-  // then the SourceID plus record header name
-  path_elements.push_back(trh.get_header().element_id.to_string() + "_" + m_conf_params.record_header_dataset_name);
-
-  return path_elements;
+  return get_record_header_path_elements(
+    trh.get_trigger_number(), trh.get_sequence_number(), trh.get_header().element_id);
 }
 
 /**
@@ -125,18 +284,29 @@ HDF5FileLayout::get_path_elements(const daqdataformats::TriggerRecordHeader& trh
  */
 std::vector<std::string>
 HDF5FileLayout::get_path_elements(const daqdataformats::TimeSliceHeader& tsh) const
+{
+  return get_record_header_path_elements(tsh.timeslice_number, 0, tsh.element_id);
+}
+
+/**
+ * @brief get the path for a record header, given its record number, sequence number and SourceID
+ */
+std::vector<std::string>
+HDF5FileLayout::get_record_header_path_elements(uint64_t rec_num, // NOLINT(build/unsigned)
+                                                daqdataformats::sequence_number_t seq_num,
+                                                const daqdataformats::SourceID& source_id) const
 {
 
   std::vector<std::string> path_elements;
 
-  // first the Trigger string
-  path_elements.push_back(get_timeslice_number_string(tsh.timeslice_number));
+  // first the record string
+  path_elements.push_back(get_record_number_string(rec_num, seq_num));
 
   // then the RawData group name
   path_elements.push_back(m_conf_params.raw_data_group_name);
 
   // then the SourceID plus record header name
-  path_elements.push_back(tsh.element_id.to_string() + "_" + m_conf_params.record_header_dataset_name);
+  path_elements.push_back(source_id.to_string() + "_" + m_conf_params.record_header_dataset_name);
 
   return path_elements;
 }
@@ -203,11 +373,14 @@ HDF5FileLayout::get_fragment_path(uint64_t trig_num, // NOLINT(build/unsigned)
 
   auto const& path_params = get_path_params(element_id.subsystem);
 
-  std::ostringstream path_string;
-  path_string << get_trigger_number_string(trig_num, seq_num) << "/" << path_params.detector_group_name << "/"
-              << path_params.element_name_prefix << std::setw(path_params.digits_for_element_number)
-              << std::setfill('0') << element_id.id;
-  return path_string.str();
+  std::string path_string;
+  append_record_number_string(path_string, trig_num, seq_num);
+  path_string += '/';
+  path_string += path_params.detector_group_name;
+  path_string += '/';
+  path_string += path_params.element_name_prefix;
+  append_zero_padded(path_string, element_id.id, path_params.digits_for_element_number);
+  return path_string;
 }
 
 /**
@@ -246,9 +419,11 @@ HDF5FileLayout::get_fragment_type_path(uint64_t trig_num, // NOLINT(build/unsign
 {
   auto const& path_params = get_path_params(type);
 
-  std::ostringstream path_string;
-  path_string << get_trigger_number_string(trig_num, seq_num) << "/" << path_params.detector_group_name;
-  return path_string.str();
+  std::string path_string;
+  append_record_number_string(path_string, trig_num, seq_num);
+  path_string += '/';
+  path_string += path_params.detector_group_name;
+  return path_string;
 }
 
 /**
@@ -270,7 +445,7 @@ HDF5FileLayout::get_source_id_from_path_elements(std::vector<std::string> const&
   daqdataformats::SourceID::Subsystem systype = m_detector_group_name_to_type_map.at(path_elements[1]);
 
   // get back the path parameters for this system type from the file layout
-  auto path_params = get_path_params(systype);
+  auto const& path_params = get_path_params(systype);
 
   // fourth path element is element. remove prefix and translate to numbers
   auto ele_id = std::stoi(path_elements[3].substr(path_params.element_name_prefix.size()));
@@ -339,5 +514,77 @@ HDF5FileLayout::get_v0_file_layout_params()
   return flp;
 }
 
+DatasetPathBuilder::DatasetPathBuilder(const HDF5FileLayout& file_layout)
+  : m_file_layout(file_layout)
+  , m_path_elements(3)
+{
+  m_path_elements[1] = m_file_layout.get_file_layout_params().raw_data_group_name;
+}
+
+const std::vector<std::string>&
+DatasetPathBuilder::get_path_elements(const daqdataformats::TriggerRecordHeader& trh)
+{
+  return set_record_header_dataset(trh.get_trigger_number(), trh.get_sequence_number(), trh.get_header().element_id);
+}
+
+const std::vector<std::string>&
+DatasetPathBuilder::get_path_elements(const daqdataformats::TimeSliceHeader& tsh)
+{
+  return set_record_header_dataset(tsh.timeslice_number, 0, tsh.element_id);
+}
+
+/**
+ * @brief the same path elements as HDF5FileLayout::get_path_elements(const FragmentHeader&)
+ */
+const std::vector<std::string>&
+DatasetPathBuilder::get_path_elements(const daqdataformats::FragmentHeader& fh)
+{
+  set_record(fh.trigger_number, fh.sequence_number);
+
+  auto dataset_name_key = std::make_pair(fh.element_id, fh.fragment_type);
+  auto dataset_name_iter = m_fragment_dataset_names.find(dataset_name_key);
+  if (dataset_name_iter == m_fragment_dataset_names.end()) {
+    std::string dataset_name = fh.element_id.to_string() + "_" +
+                               daqdataformats::fragment_type_to_string(
+                                 static_cast<daqdataformats::FragmentType>(fh.fragment_type));
+    dataset_name_iter = m_fragment_dataset_names.emplace(dataset_name_key, std::move(dataset_name)).first;
+  }
+  m_path_elements[2].assign(dataset_name_iter->second);
+  return m_path_elements;
+}
+
+const std::vector<std::string>&
+DatasetPathBuilder::set_record_header_dataset(uint64_t rec_num, // NOLINT(build/unsigned)
+                                              daqdataformats::sequence_number_t seq_num,
+                                              const daqdataformats::SourceID& source_id)
+{
+  set_record(rec_num, seq_num);
+
+  auto dataset_name_iter = m_record_header_dataset_names.find(source_id);
+  if (dataset_name_iter == m_record_header_dataset_names.end()) {
+    std::string dataset_name =
+      source_id.to_string() + "_" + m_file_layout.get_file_layout_params().record_header_dataset_name;
+    dataset_name_iter = m_record_header_dataset_names.emplace(source_id, std::move(dataset_name)).first;
+  }
+  m_path_elements[2].assign(dataset_name_iter->second);
+  return m_path_elements;
+}
+
+/**
+ * @brief format the record group name, unless it is the one of the previous dataset
+ */
+void
+DatasetPathBuilder::set_record(uint64_t rec_num, daqdataformats::sequence_number_t seq_num) // NOLINT(build/unsigned)
+{
+  if (m_record_is_set && rec_num == m_record_number && seq_num == m_sequence_number)
+    return;
+
+  m_path_elements[0].clear();
+  m_file_layout.append_record_number_string(m_path_elements[0], rec_num, seq_num);
+  m_record_number = rec_num;
+  m_sequence_number = seq_num;
+  m_record_is_set = true;
+}
+
 } // namespace hdf5libs
 } // namespace dunedaq
@@ -0,0 +1,170 @@
+/**
+ * This is part of the DUNE DAQ Application Framework, copyright 2020.
+ * Licensing/copyright details are in the COPYING file that you should have
+ * received with this code.
+ *
+ */
+
+#include "hdf5libs/HDF5PackedFragmentStore.hpp"
+#include "hdf5libs/HDF5RawDataFile.hpp"
+
+#include <highfive/H5DataSpace.hpp>
+#include <highfive/H5DataType.hpp>
+
+#include <memory>
+#include <string>
+#include <utility>
+#include <vector>
+
+namespace {
+
+HighFive::CompoundType
+create_packed_store_entry_type()
+{
+  // the offsets are computed with the natural alignment of the members, as for the C++ struct
+  return { { "record_number", HighFive::create_datatype<uint64_t>() },    // NOLINT(build/unsigned)
+           { "offset", HighFive::create_datatype<uint64_t>() },           // NOLINT(build/unsigned)
+           { "size", HighFive::create_datatype<uint64_t>() },             // NOLINT(build/unsigned)
+           { "subsystem", HighFive::create_datatype<uint32_t>() },        // NOLINT(build/unsigned)
+           { "source_id", HighFive::create_datatype<uint32_t>() },        // NOLINT(build/unsigned)
+           { "sequence_number", HighFive::create_datatype<uint16_t>() },  // NOLINT(build/unsigned)
+           { "fragment_type", HighFive::create_datatype<uint16_t>() },    // NOLINT(build/unsigned)
+           { "is_record_header", HighFive::create_datatype<uint8_t>() } }; // NOLINT(build/unsigned)
+}
+
+constexpr size_t INDEX_CHUNK_ROWS = 1024;
+
+} // namespace
+
+HIGHFIVE_REGISTER_TYPE(dunedaq::hdf5libs::PackedStoreEntry, create_packed_store_entry_type)
+
+namespace dunedaq {
+namespace hdf5libs {
+
+HDF5PackedFragmentStore::HDF5PackedFragmentStore(const HighFive::Group& store_group,
+                                                 create_props_function_t create_props_function)
+  : m_store_group(store_group)
+  , m_create_props_function(std::move(create_props_function))
+{
+  HighFive::DataSpace index_space({ 0 }, { HighFive::DataSpace::UNLIMITED });
+  HighFive::DataSetCreateProps index_create_props;
+  index_create_props.add(HighFive::Chunking(std::vector<hsize_t>{ INDEX_CHUNK_ROWS }));
+  m_store_group.createDataSet(s_index_dataset_name, index_space, create_packed_store_entry_type(), index_create_props);
+}
+
+HDF5PackedFragmentStore::HDF5PackedFragmentStore(const HighFive::Group& store_group)
+  : m_store_group(store_group)
+{}
+
+std::string
+HDF5PackedFragmentStore::get_store_dataset_name(daqdataformats::SourceID::Subsystem subsystem)
+{
+  return "RawDataStore_" + daqdataformats::SourceID::subsystem_to_string(subsystem);
+}
+
+HighFive::DataSet
+HDF5PackedFragmentStore::get_store_dataset(uint32_t subsystem, bool create_if_needed) // NOLINT(build/unsigned)
+{
+  auto store_iter = m_store_datasets.find(subsystem);
+  if (store_iter != m_store_datasets.end())
+    return store_iter->second;
+
+  auto subsystem_enum = static_cast<daqdataformats::SourceID::Subsystem>(subsystem);
+  std::string dataset_name = get_store_dataset_name(subsystem_enum);
+  if (!m_store_group.exist(dataset_name)) {
+    if (!create_if_needed)
+      throw InvalidHDF5Dataset(ERS_HERE, dataset_name, m_store_group.getFile().getName());
+
+    // like the per-Fragment datasets, the store datasets are two-dimensional, with a second dimension of 1
+    HighFive::DataSpace store_space({ 0, 1 }, { HighFive::DataSpace::UNLIMITED, 1 });
+    m_store_group.createDataSet<char>(dataset_name, store_space, m_create_props_function(subsystem_enum));
+    m_store_sizes[subsystem] = 0;
+  }
+
+  HighFive::DataSet store_dataset = m_store_group.getDataSet(dataset_name);
+  m_store_datasets.emplace(subsystem, store_dataset);
+  return store_dataset;
+}
+
+void
+HDF5PackedFragmentStore::append(PackedStoreEntry entry, const char* data_ptr)
+{
+  auto& pending_data = m_pending_data[entry.subsystem];
+  entry.offset = m_store_sizes[entry.subsystem] + pending_data.size();
+  pending_data.insert(pending_data.end(), data_ptr, data_ptr + entry.size);
+  m_pending_entries.push_back(entry);
+}
+
+void
+HDF5PackedFragmentStore::append(PackedStoreEntry entry, const std::vector<std::pair<const void*, size_t>>& data_pieces)
+{
+  auto& pending_data = m_pending_data[entry.subsystem];
+  entry.offset = m_store_sizes[entry.subsystem] + pending_data.size();
+  entry.size = 0;
+  for (auto const& [piece_ptr, piece_size] : data_pieces) {
+    auto piece_bytes = static_cast<const char*>(piece_ptr);
+    pending_data.insert(pending_data.end(), piece_bytes, piece_bytes + piece_size);
+    entry.size += piece_size;
+  }
+  m_pending_entries.push_back(entry);
+}
+
+void
+HDF5PackedFragmentStore::write_pending()
+{
+  // one extension and one write per subsystem and per record, rather than one dataset per Fragment
+  for (auto& [subsystem, pending_data] : m_pending_data) {
+    if (pending_data.empty())
+      continue;
+    HighFive::DataSet store_dataset = get_store_dataset(subsystem, true);
+    size_t& store_size = m_store_sizes[subsystem];
+    store_dataset.resize({ store_size + pending_data.size(), 1 });
+    store_dataset.select({ store_size, 0 }, { pending_data.size(), 1 }).write_raw(pending_data.data());
+    store_size += pending_data.size();
+    pending_data.clear();
+  }
+
+  if (!m_pending_entries.empty()) {
+    HighFive::DataSet index_dataset = m_store_group.getDataSet(s_index_dataset_name);
+    index_dataset.resize({ m_index_size + m_pending_entries.size() });
+    index_dataset.select({ m_index_size }, { m_pending_entries.size() }).write(m_pending_entries);
+    m_index_size += m_pending_entries.size();
+    m_pending_entries.clear();
+  }
+}
+
+std::vector<PackedStoreEntry>
+HDF5PackedFragmentStore::read_index(size_t first_entry) const
+{
+  std::vector<PackedStoreEntry> entries;
+  if (!m_store_group.exist(s_index_dataset_name))
+    return entries;
+
+  HighFive::DataSet index_dataset = m_store_group.getDataSet(s_index_dataset_name);
+  size_t index_size = index_dataset.getDimensions()[0];
+  if (first_entry == 0)
+    index_dataset.read(entries);
+  else if (first_entry < index_size)
+    index_dataset.select({ first_entry }, { index_size - first_entry }).read(entries);
+  return entries;
+}
+
+void
+HDF5PackedFragmentStore::reopen(const HighFive::Group& store_group)
+{
+  m_store_datasets.clear();
+  m_store_group = store_group;
+}
+
+std::unique_ptr<char[]>
+HDF5PackedFragmentStore::read(const PackedStoreEntry& entry)
+{
+  HighFive::DataSet store_dataset = get_store_dataset(entry.subsystem, false);
+  auto membuffer = std::make_unique<char[]>(entry.size);
+  if (entry.size > 0)
+    store_dataset.select({ entry.offset, 0 }, { entry.size, 1 }).read(membuffer.get());
+  return membuffer;
+}
+
+} // namespace hdf5libs
+} // namespace dunedaq
@@ -10,20 +10,406 @@
 
 #include "logging/Logging.hpp"
 
+#include <fcntl.h>
+#include <sys/stat.h>
+#include <unistd.h>
+#include <zlib.h>
+
 #include <algorithm>
+#include <cerrno>
+#include <chrono>
+#include <cstdlib>
+#include <cstring>
 #include <filesystem>
+#include <functional>
 #include <map>
 #include <memory>
+#include <optional>
 #include <set>
 #include <sstream>
 #include <string>
+#include <thread>
 #include <utility>
 #include <vector>
 
+namespace {
+
+HighFive::CompoundType
+create_record_directory_entry_type()
+{
+  // the offsets are computed with the natural alignment of the members, as for the C++ struct
+  return { { "record_number", HighFive::create_datatype<uint64_t>() },        // NOLINT(build/unsigned)
+           { "trigger_timestamp", HighFive::create_datatype<uint64_t>() },    // NOLINT(build/unsigned)
+           { "size_bytes", HighFive::create_datatype<uint64_t>() },           // NOLINT(build/unsigned)
+           { "header_source_subsys", HighFive::create_datatype<uint32_t>() }, // NOLINT(build/unsigned)
+           { "header_source_id", HighFive::create_datatype<uint32_t>() },     // NOLINT(build/unsigned)
+           { "fragment_count", HighFive::create_datatype<uint32_t>() },       // NOLINT(build/unsigned)
+           { "sequence_number", HighFive::create_datatype<uint16_t>() } };    // NOLINT(build/unsigned)
+}
+
+} // namespace
+
+HIGHFIVE_REGISTER_TYPE(dunedaq::hdf5libs::RecordDirectoryEntry, create_record_directory_entry_type)
+
 namespace dunedaq {
 namespace hdf5libs {
 
 constexpr uint32_t MAX_FILELAYOUT_VERSION = 4294967295; // NOLINT(build/unsigned)
+constexpr size_t GROUP_CACHE_CAPACITY = 16;
+constexpr const char* RECORD_DIRECTORY_DATASET_NAME = "RecordDirectory";
+constexpr const char* RECORD_LAYOUTS_GROUP_NAME = "RecordLayouts";
+constexpr size_t RECORD_DIRECTORY_CHUNK_ROWS = 1024;
+constexpr size_t DEFAULT_PACKED_STORE_CHUNK_SIZE_BYTES = 1048576;
+constexpr size_t DEFAULT_CHUNK_CACHE_BYTES = 1048576; // the HDF5 default
+constexpr std::chrono::milliseconds FREE_SPACE_CHECK_INTERVAL{ 1000 };
+constexpr std::chrono::milliseconds FREE_SPACE_POLL_INTERVAL{ 100 };
+constexpr size_t FINALIZER_THREAD_COUNT = 2;
+constexpr size_t CORE_STAGING_INCREMENT_BYTES = 16777216;
+constexpr size_t DIRECT_IO_ALIGNMENT = 4096;
+constexpr unsigned MAX_COMPACT_BUCKET_LINKS = 16; // NOLINT(build/unsigned)
+constexpr unsigned MIN_DENSE_BUCKET_LINKS = 12;   // NOLINT(build/unsigned)
+constexpr size_t MIN_METADATA_CACHE_BYTES = 1024;      // the bounds that HDF5 accepts for the maximum
+constexpr size_t MAX_METADATA_CACHE_BYTES = 134217728; // size of the metadata cache
+
+/**
+ * @brief A Fragment of a record that is written with the compression pool: compressed on the pool, or written as it
+ * is, through the HDF5 filter pipeline of its dataset, when the pool does not handle its filters
+ */
+struct PooledFragment
+{
+  const daqdataformats::Fragment* frag_ptr = nullptr;
+  std::optional<PrecompressedFragment> precompressed_frag;
+};
+
+namespace {
+
+/**
+ * @brief Adapter that allows HDF5 property calls that HighFive does not wrap
+ * to be added to a HighFive property list.
+ */
+class RawHDF5Property
+{
+public:
+  RawHDF5Property(std::string name, std::function<herr_t(hid_t)> setter)
+    : m_name(std::move(name))
+    , m_setter(std::move(setter))
+  {}
+
+  void apply(hid_t hid) const
+  {
+    if (m_setter(hid) < 0)
+      throw HDF5PropertyFailed(ERS_HERE, m_name);
+  }
+
+private:
+  std::string m_name;
+  std::function<herr_t(hid_t)> m_setter;
+};
+
+H5F_fspace_strategy_t
+get_file_space_strategy(const std::string& strategy_name)
+{
+  if (strategy_name == "fsm_aggr")
+    return H5F_FSPACE_STRATEGY_FSM_AGGR;
+  if (strategy_name == "page")
+    return H5F_FSPACE_STRATEGY_PAGE;
+  if (strategy_name == "aggr")
+    return H5F_FSPACE_STRATEGY_AGGR;
+  if (strategy_name == "none")
+    return H5F_FSPACE_STRATEGY_NONE;
+  throw FileLayoutInvalidFileProperties(ERS_HERE, "unknown file_space_strategy " + strategy_name);
+}
+
+H5F_libver_t
+get_libver_bound(const std::string& libver_name)
+{
+  if (libver_name == "earliest")
+    return H5F_LIBVER_EARLIEST;
+  if (libver_name == "v18")
+    return H5F_LIBVER_V18;
+  if (libver_name == "v110")
+    return H5F_LIBVER_V110;
+  if (libver_name == "latest")
+    return H5F_LIBVER_LATEST;
+  throw FileLayoutInvalidFileProperties(ERS_HERE, "unknown libver_low_bound " + libver_name);
+}
+
+/**
+ * @brief translate the file properties of the file layout into HDF5 file creation and access properties.
+ * Properties that are not set keep their HDF5 defaults.
+ */
+void
+add_file_properties(const hdf5filelayout::FileProperties& file_properties,
+                    HighFive::FileCreateProps& file_create_props,
+                    HighFive::FileAccessProps& file_access_props)
+{
+  if (file_properties.alignment_bytes > 0) {
+    hsize_t threshold = file_properties.alignment_threshold_bytes;
+    hsize_t alignment = file_properties.alignment_bytes;
+    file_access_props.add(RawHDF5Property(
+      "alignment", [threshold, alignment](hid_t hid) { return H5Pset_alignment(hid, threshold, alignment); }));
+  }
+  if (file_properties.meta_block_size_bytes > 0) {
+    hsize_t block_size = file_properties.meta_block_size_bytes;
+    file_access_props.add(RawHDF5Property(
+      "meta_block_size", [block_size](hid_t hid) { return H5Pset_meta_block_size(hid, block_size); }));
+  }
+  if (file_properties.small_data_block_size_bytes > 0) {
+    hsize_t block_size = file_properties.small_data_block_size_bytes;
+    file_access_props.add(RawHDF5Property(
+      "small_data_block_size", [block_size](hid_t hid) { return H5Pset_small_data_block_size(hid, block_size); }));
+  }
+  if (!file_properties.file_space_strategy.empty()) {
+    H5F_fspace_strategy_t strategy = get_file_space_strategy(file_properties.file_space_strategy);
+    file_create_props.add(RawHDF5Property("file_space_strategy", [strategy](hid_t hid) {
+      return H5Pset_file_space_strategy(hid, strategy, false, 1);
+    }));
+  }
+  if (file_properties.file_space_page_size_bytes > 0) {
+    hsize_t page_size = file_properties.file_space_page_size_bytes;
+    file_create_props.add(RawHDF5Property(
+      "file_space_page_size", [page_size](hid_t hid) { return H5Pset_file_space_page_size(hid, page_size); }));
+  }
+  if (!file_properties.libver_low_bound.empty()) {
+    H5F_libver_t low_bound = get_libver_bound(file_properties.libver_low_bound);
+    file_access_props.add(RawHDF5Property(
+      "libver_bounds", [low_bound](hid_t hid) { return H5Pset_libver_bounds(hid, low_bound, H5F_LIBVER_LATEST); }));
+  }
+}
+
+/**
+ * @brief Use the multi driver the way H5Pset_fapl_split() does, with one file for the metadata and one for the raw
+ * data, but with names that are printf formats of the file name rather than suffixes, so that the metadata file
+ * may be in another directory.
+ */
+void
+add_split_driver(HighFive::FileAccessProps& file_access_props, std::string metadata_format, std::string raw_format)
+{
+  file_access_props.add(RawHDF5Property("split_driver", [metadata_format, raw_format](hid_t hid) {
+    H5FD_mem_t member_map[H5FD_MEM_NTYPES];
+    hid_t member_fapl[H5FD_MEM_NTYPES];
+    const char* member_name[H5FD_MEM_NTYPES];
+    haddr_t member_addr[H5FD_MEM_NTYPES];
+    for (int mem_type = H5FD_MEM_DEFAULT; mem_type < H5FD_MEM_NTYPES; ++mem_type) {
+      member_map[mem_type] = (mem_type == H5FD_MEM_DRAW) ? H5FD_MEM_DRAW : H5FD_MEM_SUPER;
+      member_fapl[mem_type] = H5P_DEFAULT;
+      member_name[mem_type] = nullptr;
+      member_addr[mem_type] = HADDR_UNDEF;
+    }
+    member_name[H5FD_MEM_SUPER] = metadata_format.c_str();
+    member_addr[H5FD_MEM_SUPER] = 0;
+    member_name[H5FD_MEM_DRAW] = raw_format.c_str();
+    member_addr[H5FD_MEM_DRAW] = HADDR_MAX / 2;
+    return H5Pset_fapl_multi(hid, member_map, member_fapl, member_name, member_addr, false);
+  }));
+}
+
+// a file name as a printf format that gives that name
+std::string
+escape_printf_format(const std::string& file_name)
+{
+  std::string format;
+  for (char name_char : file_name) {
+    if (name_char == '%')
+      format += '%';
+    format += name_char;
+  }
+  return format;
+}
+
+// uniform access to the fragments of a record, whether or not they were compressed beforehand
+const daqdataformats::Fragment&
+fragment_ref(const std::unique_ptr<daqdataformats::Fragment>& frag_ptr)
+{
+  return *frag_ptr;
+}
+
+const PrecompressedFragment&
+fragment_ref(const PrecompressedFragment& precompressed_frag)
+{
+  return precompressed_frag;
+}
+
+daqdataformats::FragmentHeader
+fragment_header(const daqdataformats::Fragment& frag)
+{
+  return frag.get_header();
+}
+
+const daqdataformats::FragmentHeader&
+fragment_header(const PrecompressedFragment& precompressed_frag)
+{
+  return precompressed_frag.header;
+}
+
+const PooledFragment&
+fragment_ref(const PooledFragment& pooled_frag)
+{
+  return pooled_frag;
+}
+
+daqdataformats::FragmentHeader
+fragment_header(const PooledFragment& pooled_frag)
+{
+  return pooled_frag.frag_ptr->get_header();
+}
+
+const ScatteredFragment&
+fragment_ref(const ScatteredFragment& scattered_frag)
+{
+  return scattered_frag;
+}
+
+const daqdataformats::FragmentHeader&
+fragment_header(const ScatteredFragment& scattered_frag)
+{
+  return scattered_frag.header;
+}
+
+HDF5RawDataFile::record_id_t
+get_record_id(const daqdataformats::TriggerRecord& tr)
+{
+  return std::make_pair(tr.get_header_ref().get_trigger_number(), tr.get_header_ref().get_sequence_number());
+}
+
+HDF5RawDataFile::record_id_t
+get_record_id(const daqdataformats::TimeSlice& ts)
+{
+  return std::make_pair(ts.get_header().timeslice_number, 0);
+}
+
+// the pieces of a scattered fragment have to add up to the size in its header
+void
+check_scattered_fragment_sizes(const std::vector<ScatteredFragment>& scattered_frags)
+{
+  for (auto const& scattered_frag : scattered_frags) {
+    size_t pieces_size = sizeof(daqdataformats::FragmentHeader);
+    for (auto const& payload_piece : scattered_frag.payload_pieces)
+      pieces_size += payload_piece.second;
+    if (pieces_size != scattered_frag.header.size) {
+      throw ScatteredFragmentSizeMismatch(
+        ERS_HERE, scattered_frag.header.element_id.to_string(), scattered_frag.header.size, pieces_size);
+    }
+  }
+}
+
+// the header of a scattered fragment, followed by its pieces
+std::vector<std::pair<const void*, size_t>>
+get_fragment_pieces(const ScatteredFragment& scattered_frag)
+{
+  std::vector<std::pair<const void*, size_t>> fragment_pieces;
+  fragment_pieces.reserve(scattered_frag.payload_pieces.size() + 1);
+  fragment_pieces.emplace_back(&scattered_frag.header, sizeof(daqdataformats::FragmentHeader));
+  fragment_pieces.insert(
+    fragment_pieces.end(), scattered_frag.payload_pieces.begin(), scattered_frag.payload_pieces.end());
+  return fragment_pieces;
+}
+
+PackedStoreEntry
+make_packed_store_entry(uint64_t rec_num, // NOLINT(build/unsigned)
+                        daqdataformats::sequence_number_t seq_num,
+                        const daqdataformats::SourceID& source_id,
+                        size_t size,
+                        bool is_record_header,
+                        uint32_t fragment_type = 0) // NOLINT(build/unsigned)
+{
+  PackedStoreEntry entry;
+  entry.record_number = rec_num;
+  entry.sequence_number = seq_num;
+  entry.subsystem = static_cast<uint32_t>(source_id.subsystem); // NOLINT(build/unsigned)
+  entry.source_id = source_id.id;
+  entry.size = size;
+  entry.is_record_header = is_record_header ? 1 : 0;
+  entry.fragment_type = static_cast<uint16_t>(fragment_type); // NOLINT(build/unsigned)
+  return entry;
+}
+
+// record identification of the record headers, for the record directory
+HDF5RawDataFile::record_id_t
+get_record_id(const daqdataformats::TriggerRecordHeader& trh)
+{
+  return std::make_pair(trh.get_trigger_number(), trh.get_sequence_number());
+}
+
+HDF5RawDataFile::record_id_t
+get_record_id(const daqdataformats::TimeSliceHeader& tsh)
+{
+  return std::make_pair(tsh.timeslice_number, 0);
+}
+
+uint64_t // NOLINT(build/unsigned)
+get_record_timestamp(const daqdataformats::TriggerRecordHeader& trh)
+{
+  return trh.get_trigger_timestamp();
+}
+
+size_t
+get_record_header_size(const daqdataformats::TriggerRecordHeader& trh)
+{
+  return trh.get_total_size_bytes();
+}
+
+size_t
+get_record_header_size(const daqdataformats::TimeSliceHeader& /*tsh*/)
+{
+  return sizeof(daqdataformats::TimeSliceHeader);
+}
+
+uint64_t // NOLINT(build/unsigned)
+get_record_timestamp(const daqdataformats::TimeSliceHeader& /*tsh*/)
+{
+  return 0;
+}
+
+/**
+ * @brief hand the Fragments of a record that was written (or failed to be written) back to a pool
+ */
+template<typename RecordT>
+void
+hand_back_fragments(RecordT& record,
+                    std::vector<std::future<PrecompressedFragment>>& compressed_frags,
+                    FragmentBufferPool& buffer_pool)
+{
+  // if the writing failed, compression tasks may still be reading the fragments
+  for (auto& compressed_frag : compressed_frags) {
+    if (compressed_frag.valid())
+      compressed_frag.wait();
+  }
+
+  auto& fragments = record.get_fragments_ref();
+  for (auto& frag_ptr : fragments) {
+    if (frag_ptr)
+      buffer_pool.release(std::move(frag_ptr));
+  }
+  fragments.clear();
+}
+
+/**
+ * @brief the value of a key in one of the record-level maps, or an empty value if the map does not have the key
+ */
+template<typename MapT>
+typename MapT::mapped_type
+get_map_value(const MapT& the_map, const typename MapT::key_type& key)
+{
+  auto map_iter = the_map.find(key);
+  if (map_iter == the_map.end())
+    return typename MapT::mapped_type();
+  return map_iter->second;
+}
+
+/**
+ * @brief open the named child group of a file or group, creating it if it does not exist yet
+ */
+template<typename ParentT>
+HighFive::Group
+open_or_create_child_group(ParentT&& parent, std::string const& child_group_name)
+{
+  if (!parent.exist(child_group_name))
+    return parent.createGroup(child_group_name);
+  return parent.getGroup(child_group_name);
+}
+
+} // namespace
 
 /**
  * @brief Constructor for writing a new file
@@ -35,9 +421,11 @@ HDF5RawDataFile::HDF5RawDataFile(std::string file_name,
                                  const hdf5filelayout::FileLayoutParams& fl_params,
                                  hdf5rawdatafile::SrcIDGeoIDMap srcid_geoid_map,
                                  std::string inprogress_filename_suffix,
-                                 unsigned open_flags)
+                                 unsigned open_flags,
+                                 const hdf5rawdatafile::WriterParams& writer_params)
   : m_bare_file_name(file_name)
   , m_open_flags(open_flags)
+  , m_write_statistics(std::chrono::milliseconds(writer_params.statistics_averaging_interval_ms))
 {
 
   // check and make sure that the file isn't ReadOnly
@@ -47,9 +435,62 @@ HDF5RawDataFile::HDF5RawDataFile(std::string file_name,
 
   auto filename_to_open = m_bare_file_name + inprogress_filename_suffix;
 
+  m_free_space_policy = string_to_free_space_policy(writer_params.free_space_policy);
+
+  // set the file layout contents; its file properties are needed to open the file
+  m_file_layout_ptr.reset(new HDF5FileLayout(fl_params, HDF5FileLayout::get_required_version(fl_params)));
+  m_path_builder_ptr = std::make_unique<DatasetPathBuilder>(*m_file_layout_ptr);
+  m_record_layout_dictionary = fl_params.record_layout_dictionary;
+
+  HighFive::FileCreateProps file_create_props;
+  HighFive::FileAccessProps file_access_props;
+  add_file_properties(m_file_layout_ptr->get_file_properties(), file_create_props, file_access_props);
+
+  // the metadata cache may be bounded, and the metadata of each record are evicted from it once the record is
+  // written. HDF5 does not open a file that is open with evict-on-close without it, as the readers that follow
+  // a live file in the same process would, so it is not used with live_tail.
+  m_metadata_cache_max_bytes = writer_params.metadata_cache_max_bytes;
+  m_metadata_cache_initial_bytes = writer_params.metadata_cache_initial_bytes;
+  m_evict_on_close = writer_params.evict_on_close && !writer_params.live_tail;
+  if (m_metadata_cache_max_bytes > 0 &&
+      (m_metadata_cache_max_bytes < MIN_METADATA_CACHE_BYTES || m_metadata_cache_max_bytes > MAX_METADATA_CACHE_BYTES))
+    throw InvalidMetadataCacheConfig(ERS_HERE, filename_to_open, "the maximum size must be between 1 KiB and 128 MiB");
+  if (m_metadata_cache_initial_bytes >
+      ((m_metadata_cache_max_bytes > 0) ? m_metadata_cache_max_bytes : MAX_METADATA_CACHE_BYTES))
+    throw InvalidMetadataCacheConfig(ERS_HERE, filename_to_open, "the initial size is above the maximum size");
+  add_metadata_cache_properties(file_access_props);
+
+  // the metadata and the raw data may go to separate files, on separate storage. The raw data file
+  // name is relative to the file name, so that it follows the renaming of the file.
+  m_inprogress_file_name = filename_to_open;
+  m_split_files = writer_params.split_files;
+  m_split_metadata_directory = writer_params.split_metadata_directory;
+  if (m_split_files) {
+    std::string metadata_format = m_split_metadata_directory.empty()
+                                    ? std::string("%s") + SPLIT_METADATA_SUFFIX
+                                    : escape_printf_format(get_split_metadata_file_name(filename_to_open));
+    add_split_driver(file_access_props, metadata_format, std::string("%s") + SPLIT_RAW_DATA_SUFFIX);
+  }
+
+  // the file may be built in memory, without a backing store: write_core_image() writes it to disk
+  m_core_staging_max_bytes = writer_params.core_staging_max_bytes;
+  m_core_staging_direct_io = writer_params.core_staging_direct_io;
+  if (m_core_staging_max_bytes > 0) {
+    if (writer_params.live_tail) {
+      ers::warning(CoreStagingUnavailable(ERS_HERE, filename_to_open, "live_tail readers need the file on disk"));
+    } else if (m_split_files) {
+      ers::warning(CoreStagingUnavailable(ERS_HERE, filename_to_open, "split files are written by the split driver"));
+    } else {
+      size_t increment = std::min(m_core_staging_max_bytes, CORE_STAGING_INCREMENT_BYTES);
+      file_access_props.add(RawHDF5Property(
+        "core_driver", [increment](hid_t hid) { return H5Pset_fapl_core(hid, increment, false); }));
+      m_core_staging = true;
+    }
+  }
+
   // do the file open
   try {
-    m_file_ptr.reset(new HighFive::File(filename_to_open, m_open_flags));
+    m_file_ptr.reset(new HighFive::File(filename_to_open, m_open_flags, file_create_props, file_access_props));
   } catch (std::exception const& excpt) {
     throw FileOpenFailed(ERS_HERE, filename_to_open, excpt.what());
   }
@@ -68,9 +509,18 @@ HDF5RawDataFile::HDF5RawDataFile(std::string file_name,
   write_attribute("creation_timestamp", file_creation_timestamp);
   write_attribute("application_name", application_name);
 
-  // set the file layout contents
-  m_file_layout_ptr.reset(new HDF5FileLayout(fl_params));
+  // write the file layout contents
   write_file_layout();
+  fill_dataset_storage_params();
+
+  // the packed fragment store lives in the file-level group, next to the record groups
+  if (m_file_layout_ptr->is_packed_fragment_store()) {
+    HighFive::Group file_level_group = m_file_ptr->createGroup(m_file_layout_ptr->get_file_level_group_name());
+    m_packed_store_ptr = std::make_unique<HDF5PackedFragmentStore>(
+      file_level_group, [this](daqdataformats::SourceID::Subsystem subsystem) {
+        return get_packed_store_create_props(subsystem);
+      });
+  }
 
   // write the SourceID-related attributes
   HDF5SourceIDHandler::populate_source_id_geo_id_map(srcid_geoid_map, m_file_level_source_id_geo_id_map);
@@ -79,13 +529,145 @@ HDF5RawDataFile::HDF5RawDataFile(std::string file_name,
   // write the record type
   m_record_type = fl_params.record_name_prefix;
   write_attribute("record_type", m_record_type);
+
+  // set up and record the flush policy
+  m_flush_policy = string_to_flush_policy(writer_params.flush_policy);
+  m_flush_interval_records = std::max(writer_params.flush_interval_records, 1);
+  m_flush_interval_bytes = writer_params.flush_interval_bytes;
+  m_flush_interval_time = std::chrono::milliseconds(writer_params.flush_interval_ms);
+  m_last_flush_time = std::chrono::steady_clock::now();
+  write_attribute("flush_policy", flush_policy_to_string(m_flush_policy));
+  if (m_flush_policy == FlushPolicy::kEveryNRecords) {
+    write_attribute("flush_interval_records", m_flush_interval_records);
+  } else if (m_flush_policy == FlushPolicy::kEveryNBytes) {
+    write_attribute("flush_interval_bytes", m_flush_interval_bytes);
+  } else if (m_flush_policy == FlushPolicy::kTimeInterval) {
+    write_attribute("flush_interval_ms", static_cast<size_t>(m_flush_interval_time.count()));
+  }
+
+  // set up the disk space management (the policy was checked before opening the file)
+  m_free_space_reserve_bytes = writer_params.free_space_reserve_bytes;
+  m_free_space_wait_timeout = std::chrono::milliseconds(writer_params.free_space_wait_timeout_ms);
+  m_preallocation_extent_bytes = writer_params.preallocation_extent_bytes;
+  if (m_preallocation_extent_bytes > 0 && !m_core_staging)
+    setup_preallocation();
+
+  if (writer_params.live_tail)
+    setup_live_tail();
+
+  // the compression pool only compresses the fragments of subsystems whose datasets have deflate (and optionally
+  // shuffle, which leaves one-byte elements unchanged) as their only filters, and are a single chunk, which it
+  // knows how to produce. The packed store compresses whole store chunks through the filter pipeline instead.
+  if (writer_params.compression_thread_count > 0 && !m_packed_store_ptr) {
+    for (auto const& [subsystem, storage_params] : m_dataset_storage_params) {
+      if (storage_params.deflate_level > 0 && storage_params.szip_pixels_per_block == 0 &&
+          storage_params.filter_id == 0 && storage_params.chunk_size_bytes == 0)
+        m_pool_compressed_subsystems.insert(subsystem);
+    }
+    if (!m_pool_compressed_subsystems.empty()) {
+      m_compression_pool_ptr = std::make_unique<WorkStealingThreadPool>(writer_params.compression_thread_count);
+      TLOG_DEBUG(TLVL_BASIC) << "Started " << m_compression_pool_ptr->get_thread_count()
+                             << " compression threads for " << file_name;
+    }
+  }
+
+  // start the background I/O thread, if requested; this needs to be last, since the
+  // thread may start writing as soon as the first record is queued
+  if (writer_params.async_write_queue_depth > 0) {
+    hbool_t library_is_threadsafe = false;
+    H5is_library_threadsafe(&library_is_threadsafe);
+    if (!library_is_threadsafe) {
+      ers::warning(HDF5LibraryNotThreadSafe(ERS_HERE, file_name));
+    }
+
+    m_write_queue_ptr = std::make_unique<write_queue_t>(writer_params.async_write_queue_depth);
+    m_io_thread = std::thread(&HDF5RawDataFile::run_io_thread, this);
+    TLOG_DEBUG(TLVL_BASIC) << "Started background I/O thread for " << file_name << " with a queue depth of "
+                           << m_write_queue_ptr->capacity();
+  }
 }
 
 
 HDF5RawDataFile::~HDF5RawDataFile()
 {
+  {
+    std::lock_guard<std::shared_mutex> lk(m_close_mutex);
+    if (m_close_future.valid()) {
+      // failures were reported through the future
+      m_close_future.wait();
+      return;
+    }
+    m_close_requested = true;
+  }
+  do_close();
+}
+
+/**
+ * @brief Close the file on the finalizer thread. Calling it again returns the same future.
+ */
+std::shared_future<void>
+HDF5RawDataFile::close_async()
+{
+  return start_close(true);
+}
+
+/**
+ * @brief Close the file in the calling thread, unless close_async() was called before, and wait for the closing.
+ */
+void
+HDF5RawDataFile::finalize()
+{
+  start_close(false).get();
+}
+
+std::shared_future<void>
+HDF5RawDataFile::start_close(bool in_background)
+{
+  std::lock_guard<std::shared_mutex> lk(m_close_mutex);
+  if (m_close_future.valid())
+    return m_close_future;
+  m_close_requested = true;
+
+  // the closing makes HDF5 calls while the application may be writing other files
+  if (in_background) {
+    hbool_t library_is_threadsafe = false;
+    H5is_library_threadsafe(&library_is_threadsafe);
+    if (library_is_threadsafe) {
+      static WorkStealingThreadPool finalizer_pool(FINALIZER_THREAD_COUNT);
+      m_close_future = finalizer_pool.submit([this]() { do_close(); }).share();
+      return m_close_future;
+    }
+    ers::warning(HDF5LibraryNotThreadSafe(ERS_HERE, m_bare_file_name));
+  }
+
+  std::promise<void> close_promise;
+  try {
+    do_close();
+    close_promise.set_value();
+  } catch (...) {
+    close_promise.set_exception(std::current_exception());
+  }
+  m_close_future = close_promise.get_future().share();
+  return m_close_future;
+}
+
+/**
+ * @brief Write the closing attributes and the record directory, and flush, close and rename the file
+ */
+void
+HDF5RawDataFile::do_close()
+{
+  // any records that are still queued are written before the file is closed, and a synchronous write that
+  // started before the close was requested finishes before anything is released
+  stop_io_thread();
+  std::lock_guard<std::mutex> lk(m_write_mutex);
+  m_compression_pool_ptr.reset();
+  clear_group_cache();
+  m_packed_store_ptr.reset();
+
   if (m_file_ptr.get() != nullptr && m_open_flags != HighFive::File::ReadOnly) {
-    write_attribute("recorded_size", m_recorded_size);
+    write_record_directory();
+    write_attribute("recorded_size", m_recorded_size.load());
 
     int64_t timestamp =
       std::chrono::duration_cast<std::chrono::milliseconds>(system_clock::now().time_since_epoch()).count();
@@ -93,223 +675,1903 @@ HDF5RawDataFile::~HDF5RawDataFile()
     write_attribute("closing_timestamp", file_closing_timestamp);
 
     m_file_ptr->flush();
+    if (m_core_staging)
+      write_core_image();
 
     // rename file to the bare name
-    std::filesystem::rename(m_file_ptr->getName(), m_bare_file_name);
+    if (m_split_files)
+      rename_split_files();
+    else
+      std::filesystem::rename(m_file_ptr->getName(), m_bare_file_name);
+  }
+
+  // explicit destruction; not really needed, but nice to be clear... The layout is kept, since it
+  // describes the closed file to get_file_layout() callers.
+  m_file_ptr.reset();
+  m_path_builder_ptr.reset();
+
+  release_unused_preallocation();
+}
+
+/**
+ * @brief bound the metadata cache of the file, starting from the HDF5 defaults, and evict the metadata of objects
+ * when they are closed
+ */
+void
+HDF5RawDataFile::add_metadata_cache_properties(HighFive::FileAccessProps& file_access_props) const
+{
+  if (m_metadata_cache_max_bytes > 0 || m_metadata_cache_initial_bytes > 0) {
+    size_t max_bytes = m_metadata_cache_max_bytes;
+    size_t initial_bytes = m_metadata_cache_initial_bytes;
+    file_access_props.add(RawHDF5Property("mdc_config", [max_bytes, initial_bytes](hid_t hid) {
+      H5AC_cache_config_t config;
+      config.version = H5AC__CURR_CACHE_CONFIG_VERSION;
+      if (H5Pget_mdc_config(hid, &config) < 0)
+        return herr_t(-1);
+      if (max_bytes > 0) {
+        config.max_size = max_bytes;
+        config.min_size = std::min(config.min_size, max_bytes);
+      }
+      if (initial_bytes > 0 || config.initial_size > config.max_size) {
+        config.set_initial_size = true;
+        config.initial_size =
+          std::clamp((initial_bytes > 0) ? initial_bytes : config.initial_size, config.min_size, config.max_size);
+      }
+      return H5Pset_mdc_config(hid, &config);
+    }));
+  }
+  if (m_evict_on_close)
+    file_access_props.add(
+      RawHDF5Property("evict_on_close", [](hid_t hid) { return H5Pset_evict_on_close(hid, true); }));
+}
+
+std::string
+HDF5RawDataFile::get_split_metadata_file_name(const std::string& file_name) const
+{
+  if (m_split_metadata_directory.empty())
+    return file_name + SPLIT_METADATA_SUFFIX;
+  return (std::filesystem::path(m_split_metadata_directory) / std::filesystem::path(file_name).filename()).string() +
+         SPLIT_METADATA_SUFFIX;
+}
+
+/**
+ * @brief Give the metadata and raw data files of split files their final names. A metadata file in another
+ * directory gets a link next to the raw data file, through which readers find it from the bare file name.
+ */
+void
+HDF5RawDataFile::rename_split_files()
+{
+  std::filesystem::rename(m_inprogress_file_name + SPLIT_RAW_DATA_SUFFIX, m_bare_file_name + SPLIT_RAW_DATA_SUFFIX);
+
+  std::filesystem::path metadata_path =
+    std::filesystem::absolute(get_split_metadata_file_name(m_bare_file_name)).lexically_normal();
+  std::filesystem::rename(get_split_metadata_file_name(m_inprogress_file_name), metadata_path);
+
+  std::filesystem::path link_path =
+    std::filesystem::absolute(m_bare_file_name + SPLIT_METADATA_SUFFIX).lexically_normal();
+  if (link_path != metadata_path) {
+    std::filesystem::remove(link_path);
+    std::filesystem::create_symlink(metadata_path, link_path);
+  }
+}
+
+std::vector<std::string>
+HDF5RawDataFile::get_final_file_names() const
+{
+  if (!m_split_files)
+    return { m_bare_file_name };
+
+  std::vector<std::string> file_names{ m_bare_file_name + SPLIT_RAW_DATA_SUFFIX,
+                                       get_split_metadata_file_name(m_bare_file_name) };
+  std::filesystem::path metadata_path = std::filesystem::absolute(file_names.back()).lexically_normal();
+  std::filesystem::path link_path =
+    std::filesystem::absolute(m_bare_file_name + SPLIT_METADATA_SUFFIX).lexically_normal();
+  if (link_path != metadata_path)
+    file_names.push_back(link_path.string());
+  return file_names;
+}
+
+bool
+HDF5RawDataFile::is_split_file(const std::string& file_name)
+{
+  return !std::filesystem::exists(file_name) && std::filesystem::exists(file_name + SPLIT_METADATA_SUFFIX) &&
+         std::filesystem::exists(file_name + SPLIT_RAW_DATA_SUFFIX);
+}
+
+void
+HDF5RawDataFile::check_open_for_writing(uint64_t rec_num, // NOLINT(build/unsigned)
+                                        daqdataformats::sequence_number_t seq_num) const
+{
+  if (m_close_requested.load())
+    throw FileClosed(ERS_HERE, rec_num, seq_num, m_bare_file_name);
+}
+
+/**
+ * @brief Write a TriggerRecord to the file.
+ */
+void
+HDF5RawDataFile::write(const daqdataformats::TriggerRecord& tr)
+{
+  check_open_for_writing(tr.get_header_ref().get_trigger_number(), tr.get_header_ref().get_sequence_number());
+
+  // keep the records in order with respect to any that were queued earlier
+  drain();
+
+  std::lock_guard<std::mutex> lk(m_write_mutex);
+  // the file may have been closed while this thread waited for the lock
+  check_open_for_writing(tr.get_header_ref().get_trigger_number(), tr.get_header_ref().get_sequence_number());
+  if (m_compression_pool_ptr) {
+    auto compressed_frags = submit_compression(tr.get_fragments_ref());
+    do_write_record(tr, compressed_frags);
+    return;
+  }
+  do_write_record(tr);
+}
+
+/**
+ * @brief Write a TimeSlice to the file.
+ */
+void
+HDF5RawDataFile::write(const daqdataformats::TimeSlice& ts)
+{
+  check_open_for_writing(ts.get_header().timeslice_number, 0);
+
+  // keep the records in order with respect to any that were queued earlier
+  drain();
+
+  std::lock_guard<std::mutex> lk(m_write_mutex);
+  // the file may have been closed while this thread waited for the lock
+  check_open_for_writing(ts.get_header().timeslice_number, 0);
+  if (m_compression_pool_ptr) {
+    auto compressed_frags = submit_compression(ts.get_fragments_ref());
+    do_write_record(ts, compressed_frags);
+    return;
+  }
+  do_write_record(ts);
+}
+
+/**
+ * @brief Write a TriggerRecord to the file, and hand its Fragments back to the pool.
+ */
+void
+HDF5RawDataFile::write(std::unique_ptr<daqdataformats::TriggerRecord> tr, FragmentBufferPool& buffer_pool)
+{
+  check_open_for_writing(tr->get_header_ref().get_trigger_number(), tr->get_header_ref().get_sequence_number());
+
+  // keep the records in order with respect to any that were queued earlier
+  drain();
+
+  do_write_and_hand_back(*tr, buffer_pool);
+}
+
+/**
+ * @brief Write a TimeSlice to the file, and hand its Fragments back to the pool.
+ */
+void
+HDF5RawDataFile::write(std::unique_ptr<daqdataformats::TimeSlice> ts, FragmentBufferPool& buffer_pool)
+{
+  check_open_for_writing(ts->get_header().timeslice_number, 0);
+
+  // keep the records in order with respect to any that were queued earlier
+  drain();
+
+  do_write_and_hand_back(*ts, buffer_pool);
+}
+
+template<typename RecordT>
+void
+HDF5RawDataFile::do_write_and_hand_back(RecordT& record, FragmentBufferPool& buffer_pool)
+{
+  std::vector<std::future<PrecompressedFragment>> compressed_frags;
+  try {
+    std::lock_guard<std::mutex> lk(m_write_mutex);
+    // the file may have been closed while this thread waited for the lock
+    check_open_for_writing(get_record_id(record).first, get_record_id(record).second);
+    if (m_compression_pool_ptr)
+      compressed_frags = submit_compression(record.get_fragments_ref());
+    if (compressed_frags.empty())
+      do_write_record(record);
+    else
+      do_write_record(record, compressed_frags);
+  } catch (...) {
+    hand_back_fragments(record, compressed_frags, buffer_pool);
+    throw;
+  }
+  hand_back_fragments(record, compressed_frags, buffer_pool);
+}
+
+/**
+ * @brief Write a TriggerRecord whose fragments have already been compressed to the file.
+ */
+void
+HDF5RawDataFile::write(const daqdataformats::TriggerRecordHeader& trh,
+                       const std::vector<PrecompressedFragment>& precompressed_frags)
+{
+  check_open_for_writing(trh.get_trigger_number(), trh.get_sequence_number());
+
+  // keep the records in order with respect to any that were queued earlier
+  drain();
+
+  std::lock_guard<std::mutex> lk(m_write_mutex);
+  // the file may have been closed while this thread waited for the lock
+  check_open_for_writing(trh.get_trigger_number(), trh.get_sequence_number());
+  do_write_record(trh, precompressed_frags);
+}
+
+/**
+ * @brief Write a TimeSlice whose fragments have already been compressed to the file.
+ */
+void
+HDF5RawDataFile::write(const daqdataformats::TimeSliceHeader& tsh,
+                       const std::vector<PrecompressedFragment>& precompressed_frags)
+{
+  check_open_for_writing(tsh.timeslice_number, 0);
+
+  // keep the records in order with respect to any that were queued earlier
+  drain();
+
+  std::lock_guard<std::mutex> lk(m_write_mutex);
+  // the file may have been closed while this thread waited for the lock
+  check_open_for_writing(tsh.timeslice_number, 0);
+  do_write_record(tsh, precompressed_frags);
+}
+
+/**
+ * @brief Write a TriggerRecord whose fragment payloads are spread over several buffers to the file.
+ */
+void
+HDF5RawDataFile::write(const daqdataformats::TriggerRecordHeader& trh,
+                       const std::vector<ScatteredFragment>& scattered_frags)
+{
+  check_open_for_writing(trh.get_trigger_number(), trh.get_sequence_number());
+  check_scattered_fragment_sizes(scattered_frags);
+
+  // keep the records in order with respect to any that were queued earlier
+  drain();
+
+  std::lock_guard<std::mutex> lk(m_write_mutex);
+  // the file may have been closed while this thread waited for the lock
+  check_open_for_writing(trh.get_trigger_number(), trh.get_sequence_number());
+  do_write_record(trh, scattered_frags);
+}
+
+/**
+ * @brief Write a TimeSlice whose fragment payloads are spread over several buffers to the file.
+ */
+void
+HDF5RawDataFile::write(const daqdataformats::TimeSliceHeader& tsh,
+                       const std::vector<ScatteredFragment>& scattered_frags)
+{
+  check_open_for_writing(tsh.timeslice_number, 0);
+  check_scattered_fragment_sizes(scattered_frags);
+
+  // keep the records in order with respect to any that were queued earlier
+  drain();
+
+  std::lock_guard<std::mutex> lk(m_write_mutex);
+  // the file may have been closed while this thread waited for the lock
+  check_open_for_writing(tsh.timeslice_number, 0);
+  do_write_record(tsh, scattered_frags);
+}
+
+/**
+ * @brief Queue a TriggerRecord for writing by the background I/O thread. Blocks while the queue is full.
+ */
+std::future<void>
+HDF5RawDataFile::write_async(std::unique_ptr<daqdataformats::TriggerRecord> tr)
+{
+  std::shared_lock<std::shared_mutex> close_lk(m_close_mutex);
+  check_open_for_writing(tr->get_header_ref().get_trigger_number(), tr->get_header_ref().get_sequence_number());
+
+  auto pending_write = std::make_unique<PendingWrite>();
+  if (m_compression_pool_ptr && is_async())
+    pending_write->compressed_frags = submit_compression(tr->get_fragments_ref());
+  pending_write->record = std::move(tr);
+  return enqueue_write(std::move(pending_write));
+}
+
+/**
+ * @brief Queue a TimeSlice for writing by the background I/O thread. Blocks while the queue is full.
+ */
+std::future<void>
+HDF5RawDataFile::write_async(std::unique_ptr<daqdataformats::TimeSlice> ts)
+{
+  std::shared_lock<std::shared_mutex> close_lk(m_close_mutex);
+  check_open_for_writing(ts->get_header().timeslice_number, 0);
+
+  auto pending_write = std::make_unique<PendingWrite>();
+  if (m_compression_pool_ptr && is_async())
+    pending_write->compressed_frags = submit_compression(ts->get_fragments_ref());
+  pending_write->record = std::move(ts);
+  return enqueue_write(std::move(pending_write));
+}
+
+/**
+ * @brief Queue a TriggerRecord for writing by the background I/O thread, which hands its Fragments back to the pool
+ * once it is written. Blocks while the queue is full.
+ */
+std::future<void>
+HDF5RawDataFile::write_async(std::unique_ptr<daqdataformats::TriggerRecord> tr, FragmentBufferPool& buffer_pool)
+{
+  std::shared_lock<std::shared_mutex> close_lk(m_close_mutex);
+  check_open_for_writing(tr->get_header_ref().get_trigger_number(), tr->get_header_ref().get_sequence_number());
+
+  auto pending_write = std::make_unique<PendingWrite>();
+  if (m_compression_pool_ptr && is_async())
+    pending_write->compressed_frags = submit_compression(tr->get_fragments_ref());
+  pending_write->record = std::move(tr);
+  pending_write->buffer_pool = &buffer_pool;
+  return enqueue_write(std::move(pending_write));
+}
+
+/**
+ * @brief Queue a TimeSlice for writing by the background I/O thread, which hands its Fragments back to the pool
+ * once it is written. Blocks while the queue is full.
+ */
+std::future<void>
+HDF5RawDataFile::write_async(std::unique_ptr<daqdataformats::TimeSlice> ts, FragmentBufferPool& buffer_pool)
+{
+  std::shared_lock<std::shared_mutex> close_lk(m_close_mutex);
+  check_open_for_writing(ts->get_header().timeslice_number, 0);
+
+  auto pending_write = std::make_unique<PendingWrite>();
+  if (m_compression_pool_ptr && is_async())
+    pending_write->compressed_frags = submit_compression(ts->get_fragments_ref());
+  pending_write->record = std::move(ts);
+  pending_write->buffer_pool = &buffer_pool;
+  return enqueue_write(std::move(pending_write));
+}
+
+/**
+ * @brief Queue a TriggerRecord for writing, if there is room. Otherwise, the record stays with the caller.
+ */
+bool
+HDF5RawDataFile::try_write_async(std::unique_ptr<daqdataformats::TriggerRecord>& tr, std::future<void>& completion)
+{
+  std::shared_lock<std::shared_mutex> close_lk(m_close_mutex);
+  check_open_for_writing(tr->get_header_ref().get_trigger_number(), tr->get_header_ref().get_sequence_number());
+
+  auto pending_write = std::make_unique<PendingWrite>();
+  if (m_compression_pool_ptr && is_async())
+    pending_write->compressed_frags = submit_compression(tr->get_fragments_ref());
+  pending_write->record = std::move(tr);
+  std::future<void> local_completion = pending_write->completion.get_future();
+  if (!try_enqueue_write(pending_write)) {
+    // the compression tasks refer to the fragments, which go back to the caller
+    for (auto& compressed_frag : pending_write->compressed_frags) {
+      if (compressed_frag.valid())
+        compressed_frag.wait();
+    }
+    tr = std::move(std::get<std::unique_ptr<daqdataformats::TriggerRecord>>(pending_write->record));
+    return false;
+  }
+  completion = std::move(local_completion);
+  return true;
+}
+
+/**
+ * @brief Queue a TimeSlice for writing, if there is room. Otherwise, the record stays with the caller.
+ */
+bool
+HDF5RawDataFile::try_write_async(std::unique_ptr<daqdataformats::TimeSlice>& ts, std::future<void>& completion)
+{
+  std::shared_lock<std::shared_mutex> close_lk(m_close_mutex);
+  check_open_for_writing(ts->get_header().timeslice_number, 0);
+
+  auto pending_write = std::make_unique<PendingWrite>();
+  if (m_compression_pool_ptr && is_async())
+    pending_write->compressed_frags = submit_compression(ts->get_fragments_ref());
+  pending_write->record = std::move(ts);
+  std::future<void> local_completion = pending_write->completion.get_future();
+  if (!try_enqueue_write(pending_write)) {
+    // the compression tasks refer to the fragments, which go back to the caller
+    for (auto& compressed_frag : pending_write->compressed_frags) {
+      if (compressed_frag.valid())
+        compressed_frag.wait();
+    }
+    ts = std::move(std::get<std::unique_ptr<daqdataformats::TimeSlice>>(pending_write->record));
+    return false;
+  }
+  completion = std::move(local_completion);
+  return true;
+}
+
+std::future<void>
+HDF5RawDataFile::enqueue_write(std::unique_ptr<PendingWrite> pending_write)
+{
+  if (!is_async())
+    throw AsyncWritingNotEnabled(ERS_HERE, m_bare_file_name);
+
+  check_io_thread_running(*pending_write);
+  std::future<void> completion = pending_write->completion.get_future();
+  ++m_pending_write_count;
+  while (!m_write_queue_ptr->try_push(pending_write)) {
+    if (m_io_thread_stop_requested.load()) {
+      if (--m_pending_write_count == 0) {
+        std::lock_guard<std::mutex> lk(m_queue_wait_mutex);
+        m_writes_drained_cv.notify_all();
+      }
+      check_io_thread_running(*pending_write);
+    }
+    // backpressure: wait for the I/O thread to make room
+    std::unique_lock<std::mutex> lk(m_queue_wait_mutex);
+    m_queue_not_full_cv.wait_for(lk, std::chrono::milliseconds(1));
+  }
+  m_queue_not_empty_cv.notify_one();
+  return completion;
+}
+
+bool
+HDF5RawDataFile::try_enqueue_write(std::unique_ptr<PendingWrite>& pending_write)
+{
+  if (!is_async())
+    throw AsyncWritingNotEnabled(ERS_HERE, m_bare_file_name);
+
+  check_io_thread_running(*pending_write);
+  ++m_pending_write_count;
+  if (!m_write_queue_ptr->try_push(pending_write)) {
+    --m_pending_write_count;
+    return false;
+  }
+  m_queue_not_empty_cv.notify_one();
+  return true;
+}
+
+/**
+ * @brief the queue takes no more records once the I/O thread is asked to stop, since they would never be written
+ */
+void
+HDF5RawDataFile::check_io_thread_running(PendingWrite& pending_write)
+{
+  if (!m_io_thread_stop_requested.load())
+    return;
+
+  // the compression tasks refer to the fragments of the record
+  for (auto& compressed_frag : pending_write.compressed_frags) {
+    if (compressed_frag.valid())
+      compressed_frag.wait();
+  }
+  auto rid = std::visit([](auto const& record_ptr) { return get_record_id(*record_ptr); }, pending_write.record);
+  throw FileClosed(ERS_HERE, rid.first, rid.second, m_bare_file_name);
+}
+
+void
+HDF5RawDataFile::drain()
+{
+  if (!is_async())
+    return;
+
+  std::unique_lock<std::mutex> lk(m_queue_wait_mutex);
+  m_writes_drained_cv.wait(lk, [this] { return m_pending_write_count.load() == 0; });
+}
+
+/**
+ * @brief Main loop of the background I/O thread. Runs until a stop is requested *and* the queue is empty.
+ */
+void
+HDF5RawDataFile::run_io_thread()
+{
+  std::unique_ptr<PendingWrite> pending_write;
+  while (true) {
+    if (!m_write_queue_ptr->try_pop(pending_write)) {
+      if (m_io_thread_stop_requested.load() && m_write_queue_ptr->size_approx() == 0)
+        break;
+      std::unique_lock<std::mutex> lk(m_queue_wait_mutex);
+      m_queue_not_empty_cv.wait_for(lk, std::chrono::milliseconds(1), [this] {
+        return m_write_queue_ptr->size_approx() > 0 || m_io_thread_stop_requested.load();
+      });
+      continue;
+    }
+    m_queue_not_full_cv.notify_one();
+
+    std::exception_ptr write_exception;
+    try {
+      std::lock_guard<std::mutex> lk(m_write_mutex);
+      std::visit(
+        [this, &pending_write](auto const& record_ptr) {
+          if (pending_write->compressed_frags.empty())
+            do_write_record(*record_ptr);
+          else
+            do_write_record(*record_ptr, pending_write->compressed_frags);
+        },
+        pending_write->record);
+    } catch (std::exception const& excpt) {
+      uint64_t rec_num = 0; // NOLINT(build/unsigned)
+      daqdataformats::sequence_number_t seq_num = 0;
+      if (auto tr_ptr = std::get_if<std::unique_ptr<daqdataformats::TriggerRecord>>(&pending_write->record)) {
+        rec_num = (*tr_ptr)->get_header_ref().get_trigger_number();
+        seq_num = (*tr_ptr)->get_header_ref().get_sequence_number();
+      } else if (auto ts_ptr = std::get_if<std::unique_ptr<daqdataformats::TimeSlice>>(&pending_write->record)) {
+        rec_num = (*ts_ptr)->get_header().timeslice_number;
+      }
+      ers::error(AsyncWriteFailed(ERS_HERE, rec_num, seq_num, m_bare_file_name, excpt.what()));
+      write_exception = std::current_exception();
+    }
+
+    // the fragments are back in the pool by the time that the record is reported as complete
+    if (pending_write->buffer_pool) {
+      std::visit(
+        [&pending_write](auto const& record_ptr) {
+          hand_back_fragments(*record_ptr, pending_write->compressed_frags, *pending_write->buffer_pool);
+        },
+        pending_write->record);
+    }
+    if (write_exception)
+      pending_write->completion.set_exception(write_exception);
+    else
+      pending_write->completion.set_value();
+    pending_write.reset();
+
+    if (--m_pending_write_count == 0) {
+      std::lock_guard<std::mutex> lk(m_queue_wait_mutex);
+      m_writes_drained_cv.notify_all();
+    }
+  }
+}
+
+void
+HDF5RawDataFile::stop_io_thread()
+{
+  if (!m_io_thread.joinable())
+    return;
+
+  m_io_thread_stop_requested = true;
+  m_queue_not_empty_cv.notify_all();
+  m_io_thread.join();
+}
+
+/**
+ * @brief Write a record header and its fragments to the file. The caller is responsible for holding m_write_mutex.
+ */
+template<typename RecordHeaderT, typename FragmentContainerT>
+void
+HDF5RawDataFile::do_write_record(const RecordHeaderT& record_header, const FragmentContainerT& fragments)
+{
+  // the source_id_path map that we will build up as we write the record header
+  // and fragments (and then write the map into the HDF5 record Group)
+  HDF5SourceIDHandler::source_id_path_map_t source_id_path_map;
+
+  // the map of fragment types to SourceIDS
+  HDF5SourceIDHandler::fragment_type_source_id_map_t fragment_type_source_id_map;
+
+  // the map of subdetectors to SourceIDS
+  HDF5SourceIDHandler::subdetector_source_id_map_t subdetector_source_id_map;
+
+  // writes the maps with the encoding of the file layout version
+  HDF5SourceIDHandler sid_handler(get_version());
+
+  record_id_t rid = get_record_id(record_header);
+  if (m_free_space_reserve_bytes > 0 || m_preallocation_fd >= 0 || m_core_staging) {
+    // compressed fragments are counted with their uncompressed size
+    size_t record_size_bytes = get_record_header_size(record_header);
+    for (auto const& frag : fragments)
+      record_size_bytes += fragment_header(fragment_ref(frag)).size;
+    check_free_space(rid, record_size_bytes);
+    spill_core_image_if_needed(record_size_bytes);
+    preallocate_if_needed(record_size_bytes);
+  }
+
+  size_t recorded_size_at_start = m_recorded_size.load();
+  auto write_start_time = std::chrono::steady_clock::now();
+
+  // write the record header into the HDF5 file/group
+  HighFive::Group record_level_group = write(record_header, source_id_path_map);
+
+  // store the SourceID of the record header in the HDF5 file/group
+  // (since there should only be one entry in the map at this point, we'll take advantage of that...)
+  RecordDirectoryEntry directory_entry;
+  daqdataformats::SourceID record_header_source_id;
+  for (auto const& source_id_path : source_id_path_map) {
+    record_header_source_id = source_id_path.first;
+    directory_entry.header_source_subsys = static_cast<uint32_t>(source_id_path.first.subsystem); // NOLINT
+    directory_entry.header_source_id = source_id_path.first.id;
+  }
+
+  // write all of the fragments into the HDF5 file/group
+  for (auto const& frag : fragments) {
+    write(fragment_ref(frag), source_id_path_map);
+    auto const& frag_header = fragment_header(fragment_ref(frag));
+    HDF5SourceIDHandler::add_fragment_type_source_id_to_map(
+      fragment_type_source_id_map,
+      static_cast<daqdataformats::FragmentType>(frag_header.fragment_type),
+      frag_header.element_id);
+    HDF5SourceIDHandler::add_subdetector_source_id_to_map(
+      subdetector_source_id_map,
+      static_cast<detdataformats::DetID::Subdetector>(frag_header.detector_id),
+      frag_header.element_id);
+  }
+
+  // store all of the record-level maps in the HDF5 file/group, unless the record refers to a record layout
+  {
+    ScopedWritePhaseTimer timer(m_write_statistics, WritePhase::kAttributeStore);
+    if (!m_record_layout_dictionary || !store_record_layout(record_level_group,
+                                                            record_header_source_id,
+                                                            source_id_path_map,
+                                                            fragment_type_source_id_map,
+                                                            subdetector_source_id_map,
+                                                            sid_handler)) {
+      sid_handler.store_record_header_source_id(record_level_group, record_header_source_id);
+      sid_handler.store_record_level_path_info(record_level_group, source_id_path_map);
+      sid_handler.store_record_level_fragment_type_map(record_level_group, fragment_type_source_id_map);
+      sid_handler.store_record_level_subdetector_map(record_level_group, subdetector_source_id_map);
+    }
+  }
+
+  // the packed store writes a whole record at once
+  if (m_packed_store_ptr) {
+    {
+      ScopedWritePhaseTimer timer(m_write_statistics, WritePhase::kRawWrite);
+      m_packed_store_ptr->write_pending();
+    }
+    if (m_flush_policy == FlushPolicy::kPerDataset)
+      flush_dataset();
+  }
+
+  directory_entry.record_number = rid.first;
+  directory_entry.sequence_number = rid.second;
+  directory_entry.trigger_timestamp = get_record_timestamp(record_header);
+  directory_entry.size_bytes = m_recorded_size.load() - recorded_size_at_start;
+  directory_entry.fragment_count = fragments.size();
+  m_record_directory.push_back(directory_entry);
+
+  // the record is visible to the readers that follow the file once the directory entry is flushed
+  if (m_live_tail) {
+    append_to_record_directory(directory_entry);
+    if (m_flush_policy == FlushPolicy::kPerDataset)
+      flush_dataset();
+  }
+
+  flush_after_record_if_needed(directory_entry.size_bytes);
+
+  // the groups of the record are closed, and their metadata evicted, once the record group handle is released
+  if (m_evict_on_close)
+    evict_record_groups(record_level_group.getPath());
+
+  auto write_end_time = std::chrono::steady_clock::now();
+  int64_t record_write_time_ns =
+    std::chrono::duration_cast<std::chrono::nanoseconds>(write_end_time - write_start_time).count();
+  ++m_written_record_count;
+  m_write_time_ns += record_write_time_ns;
+
+  RecordWriteSummary record_summary;
+  record_summary.record_number = rid.first;
+  record_summary.sequence_number = rid.second;
+  record_summary.size_bytes = directory_entry.size_bytes;
+  record_summary.write_time_ns = record_write_time_ns;
+  record_summary.fragment_count = directory_entry.fragment_count;
+  m_write_statistics.add_record(record_summary, write_end_time);
+}
+
+/**
+ * @brief Write a TriggerRecord to the file. The caller is responsible for holding m_write_mutex.
+ */
+void
+HDF5RawDataFile::do_write_record(const daqdataformats::TriggerRecord& tr)
+{
+  do_write_record(tr.get_header_ref(), tr.get_fragments_ref());
+}
+
+/**
+ * @brief Write a TimeSlice to the file. The caller is responsible for holding m_write_mutex.
+ */
+void
+HDF5RawDataFile::do_write_record(const daqdataformats::TimeSlice& ts)
+{
+  do_write_record(ts.get_header(), ts.get_fragments_ref());
+}
+
+/**
+ * @brief Write a TriggerRecord whose fragments are being compressed by the compression pool to the file.
+ * The caller is responsible for holding m_write_mutex.
+ */
+void
+HDF5RawDataFile::do_write_record(const daqdataformats::TriggerRecord& tr,
+                                 std::vector<std::future<PrecompressedFragment>>& compressed_frags)
+{
+  do_write_record(tr.get_header_ref(), collect_compressed_fragments(tr.get_fragments_ref(), compressed_frags));
+}
+
+/**
+ * @brief Write a TimeSlice whose fragments are being compressed by the compression pool to the file.
+ * The caller is responsible for holding m_write_mutex.
+ */
+void
+HDF5RawDataFile::do_write_record(const daqdataformats::TimeSlice& ts,
+                                 std::vector<std::future<PrecompressedFragment>>& compressed_frags)
+{
+  do_write_record(ts.get_header(), collect_compressed_fragments(ts.get_fragments_ref(), compressed_frags));
+}
+
+/**
+ * @brief Hand the fragments of a record to the compression pool. The fragments must outlive the returned futures.
+ */
+std::vector<std::future<PrecompressedFragment>>
+HDF5RawDataFile::submit_compression(const std::vector<std::unique_ptr<daqdataformats::Fragment>>& fragments)
+{
+  std::vector<std::future<PrecompressedFragment>> compressed_frags;
+  compressed_frags.reserve(fragments.size());
+  for (auto const& frag_ptr : fragments) {
+    const daqdataformats::Fragment* frag = frag_ptr.get();
+    if (m_pool_compressed_subsystems.count(frag->get_element_id().subsystem) == 0) {
+      compressed_frags.emplace_back();
+      continue;
+    }
+    compressed_frags.push_back(m_compression_pool_ptr->submit([this, frag]() {
+      auto compression_start_time = std::chrono::steady_clock::now();
+      PrecompressedFragment precompressed_frag = compress_fragment(*frag);
+      m_compression_time_ns += std::chrono::duration_cast<std::chrono::nanoseconds>(
+                                 std::chrono::steady_clock::now() - compression_start_time)
+                                 .count();
+      ++m_compressed_fragment_count;
+      m_compression_input_bytes += frag->get_size();
+      m_compression_output_bytes += precompressed_frag.data.size();
+      return precompressed_frag;
+    }));
+  }
+  return compressed_frags;
+}
+
+/**
+ * @brief Wait for the compression of the fragments of a record, in order. Rethrows compression failures.
+ */
+std::vector<PooledFragment>
+HDF5RawDataFile::collect_compressed_fragments(const std::vector<std::unique_ptr<daqdataformats::Fragment>>& fragments,
+                                              std::vector<std::future<PrecompressedFragment>>& compressed_frags)
+{
+  auto wait_start_time = std::chrono::steady_clock::now();
+  std::vector<PooledFragment> pooled_frags(fragments.size());
+  for (size_t idx = 0; idx < fragments.size(); ++idx) {
+    pooled_frags[idx].frag_ptr = fragments[idx].get();
+    if (compressed_frags[idx].valid())
+      pooled_frags[idx].precompressed_frag = compressed_frags[idx].get();
+  }
+  m_compression_wait_time_ns +=
+    std::chrono::duration_cast<std::chrono::nanoseconds>(std::chrono::steady_clock::now() - wait_start_time).count();
+  return pooled_frags;
+}
+
+WriteStatistics
+HDF5RawDataFile::get_write_statistics() const
+{
+  return m_write_statistics.get_statistics();
+}
+
+std::vector<RecordDirectoryEntry>
+HDF5RawDataFile::get_record_directory()
+{
+  std::lock_guard<std::mutex> lk(m_write_mutex);
+  return m_record_directory;
+}
+
+HDF5RawDataFile::MetadataCacheStatus
+HDF5RawDataFile::get_metadata_cache_status()
+{
+  std::lock_guard<std::mutex> lk(m_write_mutex);
+  MetadataCacheStatus status;
+  if (!m_file_ptr)
+    return status;
+
+  int entry_count = 0;
+  if (H5Fget_mdc_size(m_file_ptr->getId(),
+                      &status.max_size_bytes,
+                      &status.min_clean_size_bytes,
+                      &status.current_size_bytes,
+                      &entry_count) >= 0)
+    status.entry_count = entry_count;
+  H5Fget_mdc_hit_rate(m_file_ptr->getId(), &status.hit_rate);
+  return status;
+}
+
+size_t
+HDF5RawDataFile::get_free_disk_space() const
+{
+  // the directory is queried, since a file that is built in memory does not exist on disk yet
+  std::filesystem::path directory = std::filesystem::path(m_bare_file_name).parent_path();
+  if (directory.empty())
+    directory = ".";
+  struct statvfs fs_stats;
+  if (statvfs(directory.c_str(), &fs_stats) != 0)
+    throw DiskSpaceQueryFailed(ERS_HERE, directory.string(), std::strerror(errno));
+  return static_cast<size_t>(fs_stats.f_bavail) * fs_stats.f_frsize;
+}
+
+void
+HDF5RawDataFile::set_low_disk_space_callback(low_disk_space_callback_t callback)
+{
+  std::lock_guard<std::mutex> lk(m_write_mutex);
+  m_low_disk_space_callback = std::move(callback);
+}
+
+HDF5RawDataFile::PipelineStageTimings
+HDF5RawDataFile::get_pipeline_stage_timings() const
+{
+  PipelineStageTimings timings;
+  timings.compressed_fragment_count = m_compressed_fragment_count.load();
+  timings.compression_input_bytes = m_compression_input_bytes.load();
+  timings.compression_output_bytes = m_compression_output_bytes.load();
+  timings.compression_seconds = m_compression_time_ns.load() / 1.0e9;
+  timings.compression_wait_seconds = m_compression_wait_time_ns.load() / 1.0e9;
+  timings.written_record_count = m_written_record_count.load();
+  timings.write_seconds = m_write_time_ns.load() / 1.0e9;
+  return timings;
+}
+
+/**
+ * @brief Write a TriggerRecordHeader to the file.
+ */
+HighFive::Group
+HDF5RawDataFile::write(const daqdataformats::TriggerRecordHeader& trh,
+                       HDF5SourceIDHandler::source_id_path_map_t& path_map)
+{
+  std::tuple<size_t, std::string, HighFive::Group> write_results =
+    m_packed_store_ptr
+      ? do_write_packed(m_path_builder_ptr->get_path_elements(trh),
+                        static_cast<const char*>(trh.get_storage_location()),
+                        make_packed_store_entry(trh.get_trigger_number(),
+                                                trh.get_sequence_number(),
+                                                trh.get_header().element_id,
+                                                trh.get_total_size_bytes(),
+                                                true))
+      : do_write(m_path_builder_ptr->get_path_elements(trh),
+                 static_cast<const char*>(trh.get_storage_location()),
+                 trh.get_total_size_bytes());
+  m_recorded_size += std::get<0>(write_results);
+  HDF5SourceIDHandler::add_source_id_path_to_map(path_map, trh.get_header().element_id, std::get<1>(write_results));
+  return std::get<2>(write_results);
+}
+
+/**
+ * @brief Write a TimeSliceHeader to the file.
+ */
+HighFive::Group
+HDF5RawDataFile::write(const daqdataformats::TimeSliceHeader& tsh, HDF5SourceIDHandler::source_id_path_map_t& path_map)
+{
+  std::tuple<size_t, std::string, HighFive::Group> write_results =
+    m_packed_store_ptr
+      ? do_write_packed(m_path_builder_ptr->get_path_elements(tsh),
+                        (const char*)(&tsh),
+                        make_packed_store_entry(
+                          tsh.timeslice_number, 0, tsh.element_id, sizeof(daqdataformats::TimeSliceHeader), true))
+      : do_write(
+          m_path_builder_ptr->get_path_elements(tsh), (const char*)(&tsh), sizeof(daqdataformats::TimeSliceHeader));
+  m_recorded_size += std::get<0>(write_results);
+  HDF5SourceIDHandler::add_source_id_path_to_map(path_map, tsh.element_id, std::get<1>(write_results));
+  return std::get<2>(write_results);
+}
+
+/**
+ * @brief Write a Fragment to the file.
+ */
+void
+HDF5RawDataFile::write(const daqdataformats::Fragment& frag, HDF5SourceIDHandler::source_id_path_map_t& path_map)
+{
+  auto storage_params_iter = m_dataset_storage_params.find(frag.get_element_id().subsystem);
+  auto const& frag_header = frag.get_header();
+  std::tuple<size_t, std::string, HighFive::Group> write_results =
+    m_packed_store_ptr
+      ? do_write_packed(m_path_builder_ptr->get_path_elements(frag_header),
+                        static_cast<const char*>(frag.get_storage_location()),
+                        make_packed_store_entry(frag_header.trigger_number,
+                                                frag_header.sequence_number,
+                                                frag_header.element_id,
+                                                frag.get_size(),
+                                                false,
+                                                frag_header.fragment_type))
+      : do_write(m_path_builder_ptr->get_path_elements(frag_header),
+                 static_cast<const char*>(frag.get_storage_location()),
+                 frag.get_size(),
+                 (storage_params_iter != m_dataset_storage_params.end()) ? &storage_params_iter->second : nullptr);
+  m_recorded_size += std::get<0>(write_results);
+
+  daqdataformats::SourceID source_id = frag.get_element_id();
+  HDF5SourceIDHandler::add_source_id_path_to_map(path_map, source_id, std::get<1>(write_results));
+}
+
+/**
+ * @brief Write a Fragment that has already been compressed to the file.
+ */
+void
+HDF5RawDataFile::write(const PrecompressedFragment& precompressed_frag,
+                       HDF5SourceIDHandler::source_id_path_map_t& path_map)
+{
+  auto const& frag_header = precompressed_frag.header;
+  if (m_packed_store_ptr) {
+    // the store datasets are compressed through the filter pipeline, so only uncompressed data can be appended
+    if (precompressed_frag.data.size() != frag_header.size)
+      throw PackedStoreNeedsUncompressedFragments(ERS_HERE, frag_header.element_id.to_string(), m_bare_file_name);
+    auto write_results = do_write_packed(m_path_builder_ptr->get_path_elements(frag_header),
+                                         precompressed_frag.data.data(),
+                                         make_packed_store_entry(frag_header.trigger_number,
+                                                                 frag_header.sequence_number,
+                                                                 frag_header.element_id,
+                                                                 frag_header.size,
+                                                                 false,
+                                                                 frag_header.fragment_type));
+    m_recorded_size += std::get<0>(write_results);
+    HDF5SourceIDHandler::add_source_id_path_to_map(path_map, frag_header.element_id, std::get<1>(write_results));
+    return;
+  }
+
+  auto storage_params_iter = m_dataset_storage_params.find(precompressed_frag.header.element_id.subsystem);
+  // datasets of subsystems without storage params are contiguous, and compress_fragment() leaves them uncompressed
+  std::tuple<size_t, std::string, HighFive::Group> write_results =
+    (storage_params_iter != m_dataset_storage_params.end())
+      ? do_write_precompressed(m_path_builder_ptr->get_path_elements(precompressed_frag.header),
+                               precompressed_frag,
+                               storage_params_iter->second)
+      : do_write(m_path_builder_ptr->get_path_elements(precompressed_frag.header),
+                 precompressed_frag.data.data(),
+                 precompressed_frag.data.size());
+  m_recorded_size += std::get<0>(write_results);
+
+  HDF5SourceIDHandler::add_source_id_path_to_map(
+    path_map, precompressed_frag.header.element_id, std::get<1>(write_results));
+}
+
+/**
+ * @brief Write a Fragment of a record that went through the compression pool to the file.
+ */
+void
+HDF5RawDataFile::write(const PooledFragment& pooled_frag, HDF5SourceIDHandler::source_id_path_map_t& path_map)
+{
+  if (pooled_frag.precompressed_frag)
+    write(*pooled_frag.precompressed_frag, path_map);
+  else
+    write(*pooled_frag.frag_ptr, path_map);
+}
+
+/**
+ * @brief Write a Fragment whose payload is spread over several buffers to the file.
+ */
+void
+HDF5RawDataFile::write(const ScatteredFragment& scattered_frag, HDF5SourceIDHandler::source_id_path_map_t& path_map)
+{
+  auto const& frag_header = scattered_frag.header;
+  auto storage_params_iter = m_dataset_storage_params.find(frag_header.element_id.subsystem);
+  std::tuple<size_t, std::string, HighFive::Group> write_results =
+    m_packed_store_ptr
+      ? do_write_packed(m_path_builder_ptr->get_path_elements(frag_header),
+                        get_fragment_pieces(scattered_frag),
+                        make_packed_store_entry(frag_header.trigger_number,
+                                                frag_header.sequence_number,
+                                                frag_header.element_id,
+                                                frag_header.size,
+                                                false,
+                                                frag_header.fragment_type))
+      : do_write_scattered(m_path_builder_ptr->get_path_elements(frag_header),
+                           scattered_frag,
+                           (storage_params_iter != m_dataset_storage_params.end()) ? &storage_params_iter->second
+                                                                                   : nullptr);
+  m_recorded_size += std::get<0>(write_results);
+
+  HDF5SourceIDHandler::add_source_id_path_to_map(path_map, frag_header.element_id, std::get<1>(write_results));
+}
+
+/**
+ * @brief Run a Fragment through the filters that are configured for its subsystem, so that it can be
+ * written with the direct chunk write. Only uses the file configuration, so it may be called from any thread.
+ */
+PrecompressedFragment
+HDF5RawDataFile::compress_fragment(const daqdataformats::Fragment& frag) const
+{
+  PrecompressedFragment precompressed_frag;
+  precompressed_frag.header = frag.get_header();
+  const char* frag_bytes = static_cast<const char*>(frag.get_storage_location());
+  const size_t frag_size = frag.get_size();
+
+  // in the packed store, fragments are compressed together, by the filters of the store datasets
+  auto storage_params_iter = m_dataset_storage_params.find(frag.get_element_id().subsystem);
+  if (storage_params_iter == m_dataset_storage_params.end() || m_file_layout_ptr->is_packed_fragment_store()) {
+    precompressed_frag.data.assign(frag_bytes, frag_bytes + frag_size);
+    return precompressed_frag;
+  }
+  auto const& storage_params = storage_params_iter->second;
+
+  // The filters are in the order that get_dataset_create_props() adds them. Shuffling one-byte elements
+  // leaves the data unchanged, so only deflate is applied here; szip and any other filter are marked as skipped,
+  // so that HDF5 does not decode them when the chunk is read.
+  uint32_t filter_index = 0; // NOLINT(build/unsigned)
+  uint32_t filter_mask = 0;  // NOLINT(build/unsigned)
+  bool compressed = false;
+  if (storage_params.shuffle)
+    ++filter_index;
+  if (storage_params.deflate_level > 0) {
+    uLongf compressed_size = compressBound(frag_size);
+    precompressed_frag.data.resize(compressed_size);
+    int zlib_status = compress2(reinterpret_cast<Bytef*>(precompressed_frag.data.data()),
+                                &compressed_size,
+                                reinterpret_cast<const Bytef*>(frag_bytes),
+                                frag_size,
+                                storage_params.deflate_level);
+    // like the HDF5 filter, keep the uncompressed data if compression does not help
+    if (zlib_status == Z_OK && compressed_size < frag_size) {
+      precompressed_frag.data.resize(compressed_size);
+      compressed = true;
+    } else {
+      filter_mask |= (1u << filter_index);
+    }
+    ++filter_index;
+  }
+  if (storage_params.szip_pixels_per_block > 0)
+    filter_mask |= (1u << filter_index++);
+  if (storage_params.filter_id > 0)
+    filter_mask |= (1u << filter_index++);
+
+  if (!compressed)
+    precompressed_frag.data.assign(frag_bytes, frag_bytes + frag_size);
+  precompressed_frag.filter_mask = filter_mask;
+  return precompressed_frag;
+}
+
+HDF5RawDataFile::FlushPolicy
+HDF5RawDataFile::string_to_flush_policy(const std::string& policy_name)
+{
+  if (policy_name == "per_dataset")
+    return FlushPolicy::kPerDataset;
+  if (policy_name == "per_record")
+    return FlushPolicy::kPerRecord;
+  if (policy_name == "every_n_records")
+    return FlushPolicy::kEveryNRecords;
+  if (policy_name == "every_n_bytes")
+    return FlushPolicy::kEveryNBytes;
+  if (policy_name == "time_interval")
+    return FlushPolicy::kTimeInterval;
+  if (policy_name == "on_close")
+    return FlushPolicy::kOnClose;
+  throw InvalidFlushPolicy(ERS_HERE, policy_name);
+}
+
+HDF5RawDataFile::FreeSpacePolicy
+HDF5RawDataFile::string_to_free_space_policy(const std::string& policy_name)
+{
+  if (policy_name == "reject")
+    return FreeSpacePolicy::kReject;
+  if (policy_name == "wait")
+    return FreeSpacePolicy::kWait;
+  throw InvalidFreeSpacePolicy(ERS_HERE, policy_name);
+}
+
+std::string
+HDF5RawDataFile::flush_policy_to_string(FlushPolicy policy)
+{
+  switch (policy) {
+    case FlushPolicy::kPerDataset:
+      return "per_dataset";
+    case FlushPolicy::kPerRecord:
+      return "per_record";
+    case FlushPolicy::kEveryNRecords:
+      return "every_n_records";
+    case FlushPolicy::kEveryNBytes:
+      return "every_n_bytes";
+    case FlushPolicy::kTimeInterval:
+      return "time_interval";
+    case FlushPolicy::kOnClose:
+      return "on_close";
+  }
+  return "unknown";
+}
+
+void
+HDF5RawDataFile::flush_dataset()
+{
+  ScopedWritePhaseTimer timer(m_write_statistics, WritePhase::kFlush);
+  m_file_ptr->flush();
+}
+
+void
+HDF5RawDataFile::flush_file()
+{
+  flush_dataset();
+  m_records_since_flush = 0;
+  m_bytes_since_flush = 0;
+  m_last_flush_time = std::chrono::steady_clock::now();
+}
+
+/**
+ * @brief apply the flush policy once a complete record has been written
+ */
+void
+HDF5RawDataFile::flush_after_record_if_needed(size_t record_size_bytes)
+{
+  ++m_records_since_flush;
+  m_bytes_since_flush += record_size_bytes;
+
+  bool flush_needed = false;
+  switch (m_flush_policy) {
+    case FlushPolicy::kPerRecord:
+      flush_needed = true;
+      break;
+    case FlushPolicy::kEveryNRecords:
+      flush_needed = (m_records_since_flush >= m_flush_interval_records);
+      break;
+    case FlushPolicy::kEveryNBytes:
+      flush_needed = (m_bytes_since_flush >= m_flush_interval_bytes);
+      break;
+    case FlushPolicy::kTimeInterval:
+      flush_needed = (std::chrono::steady_clock::now() - m_last_flush_time >= m_flush_interval_time);
+      break;
+    case FlushPolicy::kPerDataset: // already flushed in do_write()
+    case FlushPolicy::kOnClose:
+      break;
+  }
+
+  if (flush_needed) {
+    TLOG_DEBUG(TLVL_FILE_SIZE) << "Flushing " << m_bare_file_name << " after " << m_records_since_flush
+                               << " records and " << m_bytes_since_flush << " bytes";
+    flush_file();
+  }
+}
+
+/**
+ * @brief get the file descriptor of the file, which is needed to preallocate space.
+ * It is only available with the default (sec2) file driver.
+ */
+void
+HDF5RawDataFile::setup_preallocation()
+{
+  hid_t fapl_id = H5Fget_access_plist(m_file_ptr->getId());
+  hid_t driver_id = H5Pget_driver(fapl_id);
+  H5Pclose(fapl_id);
+
+  void* file_handle = nullptr;
+  if (driver_id != H5FD_SEC2 || H5Fget_vfd_handle(m_file_ptr->getId(), H5P_DEFAULT, &file_handle) < 0 ||
+      file_handle == nullptr) {
+    ers::warning(PreallocationFailed(ERS_HERE, m_file_ptr->getName(), "no file descriptor for the file driver"));
+    return;
+  }
+  m_preallocation_fd = *static_cast<int*>(file_handle);
+}
+
+/**
+ * @brief move a file that is built in memory to disk, if the record would take it past the memory cap.
+ * The image is written out, and the file is reopened on disk with the default driver.
+ */
+void
+HDF5RawDataFile::spill_core_image_if_needed(size_t record_size_bytes)
+{
+  if (!m_core_staging)
+    return;
+
+  hsize_t image_size = 0;
+  if (H5Fget_filesize(m_file_ptr->getId(), &image_size) < 0 ||
+      image_size + record_size_bytes <= m_core_staging_max_bytes)
+    return;
+
+  TLOG_DEBUG(TLVL_BASIC) << "Moving " << m_inprogress_file_name << " to disk at " << image_size << " bytes";
+  m_file_ptr->flush();
+  write_core_image();
+
+  HighFive::FileCreateProps file_create_props;
+  HighFive::FileAccessProps file_access_props;
+  add_file_properties(m_file_layout_ptr->get_file_properties(), file_create_props, file_access_props);
+  add_metadata_cache_properties(file_access_props);
+  std::unique_ptr<HighFive::File> disk_file_ptr;
+  try {
+    disk_file_ptr =
+      std::make_unique<HighFive::File>(m_inprogress_file_name, HighFive::File::ReadWrite, file_access_props);
+  } catch (std::exception const& excpt) {
+    throw FileOpenFailed(ERS_HERE, m_inprogress_file_name, excpt.what());
+  }
+
+  // the in-memory file is closed once nothing refers to it any more
+  clear_group_cache();
+  if (m_packed_store_ptr)
+    m_packed_store_ptr->reopen(disk_file_ptr->getGroup(m_file_layout_ptr->get_file_level_group_name()));
+  m_file_ptr = std::move(disk_file_ptr);
+  m_core_staging = false;
+
+  if (m_preallocation_extent_bytes > 0)
+    setup_preallocation();
+}
+
+/**
+ * @brief write the image of the file that is built in memory to disk, with a single sequential write.
+ * With direct I/O, the image is padded to whole blocks, and the file is truncated to its size afterwards.
+ */
+void
+HDF5RawDataFile::write_core_image()
+{
+  ScopedWritePhaseTimer timer(m_write_statistics, WritePhase::kFileImageWrite);
+
+  ssize_t image_size = H5Fget_file_image(m_file_ptr->getId(), nullptr, 0);
+  if (image_size < 0)
+    throw FileImageWriteFailed(ERS_HERE, m_inprogress_file_name, "the file image cannot be retrieved");
+  size_t buffer_size = (image_size / DIRECT_IO_ALIGNMENT + 1) * DIRECT_IO_ALIGNMENT;
+  std::unique_ptr<char, decltype(&std::free)> image_buffer(
+    static_cast<char*>(std::aligned_alloc(DIRECT_IO_ALIGNMENT, buffer_size)), &std::free);
+  if (!image_buffer)
+    throw FileImageWriteFailed(ERS_HERE, m_inprogress_file_name, "no memory for the file image");
+  if (H5Fget_file_image(m_file_ptr->getId(), image_buffer.get(), image_size) < 0)
+    throw FileImageWriteFailed(ERS_HERE, m_inprogress_file_name, "the file image cannot be retrieved");
+  std::memset(image_buffer.get() + image_size, 0, buffer_size - image_size);
+
+  // not all file systems support O_DIRECT
+  int fd = -1;
+  size_t write_size = image_size;
+  if (m_core_staging_direct_io) {
+    fd = ::open(m_inprogress_file_name.c_str(), O_WRONLY | O_CREAT | O_TRUNC | O_DIRECT, 0644);
+    if (fd >= 0)
+      write_size = buffer_size;
+    else
+      TLOG_DEBUG(TLVL_BASIC) << "No direct I/O for " << m_inprogress_file_name << ": " << std::strerror(errno);
+  }
+  if (fd < 0)
+    fd = ::open(m_inprogress_file_name.c_str(), O_WRONLY | O_CREAT | O_TRUNC, 0644);
+  if (fd < 0)
+    throw FileImageWriteFailed(ERS_HERE, m_inprogress_file_name, std::strerror(errno));
+
+  size_t written_size = 0;
+  while (written_size < write_size) {
+    ssize_t result = ::write(fd, image_buffer.get() + written_size, write_size - written_size);
+    if (result < 0 && errno == EINTR)
+      continue;
+    if (result <= 0) {
+      std::string message = std::strerror(errno);
+      ::close(fd);
+      throw FileImageWriteFailed(ERS_HERE, m_inprogress_file_name, message);
+    }
+    written_size += result;
+  }
+  if ((write_size != static_cast<size_t>(image_size) && ftruncate(fd, image_size) != 0) || ::close(fd) != 0)
+    throw FileImageWriteFailed(ERS_HERE, m_inprogress_file_name, std::strerror(errno));
+
+  m_write_statistics.add_file_image(image_size);
+  TLOG_DEBUG(TLVL_FILE_SIZE) << "Wrote the " << image_size << " byte image of " << m_inprogress_file_name;
+}
+
+/**
+ * @brief make sure that the file space that a record will be written to is allocated, in whole extents
+ * past the write cursor. The extents are allocated without changing the size of the file, which HDF5 checks.
+ */
+void
+HDF5RawDataFile::preallocate_if_needed(size_t record_size_bytes)
+{
+  if (m_preallocation_fd < 0)
+    return;
+
+  hsize_t file_size = 0;
+  if (H5Fget_filesize(m_file_ptr->getId(), &file_size) < 0)
+    return;
+  size_t record_end = file_size + record_size_bytes;
+  if (record_end <= m_preallocated_end)
+    return;
+
+  size_t preallocation_start = std::max(static_cast<size_t>(file_size), m_preallocated_end);
+  size_t preallocation_end = (record_end / m_preallocation_extent_bytes + 1) * m_preallocation_extent_bytes;
+  {
+    ScopedWritePhaseTimer timer(m_write_statistics, WritePhase::kPreallocation);
+    if (fallocate(m_preallocation_fd,
+                  FALLOC_FL_KEEP_SIZE,
+                  preallocation_start,
+                  preallocation_end - preallocation_start) != 0) {
+      ers::warning(PreallocationFailed(ERS_HERE, m_file_ptr->getName(), std::strerror(errno)));
+      m_preallocation_fd = -1;
+      return;
+    }
+  }
+  TLOG_DEBUG(TLVL_FILE_SIZE) << "Preallocated bytes " << preallocation_start << " to " << preallocation_end << " of "
+                             << m_bare_file_name;
+  m_write_statistics.add_preallocation(preallocation_end - preallocation_start);
+  m_preallocated_end = preallocation_end;
+}
+
+/**
+ * @brief give back the space that was preallocated past the end of the closed file. Truncating the file to its
+ * own size frees the blocks beyond it, which a punched hole past the end of the file does not do on all file systems.
+ */
+void
+HDF5RawDataFile::release_unused_preallocation()
+{
+  if (m_preallocated_end == 0)
+    return;
+
+  int fd = ::open(m_bare_file_name.c_str(), O_WRONLY);
+  if (fd < 0)
+    return;
+  struct stat file_stat;
+  if (fstat(fd, &file_stat) == 0 && static_cast<size_t>(file_stat.st_size) < m_preallocated_end &&
+      ftruncate(fd, file_stat.st_size) != 0)
+    TLOG_DEBUG(TLVL_FILE_SIZE) << "Could not release the preallocated space of " << m_bare_file_name << ": "
+                               << std::strerror(errno);
+  ::close(fd);
+  m_preallocated_end = 0;
+}
+
+/**
+ * @brief admission control: delay or reject a record that would take the free space on the file system below
+ * the reserve. The file system is only queried when the record may not fit according to the last query and
+ * what has been written since, or when the last query is old, since other files may share the file system.
+ */
+void
+HDF5RawDataFile::check_free_space(const record_id_t& rid, size_t record_size_bytes)
+{
+  if (m_free_space_reserve_bytes == 0)
+    return;
+
+  const size_t needed_bytes = m_free_space_reserve_bytes + record_size_bytes;
+  auto wait_start_time = std::chrono::steady_clock::now();
+  size_t written_since_check = m_recorded_size.load() - m_recorded_size_at_free_space_check;
+  if (m_last_free_space_bytes >= needed_bytes + written_since_check &&
+      wait_start_time - m_last_free_space_check_time < FREE_SPACE_CHECK_INTERVAL)
+    return;
+
+  bool waited = false;
+  while (true) {
+    m_last_free_space_bytes = get_free_disk_space();
+    m_recorded_size_at_free_space_check = m_recorded_size.load();
+    m_last_free_space_check_time = std::chrono::steady_clock::now();
+    m_write_statistics.set_free_disk_space(m_last_free_space_bytes);
+    if (m_last_free_space_bytes >= needed_bytes) {
+      if (waited)
+        m_write_statistics.add_delayed_record(m_last_free_space_check_time - wait_start_time);
+      return;
+    }
+
+    DiskSpaceStatus status;
+    status.file_name = m_bare_file_name;
+    status.free_bytes = m_last_free_space_bytes;
+    status.reserve_bytes = m_free_space_reserve_bytes;
+    status.record_bytes = record_size_bytes;
+    status.wait_time = m_last_free_space_check_time - wait_start_time;
+    bool keep_waiting =
+      m_low_disk_space_callback ? m_low_disk_space_callback(status) : (m_free_space_policy == FreeSpacePolicy::kWait);
+    if (!keep_waiting || status.wait_time >= m_free_space_wait_timeout) {
+      m_write_statistics.add_rejected_record();
+      throw InsufficientDiskSpace(
+        ERS_HERE, rid.first, rid.second, m_bare_file_name, status.free_bytes, record_size_bytes, status.reserve_bytes);
+    }
+
+    if (!waited) {
+      TLOG_DEBUG(TLVL_BASIC) << "Record " << rid.first << "." << rid.second
+                             << " waits for free space on the file system of " << m_bare_file_name << ": "
+                             << status.free_bytes << " bytes free";
+    }
+    waited = true;
+    std::this_thread::sleep_for(FREE_SPACE_POLL_INTERVAL);
+  }
+}
+
+/**
+ * @brief write the file layout
+ */
+void
+HDF5RawDataFile::write_file_layout()
+{
+  hdf5filelayout::data_t fl_json;
+  hdf5filelayout::to_json(fl_json, m_file_layout_ptr->get_file_layout_params());
+  write_attribute("filelayout_params", fl_json.dump());
+  write_attribute("filelayout_version", m_file_layout_ptr->get_version());
+}
+
+/**
+ * @brief write the record directory into the file-level group
+ */
+void
+HDF5RawDataFile::write_record_directory()
+{
+  HighFive::Group file_level_group =
+    open_or_create_child_group(*m_file_ptr, m_file_layout_ptr->get_file_level_group_name());
+  if (file_level_group.exist(RECORD_DIRECTORY_DATASET_NAME))
+    return;
+  file_level_group.createDataSet(RECORD_DIRECTORY_DATASET_NAME, m_record_directory);
+}
+
+/**
+ * @brief have the record group refer to the record layout with its maps, storing the layout in the file-level group
+ * if it is a new one. The paths of a layout are relative to the record group. Returns false if some dataset of the
+ * record is outside of its group, in which case the maps have to be stored with the record.
+ */
+bool
+HDF5RawDataFile::store_record_layout(
+  HighFive::Group& record_group,
+  const daqdataformats::SourceID& record_header_source_id,
+  const HDF5SourceIDHandler::source_id_path_map_t& source_id_path_map,
+  const HDF5SourceIDHandler::fragment_type_source_id_map_t& fragment_type_source_id_map,
+  const HDF5SourceIDHandler::subdetector_source_id_map_t& subdetector_source_id_map,
+  HDF5SourceIDHandler& sid_handler)
+{
+  const std::string record_group_path = record_group.getPath();
+  HDF5SourceIDHandler::source_id_path_map_t relative_path_map;
+  for (auto const& [source_id, path] : source_id_path_map) {
+    if (path.compare(0, record_group_path.size(), record_group_path) != 0)
+      return false;
+    relative_path_map.emplace_hint(relative_path_map.end(), source_id, path.substr(record_group_path.size()));
+  }
+
+  std::string layout_key = HDF5SourceIDHandler::get_record_layout_key(
+    record_header_source_id, relative_path_map, fragment_type_source_id_map, subdetector_source_id_map);
+  auto layout_iter = m_record_layout_indices.find(layout_key);
+  if (layout_iter == m_record_layout_indices.end()) {
+    uint32_t layout_index = m_record_layout_indices.size(); // NOLINT(build/unsigned)
+    HighFive::Group layouts_group = open_or_create_child_group(
+      open_or_create_child_group(*m_file_ptr, m_file_layout_ptr->get_file_level_group_name()),
+      RECORD_LAYOUTS_GROUP_NAME);
+    HighFive::Group layout_group = layouts_group.createGroup(std::to_string(layout_index));
+    sid_handler.store_record_header_source_id(layout_group, record_header_source_id);
+    sid_handler.store_record_level_path_info(layout_group, relative_path_map);
+    sid_handler.store_record_level_fragment_type_map(layout_group, fragment_type_source_id_map);
+    sid_handler.store_record_level_subdetector_map(layout_group, subdetector_source_id_map);
+    layout_iter = m_record_layout_indices.emplace(std::move(layout_key), layout_index).first;
+    TLOG_DEBUG(TLVL_BASIC) << "Stored record layout " << layout_index << " with " << relative_path_map.size()
+                           << " SourceIDs in " << m_bare_file_name;
+  }
+  sid_handler.store_record_layout_index(record_group, layout_iter->second);
+  return true;
+}
+
+/**
+ * @brief read the record directory, if the file has one, and fill the list of records from it
+ */
+bool
+HDF5RawDataFile::load_record_directory()
+{
+  const std::string file_level_group_name = m_file_layout_ptr->get_file_level_group_name();
+  if (file_level_group_name.empty() || !m_file_ptr->exist(file_level_group_name))
+    return false;
+  HighFive::Group file_level_group = m_file_ptr->getGroup(file_level_group_name);
+  if (!file_level_group.exist(RECORD_DIRECTORY_DATASET_NAME))
+    return false;
+
+  // on a refresh, only the entries that were added since the previous load are read
+  HighFive::DataSet directory_dataset = file_level_group.getDataSet(RECORD_DIRECTORY_DATASET_NAME);
+  size_t first_entry = m_record_directory.size();
+  size_t directory_size = directory_dataset.getDimensions()[0];
+  std::vector<RecordDirectoryEntry> new_entries;
+  if (first_entry == 0 && directory_size > 0)
+    directory_dataset.read(new_entries);
+  else if (first_entry < directory_size)
+    directory_dataset.select({ first_entry }, { directory_size - first_entry }).read(new_entries);
+
+  for (auto const& directory_entry : new_entries) {
+    record_id_t rid = std::make_pair(directory_entry.record_number, directory_entry.sequence_number);
+    m_record_directory_index[rid] = m_record_directory.size();
+    m_all_record_ids_in_file.insert(rid);
+    m_record_directory.push_back(directory_entry);
+  }
+  m_record_directory_loaded = true;
+  return true;
+}
+
+/**
+ * @brief create the record directory dataset when the file is opened, so that records can be appended to it,
+ * and record the final name of the file for the readers that follow it
+ */
+void
+HDF5RawDataFile::setup_live_tail()
+{
+  HighFive::Group file_level_group =
+    open_or_create_child_group(*m_file_ptr, m_file_layout_ptr->get_file_level_group_name());
+  HighFive::DataSpace directory_space({ 0 }, { HighFive::DataSpace::UNLIMITED });
+  HighFive::DataSetCreateProps directory_create_props;
+  directory_create_props.add(HighFive::Chunking(std::vector<hsize_t>{ RECORD_DIRECTORY_CHUNK_ROWS }));
+  file_level_group.createDataSet<RecordDirectoryEntry>(
+    RECORD_DIRECTORY_DATASET_NAME, directory_space, directory_create_props);
+
+  write_attribute("final_file_name", std::filesystem::path(m_bare_file_name).filename().string());
+  m_live_tail = true;
+  flush_dataset();
+}
+
+void
+HDF5RawDataFile::append_to_record_directory(const RecordDirectoryEntry& directory_entry)
+{
+  ScopedWritePhaseTimer timer(m_write_statistics, WritePhase::kRecordDirectory);
+  HighFive::DataSet directory_dataset = m_file_ptr->getGroup(m_file_layout_ptr->get_file_level_group_name())
+                                          .getDataSet(RECORD_DIRECTORY_DATASET_NAME);
+  size_t directory_size = m_record_directory.size() - 1;
+  directory_dataset.resize({ directory_size + 1 });
+  directory_dataset.select({ directory_size }, { 1 }).write(std::vector<RecordDirectoryEntry>{ directory_entry });
+}
+
+/**
+ * @brief collect the subsystems whose datasets should be chunked and/or compressed
+ */
+void
+HDF5RawDataFile::fill_dataset_storage_params()
+{
+  for (auto const& [subsystem, path_params] : m_file_layout_ptr->get_path_params_map()) {
+    bool has_filter = (path_params.deflate_level > 0 || path_params.szip_pixels_per_block > 0 ||
+                       path_params.filter_id > 0 || path_params.shuffle);
+    if (!has_filter && path_params.chunk_size_bytes == 0)
+      continue;
+
+    if (path_params.filter_id > 0 && H5Zfilter_avail(static_cast<H5Z_filter_t>(path_params.filter_id)) <= 0)
+      ers::warning(HDF5FilterNotAvailable(ERS_HERE, path_params.filter_id, path_params.detector_group_name));
+
+    m_dataset_storage_params[subsystem] = path_params;
+  }
+}
+
+/**
+ * @brief build the dataset creation properties for the given storage settings. Small datasets without storage
+ * settings are compact: their data are stored in their object header, which saves the allocation (and the
+ * seek on reading) of a separate block of the file for each of them.
+ */
+HighFive::DataSetCreateProps
+HDF5RawDataFile::get_dataset_create_props(const hdf5filelayout::PathParams* storage_params,
+                                          size_t raw_data_size_bytes,
+                                          bool single_chunk) const
+{
+  HighFive::DataSetCreateProps data_set_create_props;
+  if (raw_data_size_bytes == 0)
+    return data_set_create_props;
+  if (storage_params == nullptr) {
+    if (raw_data_size_bytes <= m_file_layout_ptr->get_compact_dataset_threshold_bytes()) {
+      data_set_create_props.add(
+        RawHDF5Property("compact_layout", [](hid_t hid) { return H5Pset_layout(hid, H5D_COMPACT); }));
+    }
+    return data_set_create_props;
   }
 
-  // explicit destruction; not really needed, but nice to be clear...
-  m_file_ptr.reset();
-  m_file_layout_ptr.reset();
+  // filters need chunked storage; without an explicit chunk size (or for direct chunk writes),
+  // the whole dataset is one chunk.
+  // Chunks may not be larger than the (fixed-size) dataset.
+  size_t chunk_size = raw_data_size_bytes;
+  if (storage_params->chunk_size_bytes > 0 && !single_chunk)
+    chunk_size = std::min<size_t>(storage_params->chunk_size_bytes, raw_data_size_bytes);
+  data_set_create_props.add(HighFive::Chunking(std::vector<hsize_t>{ chunk_size, 1 }));
+  add_filter_props(*storage_params, data_set_create_props);
+  return data_set_create_props;
 }
 
 /**
- * @brief Write a TriggerRecord to the file.
+ * @brief add the filters of the given storage settings to dataset creation properties, in the order
+ * that compress_fragment() expects
  */
 void
-HDF5RawDataFile::write(const daqdataformats::TriggerRecord& tr)
+HDF5RawDataFile::add_filter_props(const hdf5filelayout::PathParams& storage_params,
+                                  HighFive::DataSetCreateProps& data_set_create_props) const
 {
-  // the source_id_path map that we will build up as we write the TR header
-  // and fragments (and then write the map into the HDF5 TR_record Group)
-  HDF5SourceIDHandler::source_id_path_map_t source_id_path_map;
-
-  // the map of fragment types to SourceIDS
-  HDF5SourceIDHandler::fragment_type_source_id_map_t fragment_type_source_id_map;
-
-  // the map of subdetectors to SourceIDS
-  HDF5SourceIDHandler::subdetector_source_id_map_t subdetector_source_id_map;
+  if (storage_params.shuffle)
+    data_set_create_props.add(HighFive::Shuffle());
 
-  // write the record header into the HDF5 file/group
-  HighFive::Group record_level_group = write(tr.get_header_ref(), source_id_path_map);
+  if (storage_params.deflate_level > 0)
+    data_set_create_props.add(HighFive::Deflate(storage_params.deflate_level));
 
-  // store the SourceID of the record header in the HDF5 file/group
-  // (since there should only be one entry in the map at this point, we'll take advantage of that...)
-  for (auto const& source_id_path : source_id_path_map) {
-    HDF5SourceIDHandler::store_record_header_source_id(record_level_group, source_id_path.first);
+  if (storage_params.szip_pixels_per_block > 0) {
+    unsigned pixels_per_block = storage_params.szip_pixels_per_block;
+    data_set_create_props.add(RawHDF5Property("szip", [pixels_per_block](hid_t hid) {
+      return H5Pset_szip(hid, H5_SZIP_NN_OPTION_MASK, pixels_per_block);
+    }));
   }
 
-  // write all of the fragments into the HDF5 file/group
-  for (auto const& frag_ptr : tr.get_fragments_ref()) {
-    write(*frag_ptr, source_id_path_map);
-    HDF5SourceIDHandler::add_fragment_type_source_id_to_map(
-      fragment_type_source_id_map, frag_ptr->get_fragment_type(), frag_ptr->get_element_id());
-    HDF5SourceIDHandler::add_subdetector_source_id_to_map(
-      subdetector_source_id_map,
-      static_cast<detdataformats::DetID::Subdetector>(frag_ptr->get_detector_id()),
-      frag_ptr->get_element_id());
+  if (storage_params.filter_id > 0) {
+    auto filter_id = static_cast<H5Z_filter_t>(storage_params.filter_id);
+    std::vector<unsigned> filter_values(storage_params.filter_values.begin(), storage_params.filter_values.end());
+    // optional, so that data are still written (unfiltered) if the filter plugin cannot be loaded
+    data_set_create_props.add(
+      RawHDF5Property("filter " + std::to_string(filter_id), [filter_id, filter_values](hid_t hid) {
+        return H5Pset_filter(hid, filter_id, H5Z_FLAG_OPTIONAL, filter_values.size(), filter_values.data());
+      }));
   }
-
-  // store all of the record-level maps in the HDF5 file/group
-  HDF5SourceIDHandler::store_record_level_path_info(record_level_group, source_id_path_map);
-  HDF5SourceIDHandler::store_record_level_fragment_type_map(record_level_group, fragment_type_source_id_map);
-  HDF5SourceIDHandler::store_record_level_subdetector_map(record_level_group, subdetector_source_id_map);
 }
 
 /**
- * @brief Write a TimeSlice to the file.
+ * @brief build the creation properties of the (extendible, hence always chunked) packed store dataset
+ * of a subsystem. The chunk size and filters come from the storage settings of the subsystem, if any.
  */
-void
-HDF5RawDataFile::write(const daqdataformats::TimeSlice& ts)
+HighFive::DataSetCreateProps
+HDF5RawDataFile::get_packed_store_create_props(daqdataformats::SourceID::Subsystem subsystem) const
 {
-  // the source_id_path map that we will build up as we write the TR header
-  // and fragments (and then write the map into the HDF5 TR_record Group)
-  HDF5SourceIDHandler::source_id_path_map_t source_id_path_map;
+  HighFive::DataSetCreateProps data_set_create_props;
+  auto storage_params_iter = m_dataset_storage_params.find(subsystem);
 
-  // the map of fragment types to SourceIDS
-  HDF5SourceIDHandler::fragment_type_source_id_map_t fragment_type_source_id_map;
+  size_t chunk_size = DEFAULT_PACKED_STORE_CHUNK_SIZE_BYTES;
+  if (storage_params_iter != m_dataset_storage_params.end() && storage_params_iter->second.chunk_size_bytes > 0)
+    chunk_size = storage_params_iter->second.chunk_size_bytes;
+  data_set_create_props.add(HighFive::Chunking(std::vector<hsize_t>{ chunk_size, 1 }));
 
-  // the map of subdetectors to SourceIDS
-  HDF5SourceIDHandler::subdetector_source_id_map_t subdetector_source_id_map;
+  if (storage_params_iter != m_dataset_storage_params.end())
+    add_filter_props(storage_params_iter->second, data_set_create_props);
+  return data_set_create_props;
+}
 
-  // write the record header into the HDF5 file/group
-  HighFive::Group record_level_group = write(ts.get_header(), source_id_path_map);
+/**
+ * @brief create a dataset in the file, at the appropriate path. Returns it with its top level (record) group.
+ * A non-zero chunk_cache_bytes replaces the default size of the chunk cache of the dataset.
+ */
+std::pair<HighFive::DataSet, HighFive::Group>
+HDF5RawDataFile::create_dataset(std::vector<std::string> const& group_and_dataset_path_elements,
+                                size_t raw_data_size_bytes,
+                                const HighFive::DataSetCreateProps& data_set_create_props,
+                                size_t chunk_cache_bytes)
+{
+  const std::string dataset_name = group_and_dataset_path_elements.back();
 
-  // store the SourceID of the record header in the HDF5 file/group
-  // (since there should only be one entry in the map at this point, we'll take advantage of that...)
-  for (auto const& source_id_path : source_id_path_map) {
-    HDF5SourceIDHandler::store_record_header_source_id(record_level_group, source_id_path.first);
-  }
+  // the top level (record) group and the group that holds the dataset normally come from the group cache,
+  // so the only metadata operation per dataset is its creation.
+  // group_and_dataset_path_elements.size()-1 because the last element is the dataset
+  HighFive::Group top_level_group = get_or_create_group(group_and_dataset_path_elements, 1);
+  HighFive::Group sub_group =
+    get_or_create_group(group_and_dataset_path_elements, group_and_dataset_path_elements.size() - 1);
 
-  // write all of the fragments into the HDF5 file/group
-  for (auto const& frag_ptr : ts.get_fragments_ref()) {
-    write(*frag_ptr, source_id_path_map);
-    HDF5SourceIDHandler::add_fragment_type_source_id_to_map(
-      fragment_type_source_id_map, frag_ptr->get_fragment_type(), frag_ptr->get_element_id());
-    HDF5SourceIDHandler::add_subdetector_source_id_to_map(
-      subdetector_source_id_map,
-      static_cast<detdataformats::DetID::Subdetector>(frag_ptr->get_detector_id()),
-      frag_ptr->get_element_id());
+  // Create dataset
+  HighFive::DataSpace data_space = HighFive::DataSpace({ raw_data_size_bytes, 1 });
+  HighFive::DataSetAccessProps data_set_access_props;
+  if (chunk_cache_bytes > 0) {
+    data_set_access_props.add(RawHDF5Property("chunk_cache", [chunk_cache_bytes](hid_t hid) {
+      return H5Pset_chunk_cache(hid, H5D_CHUNK_CACHE_NSLOTS_DEFAULT, chunk_cache_bytes, H5D_CHUNK_CACHE_W0_DEFAULT);
+    }));
   }
 
-  // store all of the record-level maps in the HDF5 file/group
-  HDF5SourceIDHandler::store_record_level_path_info(record_level_group, source_id_path_map);
-  HDF5SourceIDHandler::store_record_level_fragment_type_map(record_level_group, fragment_type_source_id_map);
-  HDF5SourceIDHandler::store_record_level_subdetector_map(record_level_group, subdetector_source_id_map);
+  auto data_set = [&]() {
+    ScopedWritePhaseTimer timer(m_write_statistics, WritePhase::kDatasetCreation);
+    return sub_group.createDataSet<char>(dataset_name, data_space, data_set_create_props, data_set_access_props);
+  }();
+  if (!data_set.isValid()) {
+    throw InvalidHDF5Dataset(ERS_HERE, dataset_name, m_file_ptr->getName());
+  }
+  return std::make_pair(data_set, top_level_group);
 }
 
 /**
- * @brief Write a TriggerRecordHeader to the file.
+ * @brief write bytes to a dataset in the file, at the appropriate path
  */
-HighFive::Group
-HDF5RawDataFile::write(const daqdataformats::TriggerRecordHeader& trh,
-                       HDF5SourceIDHandler::source_id_path_map_t& path_map)
+std::tuple<size_t, std::string, HighFive::Group>
+HDF5RawDataFile::do_write(std::vector<std::string> const& group_and_dataset_path_elements,
+                          const char* raw_data_ptr,
+                          size_t raw_data_size_bytes,
+                          const hdf5filelayout::PathParams* storage_params)
 {
-  std::tuple<size_t, std::string, HighFive::Group> write_results =
-    do_write(m_file_layout_ptr->get_path_elements(trh),
-             static_cast<const char*>(trh.get_storage_location()),
-             trh.get_total_size_bytes());
-  m_recorded_size += std::get<0>(write_results);
-  HDF5SourceIDHandler::add_source_id_path_to_map(path_map, trh.get_header().element_id, std::get<1>(write_results));
-  return std::get<2>(write_results);
+  auto [data_set, top_level_group] = create_dataset(group_and_dataset_path_elements,
+                                                    raw_data_size_bytes,
+                                                    get_dataset_create_props(storage_params, raw_data_size_bytes));
+
+  {
+    ScopedWritePhaseTimer timer(m_write_statistics, WritePhase::kRawWrite);
+    data_set.write_raw(raw_data_ptr);
+  }
+  if (m_flush_policy == FlushPolicy::kPerDataset)
+    flush_dataset();
+  return std::make_tuple(raw_data_size_bytes, data_set.getPath(), top_level_group);
 }
 
 /**
- * @brief Write a TimeSliceHeader to the file.
+ * @brief write an already-compressed fragment as the single chunk of a dataset, bypassing the filter pipeline.
+ * The dataset carries the usual filters, so that it is decompressed normally when it is read.
  */
-HighFive::Group
-HDF5RawDataFile::write(const daqdataformats::TimeSliceHeader& tsh, HDF5SourceIDHandler::source_id_path_map_t& path_map)
-{
-  std::tuple<size_t, std::string, HighFive::Group> write_results =
-    do_write(m_file_layout_ptr->get_path_elements(tsh), (const char*)(&tsh), sizeof(daqdataformats::TimeSliceHeader));
-  m_recorded_size += std::get<0>(write_results);
-  HDF5SourceIDHandler::add_source_id_path_to_map(path_map, tsh.element_id, std::get<1>(write_results));
-  return std::get<2>(write_results);
+std::tuple<size_t, std::string, HighFive::Group>
+HDF5RawDataFile::do_write_precompressed(std::vector<std::string> const& group_and_dataset_path_elements,
+                                        const PrecompressedFragment& precompressed_frag,
+                                        const hdf5filelayout::PathParams& storage_params)
+{
+  const size_t raw_data_size_bytes = precompressed_frag.header.size;
+  auto [data_set, top_level_group] =
+    create_dataset(group_and_dataset_path_elements,
+                   raw_data_size_bytes,
+                   get_dataset_create_props(&storage_params, raw_data_size_bytes, true));
+
+  if (raw_data_size_bytes > 0) {
+    ScopedWritePhaseTimer timer(m_write_statistics, WritePhase::kRawWrite);
+    hsize_t chunk_offset[2] = { 0, 0 };
+    if (H5Dwrite_chunk(data_set.getId(),
+                       H5P_DEFAULT,
+                       precompressed_frag.filter_mask,
+                       chunk_offset,
+                       precompressed_frag.data.size(),
+                       precompressed_frag.data.data()) < 0) {
+      throw InvalidHDF5Dataset(ERS_HERE, group_and_dataset_path_elements.back(), m_file_ptr->getName());
+    }
+  }
+  if (m_flush_policy == FlushPolicy::kPerDataset)
+    flush_dataset();
+  return std::make_tuple(raw_data_size_bytes, data_set.getPath(), top_level_group);
 }
 
 /**
- * @brief Write a Fragment to the file.
+ * @brief write the header and pieces of a scattered fragment at their offsets in its dataset, with one hyperslab
+ * write per piece. For chunked (compressed) datasets, the pieces are gathered in the HDF5 chunk cache, and each
+ * chunk is filtered once it is complete.
  */
-void
-HDF5RawDataFile::write(const daqdataformats::Fragment& frag, HDF5SourceIDHandler::source_id_path_map_t& path_map)
+std::tuple<size_t, std::string, HighFive::Group>
+HDF5RawDataFile::do_write_scattered(std::vector<std::string> const& group_and_dataset_path_elements,
+                                    const ScatteredFragment& scattered_frag,
+                                    const hdf5filelayout::PathParams* storage_params)
+{
+  const size_t raw_data_size_bytes = scattered_frag.header.size;
+  // the chunk cache holds the whole dataset, so that no chunk is filtered before all of its pieces are written
+  auto [data_set, top_level_group] =
+    create_dataset(group_and_dataset_path_elements,
+                   raw_data_size_bytes,
+                   get_dataset_create_props(storage_params, raw_data_size_bytes),
+                   (storage_params != nullptr) ? std::max(raw_data_size_bytes, DEFAULT_CHUNK_CACHE_BYTES) : 0);
+
+  {
+    ScopedWritePhaseTimer timer(m_write_statistics, WritePhase::kRawWrite);
+    size_t offset = 0;
+    for (auto const& [piece_ptr, piece_size] : get_fragment_pieces(scattered_frag)) {
+      if (piece_size == 0)
+        continue;
+      data_set.select({ offset, 0 }, { piece_size, 1 }).write_raw(static_cast<const char*>(piece_ptr));
+      offset += piece_size;
+    }
+  }
+  if (m_flush_policy == FlushPolicy::kPerDataset)
+    flush_dataset();
+  return std::make_tuple(raw_data_size_bytes, data_set.getPath(), top_level_group);
+}
+
+/**
+ * @brief append bytes to the packed store. Only the record group is created; the path of the (logical)
+ * dataset is returned as usual, so that the record-level SourceID maps are the same as for the other layouts.
+ */
+std::tuple<size_t, std::string, HighFive::Group>
+HDF5RawDataFile::do_write_packed(std::vector<std::string> const& group_and_dataset_path_elements,
+                                 const char* raw_data_ptr,
+                                 const PackedStoreEntry& entry)
 {
-  std::tuple<size_t, std::string, HighFive::Group> write_results =
-    do_write(m_file_layout_ptr->get_path_elements(frag.get_header()),
-             static_cast<const char*>(frag.get_storage_location()),
-             frag.get_size());
-  m_recorded_size += std::get<0>(write_results);
+  HighFive::Group top_level_group = get_or_create_group(group_and_dataset_path_elements, 1);
+  m_packed_store_ptr->append(entry, raw_data_ptr);
 
-  daqdataformats::SourceID source_id = frag.get_element_id();
-  HDF5SourceIDHandler::add_source_id_path_to_map(path_map, source_id, std::get<1>(write_results));
+  std::string dataset_path;
+  for (auto const& path_element : group_and_dataset_path_elements)
+    dataset_path += "/" + path_element;
+  return std::make_tuple(static_cast<size_t>(entry.size), dataset_path, top_level_group);
 }
 
 /**
- * @brief write the file layout
+ * @brief append bytes that are spread over several buffers to the packed store
  */
-void
-HDF5RawDataFile::write_file_layout()
+std::tuple<size_t, std::string, HighFive::Group>
+HDF5RawDataFile::do_write_packed(std::vector<std::string> const& group_and_dataset_path_elements,
+                                 const std::vector<std::pair<const void*, size_t>>& data_pieces,
+                                 const PackedStoreEntry& entry)
 {
-  hdf5filelayout::data_t fl_json;
-  hdf5filelayout::to_json(fl_json, m_file_layout_ptr->get_file_layout_params());
-  write_attribute("filelayout_params", fl_json.dump());
-  write_attribute("filelayout_version", m_file_layout_ptr->get_version());
+  HighFive::Group top_level_group = get_or_create_group(group_and_dataset_path_elements, 1);
+  m_packed_store_ptr->append(entry, data_pieces);
+
+  std::string dataset_path;
+  for (auto const& path_element : group_and_dataset_path_elements)
+    dataset_path += "/" + path_element;
+  return std::make_tuple(static_cast<size_t>(entry.size), dataset_path, top_level_group);
 }
 
 /**
- * @brief write bytes to a dataset in the file, at the appropriate path
+ * @brief get the group made of the first depth path elements, from the group cache if possible.
+ * Groups that are not in the cache are opened, or created if they do not exist yet, and added to it.
  */
-std::tuple<size_t, std::string, HighFive::Group>
-HDF5RawDataFile::do_write(std::vector<std::string> const& group_and_dataset_path_elements,
-                          const char* raw_data_ptr,
-                          size_t raw_data_size_bytes)
+HighFive::Group
+HDF5RawDataFile::get_or_create_group(std::vector<std::string> const& path_elements, size_t depth)
 {
-  const std::string dataset_name = group_and_dataset_path_elements.back();
+  // the path is built in a reused buffer, so that the lookup of a cached group does not allocate
+  m_group_path_buffer.clear();
+  for (size_t idx = 0; idx < depth; ++idx) {
+    if (path_elements[idx].empty()) {
+      throw InvalidHDF5Group(ERS_HERE, path_elements[idx]);
+    }
+    m_group_path_buffer += '/';
+    m_group_path_buffer += path_elements[idx];
+  }
+
+  auto cache_iter = m_group_cache_index.find(m_group_path_buffer);
+  if (cache_iter != m_group_cache_index.end()) {
+    // mark it as the most recently used one
+    m_group_cache.splice(m_group_cache.begin(), m_group_cache, cache_iter->second);
+    return cache_iter->second->second;
+  }
+  std::string group_path = m_group_path_buffer; // the buffer is reused by the lookup of the parent group
+
+  // the parent group is looked up before the timer starts, so that each group is only timed once
+  std::string const& group_name = path_elements[depth - 1];
+  auto timed_open_or_create_child_group = [&](auto&& parent, std::string const& child_group_name) {
+    ScopedWritePhaseTimer timer(m_write_statistics, WritePhase::kGroupCreation);
+    return open_or_create_child_group(parent, child_group_name);
+  };
+  auto open_or_create_group = [&]() {
+    if (depth > 1)
+      return timed_open_or_create_child_group(get_or_create_group(path_elements, depth - 1), group_name);
+
+    // the name of a record in a bucket starts with the name of the bucket group
+    size_t bucket_name_size = group_name.find('/');
+    if (bucket_name_size != std::string::npos)
+      return timed_open_or_create_child_group(get_or_create_bucket_group(group_name.substr(0, bucket_name_size)),
+                                              group_name.substr(bucket_name_size + 1));
+    return timed_open_or_create_child_group(*m_file_ptr, group_name);
+  };
+  HighFive::Group group = open_or_create_group();
+  if (!group.isValid()) {
+    throw InvalidHDF5Group(ERS_HERE, group_name);
+  }
 
-  // create top level group if needed
-  std::string const& top_level_group_name = group_and_dataset_path_elements.at(0);
-  if (!m_file_ptr->exist(top_level_group_name))
-    m_file_ptr->createGroup(top_level_group_name);
+  add_to_group_cache(group_path, group);
+  return group;
+}
 
-  // setup sub_group to work with
-  HighFive::Group sub_group = m_file_ptr->getGroup(top_level_group_name);
-  if (!sub_group.isValid()) {
-    throw InvalidHDF5Group(ERS_HERE, top_level_group_name);
+/**
+ * @brief get a bucket group of records, from the group cache if possible. Bucket groups are created with their links
+ * in dense (indexed) storage from the start when they hold many records, so that they are not converted from
+ * compact storage part of the way, and without creation order tracking.
+ */
+HighFive::Group
+HDF5RawDataFile::get_or_create_bucket_group(std::string const& bucket_name)
+{
+  std::string bucket_path = "/" + bucket_name;
+  auto cache_iter = m_group_cache_index.find(bucket_path);
+  if (cache_iter != m_group_cache_index.end()) {
+    m_group_cache.splice(m_group_cache.begin(), m_group_cache, cache_iter->second);
+    return cache_iter->second->second;
   }
-  HighFive::Group top_level_group = sub_group;
 
-  // Create the remaining subgroups
-  for (size_t idx = 1; idx < group_and_dataset_path_elements.size() - 1; ++idx) {
-    // group_dataset.size()-1 because the last element is the dataset
-    std::string const& child_group_name = group_and_dataset_path_elements[idx];
-    if (child_group_name.empty()) {
-      throw InvalidHDF5Group(ERS_HERE, child_group_name);
-    }
-    if (!sub_group.exist(child_group_name)) {
-      sub_group.createGroup(child_group_name);
-    }
-    HighFive::Group child_group = sub_group.getGroup(child_group_name);
-    if (!child_group.isValid()) {
-      throw InvalidHDF5Group(ERS_HERE, child_group_name);
-    }
-    sub_group = child_group;
+  unsigned max_compact = 0; // NOLINT(build/unsigned)
+  unsigned min_dense = 0;   // NOLINT(build/unsigned)
+  if (m_file_layout_ptr->get_records_per_bucket() <= MAX_COMPACT_BUCKET_LINKS) {
+    max_compact = MAX_COMPACT_BUCKET_LINKS;
+    min_dense = MIN_DENSE_BUCKET_LINKS;
+  }
+  HighFive::GroupCreateProps bucket_create_props;
+  bucket_create_props.add(RawHDF5Property("link_phase_change", [max_compact, min_dense](hid_t hid) {
+    return H5Pset_link_phase_change(hid, max_compact, min_dense);
+  }));
+  bucket_create_props.add(
+    RawHDF5Property("link_creation_order", [](hid_t hid) { return H5Pset_link_creation_order(hid, 0); }));
+
+  ScopedWritePhaseTimer timer(m_write_statistics, WritePhase::kGroupCreation);
+  HighFive::Group bucket_group = m_file_ptr->exist(bucket_name)
+                                   ? m_file_ptr->getGroup(bucket_name)
+                                   : m_file_ptr->createGroup(bucket_name, bucket_create_props);
+  if (!bucket_group.isValid()) {
+    throw InvalidHDF5Group(ERS_HERE, bucket_name);
   }
 
-  // Create dataset
-  HighFive::DataSpace data_space = HighFive::DataSpace({ raw_data_size_bytes, 1 });
-  HighFive::DataSetCreateProps data_set_create_props;
-  HighFive::DataSetAccessProps data_set_access_props;
+  add_to_group_cache(bucket_path, bucket_group);
+  return bucket_group;
+}
 
-  auto data_set = sub_group.createDataSet<char>(dataset_name, data_space, data_set_create_props, data_set_access_props);
-  if (data_set.isValid()) {
-    data_set.write_raw(raw_data_ptr);
-    m_file_ptr->flush();
-    return std::make_tuple(raw_data_size_bytes, data_set.getPath(), top_level_group);
-  } else {
-    throw InvalidHDF5Dataset(ERS_HERE, dataset_name, m_file_ptr->getName());
+/**
+ * @brief add a group to the front of the group cache, dropping the least recently used one if it is full
+ */
+void
+HDF5RawDataFile::add_to_group_cache(std::string const& group_path, HighFive::Group const& group)
+{
+  m_group_cache.emplace_front(group_path, group);
+  m_group_cache_index[group_path] = m_group_cache.begin();
+  if (m_group_cache.size() > GROUP_CACHE_CAPACITY) {
+    m_group_cache_index.erase(m_group_cache.back().first);
+    m_group_cache.pop_back();
+  }
+}
+
+/**
+ * @brief drop the groups of a record that has been written from the group cache. With evict-on-close, their
+ * metadata leave the metadata cache when the last handle to them is closed.
+ */
+void
+HDF5RawDataFile::evict_record_groups(const std::string& record_group_path)
+{
+  for (auto cache_iter = m_group_cache.begin(); cache_iter != m_group_cache.end();) {
+    auto const& group_path = cache_iter->first;
+    if (group_path.compare(0, record_group_path.size(), record_group_path) == 0 &&
+        (group_path.size() == record_group_path.size() || group_path[record_group_path.size()] == '/')) {
+      m_group_cache_index.erase(group_path);
+      cache_iter = m_group_cache.erase(cache_iter);
+    } else {
+      ++cache_iter;
+    }
   }
 }
 
+/**
+ * @brief close the cached groups
+ */
+void
+HDF5RawDataFile::clear_group_cache()
+{
+  m_group_cache_index.clear();
+  m_group_cache.clear();
+}
+
 /**
  * @brief Constructor for reading a file
  */
-HDF5RawDataFile::HDF5RawDataFile(const std::string& file_name)
-  : m_open_flags(HighFive::File::ReadOnly)
+HDF5RawDataFile::HDF5RawDataFile(const std::string& file_name, bool follow_live_file)
+  : m_bare_file_name(file_name)
+  , m_open_flags(HighFive::File::ReadOnly)
 {
   // do the file open
-  try {
-    m_file_ptr = std::make_unique<HighFive::File>(file_name, m_open_flags);
-  } catch (std::exception const& excpt) {
-    throw FileOpenFailed(ERS_HERE, file_name, excpt.what());
-  }
+  m_follow_live_file = follow_live_file;
+  m_read_file_name = file_name;
+  m_file_ptr = open_for_reading(file_name);
+  m_split_files = is_split_file(file_name);
 
   if (m_file_ptr->hasAttribute("recorded_size"))
     m_recorded_size = get_attribute<size_t>("recorded_size");
@@ -329,6 +2591,130 @@ HDF5RawDataFile::HDF5RawDataFile(const std::string& file_name)
   // because they count on the filelayout_version, which is set in read_file_layout().
   HDF5SourceIDHandler sid_handler(get_version());
   sid_handler.fetch_file_level_geo_id_info(*m_file_ptr, m_file_level_source_id_geo_id_map);
+
+  if (m_file_layout_ptr->is_packed_fragment_store())
+    load_packed_store_index();
+
+  // otherwise, the records are found by listing the top-level groups when they are first needed
+  if (load_record_directory()) {
+    TLOG_DEBUG(TLVL_BASIC) << "Read the directory of " << m_record_directory.size() << " records in " << file_name;
+  }
+}
+
+std::unique_ptr<HighFive::File>
+HDF5RawDataFile::open_for_reading(const std::string& file_name) const
+{
+  // a file that is being written is locked by the writer. Older HDF5 versions need
+  // HDF5_USE_FILE_LOCKING=FALSE in the environment instead.
+  HighFive::FileAccessProps file_access_props;
+#if H5_VERSION_GE(1, 12, 1) || (H5_VERS_MAJOR == 1 && H5_VERS_MINOR == 10 && H5_VERS_RELEASE >= 7)
+  if (m_follow_live_file) {
+    file_access_props.add(
+      RawHDF5Property("file_locking", [](hid_t hid) { return H5Pset_file_locking(hid, false, true); }));
+  }
+#endif
+
+  // split files are opened by the bare file name, from which the split driver finds the metadata and raw data files
+  if (is_split_file(file_name)) {
+    file_access_props.add(RawHDF5Property("split_driver", [](hid_t hid) {
+      return H5Pset_fapl_split(hid, SPLIT_METADATA_SUFFIX, H5P_DEFAULT, SPLIT_RAW_DATA_SUFFIX, H5P_DEFAULT);
+    }));
+  }
+
+  try {
+    return std::make_unique<HighFive::File>(file_name, HighFive::File::ReadOnly, file_access_props);
+  } catch (std::exception const& excpt) {
+    throw FileOpenFailed(ERS_HERE, file_name, excpt.what());
+  }
+}
+
+/**
+ * @brief Pick up the records that the writer added since the last refresh. The file is reopened, to see it as of
+ * the last flush of the writer, and only the new entries of the record directory and packed store index are read.
+ * Throws FileOpenFailed if the file cannot be opened again, under its name or its final name.
+ */
+size_t
+HDF5RawDataFile::refresh()
+{
+  if (!m_follow_live_file)
+    return 0;
+
+  // the writer renames the file when it closes it
+  std::string final_file_name;
+  if (m_file_ptr->hasAttribute("final_file_name")) {
+    final_file_name = (std::filesystem::path(m_read_file_name).parent_path() /
+                       get_attribute<std::string>("final_file_name"))
+                        .string();
+  }
+
+  // everything that refers to the file is closed first, since HDF5 would otherwise reuse the open file,
+  // and not read the metadata again
+  m_packed_store_ptr.reset();
+  m_file_ptr.reset();
+  try {
+    m_file_ptr = open_for_reading(m_read_file_name);
+  } catch (FileOpenFailed const&) {
+    if (final_file_name.empty() || final_file_name == m_read_file_name)
+      throw;
+    m_file_ptr = open_for_reading(final_file_name);
+    m_read_file_name = final_file_name;
+  }
+  const std::string& file_name = m_read_file_name;
+
+  size_t previous_record_count = m_record_directory.size();
+  try {
+    // the packed store index goes first, so that the records in the directory have all of their entries
+    if (m_file_layout_ptr->is_packed_fragment_store())
+      load_packed_store_index();
+    load_record_directory();
+    if (m_file_ptr->hasAttribute("recorded_size"))
+      m_recorded_size = get_attribute<size_t>("recorded_size");
+  } catch (std::exception const& excpt) {
+    // the writer may be in the middle of a flush; the records will be picked up by the next refresh
+    TLOG_DEBUG(TLVL_BASIC) << "Incomplete refresh of " << file_name << ": " << excpt.what();
+  }
+
+  size_t new_record_count = m_record_directory.size() - previous_record_count;
+  TLOG_DEBUG(TLVL_BASIC) << "Found " << new_record_count << " new records in " << file_name;
+  return new_record_count;
+}
+
+/**
+ * @brief read the index of the packed store, and key its entries by the paths that the datasets
+ * would have in the other layouts (which are also the paths in the record-level SourceID maps)
+ */
+void
+HDF5RawDataFile::load_packed_store_index()
+{
+  const std::string file_level_group_name = m_file_layout_ptr->get_file_level_group_name();
+  if (!m_file_ptr->exist(file_level_group_name))
+    throw InvalidHDF5Group(ERS_HERE, file_level_group_name);
+  m_packed_store_ptr = std::make_unique<HDF5PackedFragmentStore>(m_file_ptr->getGroup(file_level_group_name));
+
+  // on a refresh, only the entries that were added since the previous load are read
+  auto new_entries = m_packed_store_ptr->read_index(m_packed_store_index_size);
+  m_packed_store_index_size += new_entries.size();
+  for (auto const& entry : new_entries) {
+    daqdataformats::SourceID source_id(static_cast<daqdataformats::SourceID::Subsystem>(entry.subsystem),
+                                       entry.source_id);
+    std::vector<std::string> path_elements;
+    if (entry.is_record_header) {
+      path_elements =
+        m_file_layout_ptr->get_record_header_path_elements(entry.record_number, entry.sequence_number, source_id);
+    } else {
+      daqdataformats::FragmentHeader frag_header;
+      frag_header.trigger_number = entry.record_number;
+      frag_header.sequence_number = entry.sequence_number;
+      frag_header.element_id = source_id;
+      frag_header.fragment_type = entry.fragment_type;
+      path_elements = m_file_layout_ptr->get_path_elements(frag_header);
+    }
+
+    std::string dataset_path;
+    for (auto const& path_element : path_elements)
+      dataset_path += "/" + path_element;
+    m_packed_store_entries[dataset_path] = entry;
+  }
 }
 
 void
@@ -392,6 +2778,9 @@ HDF5RawDataFile::explore_subgroup(const HighFive::Group& parent_group,
     if (child_type == HighFive::ObjectType::Dataset) {
       path_list.push_back(full_path);
     } else if (child_type == HighFive::ObjectType::Group) {
+      // the file-level group holds the record directory and other bookkeeping, not record datasets
+      if (full_path == "/" + m_file_layout_ptr->get_file_level_group_name())
+        continue;
       HighFive::Group child_group = parent_group.getGroup(child_name);
       // start the recusion
       std::string new_path = relative_path + "/" + child_name;
@@ -403,11 +2792,7 @@ HDF5RawDataFile::explore_subgroup(const HighFive::Group& parent_group,
 void
 HDF5RawDataFile::add_record_level_info_to_caches_if_needed(record_id_t rid)
 {
-  // we should probably check that all relevant caches have an entry for the
-  // specified record ID, but we will just check one, in the interest of
-  // performance, and trust the "else" part of this routine to fill in *all*
-  // of the appropriate caches
-  if (m_source_id_path_cache.count(rid) != 0) {
+  if (m_record_level_info_cache.count(rid) != 0) {
     return;
   }
 
@@ -421,48 +2806,81 @@ HDF5RawDataFile::add_record_level_info_to_caches_if_needed(record_id_t rid)
     throw InvalidHDF5Group(ERS_HERE, record_level_group_name);
   }
 
-  // start with a copy of the file-level source-id-to-geo-id map and give the
-  // handler an opportunity to add any record-level additions
-  HDF5SourceIDHandler::source_id_geo_id_map_t local_source_id_geo_id_map = m_file_level_source_id_geo_id_map;
-  sid_handler.fetch_record_level_geo_id_info(record_group, local_source_id_geo_id_map);
+  // records that refer to a record layout share its maps, which are only read for the first of them
+  RecordLevelInfo record_info;
+  uint32_t layout_index = 0; // NOLINT(build/unsigned)
+  if (sid_handler.fetch_record_layout_index(record_group, layout_index)) {
+    auto layout_iter = m_record_layout_cache.find(layout_index);
+    if (layout_iter == m_record_layout_cache.end()) {
+      std::string layout_group_name = m_file_layout_ptr->get_file_level_group_name() + "/" +
+                                      RECORD_LAYOUTS_GROUP_NAME + "/" + std::to_string(layout_index);
+      HighFive::Group layout_group = m_file_ptr->getGroup(layout_group_name);
+      if (!layout_group.isValid()) {
+        throw InvalidHDF5Group(ERS_HERE, layout_group_name);
+      }
+      layout_iter = m_record_layout_cache.emplace(layout_index, read_record_layout(layout_group, sid_handler)).first;
+    }
+    record_info.layout_ptr = layout_iter->second;
+    record_info.path_prefix = record_group.getPath();
+  } else {
+    record_info.layout_ptr = read_record_layout(record_group, sid_handler);
+  }
 
-  // fetch the record-level source-id-to-path map
-  HDF5SourceIDHandler::source_id_path_map_t source_id_path_map;
-  sid_handler.fetch_source_id_path_info(record_group, source_id_path_map);
+  // note that even if the "fetch" methods fail to add anything to the maps, the maps will still
+  // be valid (though, possibly empty), and lookups in them will not fail
+  m_record_level_info_cache[rid] = std::move(record_info);
+}
 
-  // fetch the record-level fragment-type-to-source-id map
-  HDF5SourceIDHandler::fragment_type_source_id_map_t fragment_type_source_id_map;
-  sid_handler.fetch_fragment_type_source_id_info(record_group, fragment_type_source_id_map);
+/**
+ * @brief read the record-level maps that are stored in a record group or in a record layout group
+ */
+std::shared_ptr<const HDF5RawDataFile::RecordLayoutInfo>
+HDF5RawDataFile::read_record_layout(const HighFive::Group& group, HDF5SourceIDHandler& sid_handler) const
+{
+  auto layout_ptr = std::make_shared<RecordLayoutInfo>();
 
-  // fetch the record-level subdetector-to-source-id map
-  HDF5SourceIDHandler::subdetector_source_id_map_t subdetector_source_id_map;
-  sid_handler.fetch_subdetector_source_id_info(record_group, subdetector_source_id_map);
+  // start with a copy of the file-level source-id-to-geo-id map and give the
+  // handler an opportunity to add any record-level additions
+  layout_ptr->source_id_geo_id_map = m_file_level_source_id_geo_id_map;
+  sid_handler.fetch_record_level_geo_id_info(group, layout_ptr->source_id_geo_id_map);
+
+  // fetch the record-level source-id-to-path, fragment-type-to-source-id and subdetector-to-source-id maps
+  sid_handler.fetch_source_id_path_info(group, layout_ptr->source_id_path_map);
+  sid_handler.fetch_fragment_type_source_id_info(group, layout_ptr->fragment_type_source_id_map);
+  sid_handler.fetch_subdetector_source_id_info(group, layout_ptr->subdetector_source_id_map);
 
   // loop through the source-id-to-path map to create various lists of SourceIDs in the record
-  daqdataformats::SourceID rh_sid = sid_handler.fetch_record_header_source_id(record_group);
-  std::set<daqdataformats::SourceID> full_source_id_set;
-  std::set<daqdataformats::SourceID> fragment_source_id_set;
-  HDF5SourceIDHandler::subsystem_source_id_map_t subsystem_source_id_map;
-  for (auto const& source_id_path : source_id_path_map) {
-    full_source_id_set.insert(source_id_path.first);
-    if (source_id_path.first != rh_sid) {
-      fragment_source_id_set.insert(source_id_path.first);
+  layout_ptr->record_header_source_id = sid_handler.fetch_record_header_source_id(group);
+  for (auto const& source_id_path : layout_ptr->source_id_path_map) {
+    layout_ptr->source_ids.insert(source_id_path.first);
+    if (source_id_path.first != layout_ptr->record_header_source_id) {
+      layout_ptr->fragment_source_ids.insert(source_id_path.first);
     }
     HDF5SourceIDHandler::add_subsystem_source_id_to_map(
-      subsystem_source_id_map, source_id_path.first.subsystem, source_id_path.first);
+      layout_ptr->subsystem_source_id_map, source_id_path.first.subsystem, source_id_path.first);
   }
+  return layout_ptr;
+}
 
-  // note that even if the "fetch" methods above fail to add anything to the specified
-  // maps, the maps will still be valid (though, possibly empty), and once we add them
-  // to the caches here, we will be assured that lookups from the caches will not fail.
-  m_source_id_cache[rid] = full_source_id_set;
-  m_record_header_source_id_cache[rid] = rh_sid;
-  m_fragment_source_id_cache[rid] = fragment_source_id_set;
-  m_source_id_geo_id_cache[rid] = local_source_id_geo_id_map;
-  m_source_id_path_cache[rid] = source_id_path_map;
-  m_subsystem_source_id_cache[rid] = subsystem_source_id_map;
-  m_fragment_type_source_id_cache[rid] = fragment_type_source_id_map;
-  m_subdetector_source_id_cache[rid] = subdetector_source_id_map;
+const HDF5RawDataFile::RecordLayoutInfo&
+HDF5RawDataFile::get_record_layout(const record_id_t& rid)
+{
+  add_record_level_info_to_caches_if_needed(rid);
+  return *m_record_level_info_cache[rid].layout_ptr;
+}
+
+/**
+ * @brief the dataset path of a SourceID in a record, or an empty string if the record does not have it
+ */
+std::string
+HDF5RawDataFile::get_source_id_path(const record_id_t& rid, const daqdataformats::SourceID& source_id)
+{
+  add_record_level_info_to_caches_if_needed(rid);
+  auto const& record_info = m_record_level_info_cache[rid];
+  auto path_iter = record_info.layout_ptr->source_id_path_map.find(source_id);
+  if (path_iter == record_info.layout_ptr->source_id_path_map.end())
+    return std::string();
+  return record_info.path_prefix + path_iter->second;
 }
 
 /**
@@ -477,6 +2895,20 @@ HDF5RawDataFile::get_dataset_paths(std::string top_level_group_name)
   // Vector containing the path list to the HDF5 datasets
   std::vector<std::string> path_list;
 
+  // in the packed layout, the datasets are the entries of the packed store index
+  if (m_packed_store_ptr && m_open_flags == HighFive::File::ReadOnly) {
+    std::string group_prefix = top_level_group_name;
+    if (group_prefix.empty() || group_prefix.back() != '/')
+      group_prefix += "/";
+    if (group_prefix.front() != '/')
+      group_prefix.insert(0, "/");
+    for (auto const& packed_store_entry : m_packed_store_entries) {
+      if (packed_store_entry.first.compare(0, group_prefix.size(), group_prefix) == 0)
+        path_list.push_back(packed_store_entry.first);
+    }
+    return path_list;
+  }
+
   HighFive::Group parent_group = m_file_ptr->getGroup(top_level_group_name);
   if (!parent_group.isValid())
     throw InvalidHDF5Group(ERS_HERE, top_level_group_name);
@@ -492,22 +2924,24 @@ HDF5RawDataFile::get_dataset_paths(std::string top_level_group_name)
 HDF5RawDataFile::record_id_set // NOLINT(build/unsigned)
 HDF5RawDataFile::get_all_record_ids()
 {
-  if (!m_all_record_ids_in_file.empty())
+  if (!m_all_record_ids_in_file.empty() || m_record_directory_loaded)
     return m_all_record_ids_in_file;
 
-  // records are at the top level
+  // records are at the top level, or in the bucket groups at the top level
 
   HighFive::Group parent_group = m_file_ptr->getGroup(m_file_ptr->getPath());
 
   std::vector<std::string> childNames = parent_group.listObjectNames();
   const std::string record_prefix = m_file_layout_ptr->get_record_name_prefix();
   const size_t record_prefix_size = record_prefix.size();
+  const std::string bucket_prefix = m_file_layout_ptr->get_bucket_name_prefix();
+  const bool has_buckets = m_file_layout_ptr->get_records_per_bucket() > 0;
 
-  for (auto const& name : childNames) {
+  auto add_record_id = [&](std::string const& name) {
     auto loc = name.find(record_prefix);
 
     if (loc == std::string::npos)
-      continue;
+      return;
 
     auto rec_num_string = name.substr(loc + record_prefix_size);
 
@@ -519,7 +2953,15 @@ HDF5RawDataFile::get_all_record_ids()
       rec_num_string.resize(loc); // remove anything from '.' onwards
       m_all_record_ids_in_file.insert(std::make_pair(std::stoll(rec_num_string), std::stoi(seq_num_string)));
     }
+  };
 
+  for (auto const& name : childNames) {
+    if (has_buckets && name.compare(0, bucket_prefix.size(), bucket_prefix) == 0) {
+      for (auto const& record_name : parent_group.getGroup(name).listObjectNames())
+        add_record_id(record_name);
+    } else {
+      add_record_id(name);
+    }
   } // end loop over childNames
 
   return m_all_record_ids_in_file;
@@ -615,12 +3057,24 @@ HDF5RawDataFile::get_record_header_dataset_path(const record_id_t& rid)
   if (rec_id == get_all_record_ids().end())
     throw RecordIDNotFound(ERS_HERE, rid.first, rid.second);
 
-  if (get_version() <= 2) {
+  if (get_version() <= 2)
     return (m_file_ptr->getPath() + m_file_layout_ptr->get_record_header_path(rid.first, rid.second));
-  } else {
-    daqdataformats::SourceID source_id = get_record_header_source_id(rid);
-    return m_source_id_path_cache[rid][source_id];
+
+  // with a record directory, there is no need to read the SourceID maps of the record
+  auto directory_iter = m_record_directory_index.find(rid);
+  if (directory_iter != m_record_directory_index.end()) {
+    auto const& directory_entry = m_record_directory[directory_iter->second];
+    daqdataformats::SourceID source_id(
+      static_cast<daqdataformats::SourceID::Subsystem>(directory_entry.header_source_subsys),
+      directory_entry.header_source_id);
+    std::string dataset_path;
+    for (auto const& path_element :
+         m_file_layout_ptr->get_record_header_path_elements(rid.first, rid.second, source_id))
+      dataset_path += "/" + path_element;
+    return dataset_path;
   }
+
+  return get_source_id_path(rid, get_record_layout(rid).record_header_source_id);
 }
 
 std::string
@@ -698,7 +3152,7 @@ HDF5RawDataFile::get_fragment_dataset_paths(const record_id_t& rid)
   } else {
     std::set<daqdataformats::SourceID> source_id_list = get_fragment_source_ids(rid);
     for (auto const& source_id : source_id_list) {
-      frag_paths.push_back(m_source_id_path_cache[rid][source_id]);
+      frag_paths.push_back(get_source_id_path(rid, source_id));
     }
   }
   return frag_paths;
@@ -725,7 +3179,7 @@ HDF5RawDataFile::get_fragment_dataset_paths(const daqdataformats::SourceID::Subs
     } else {
       std::set<daqdataformats::SourceID> source_id_list = get_source_ids_for_subsystem(rid, subsystem);
       for (auto const& source_id : source_id_list) {
-        frag_paths.push_back(m_source_id_path_cache[rid][source_id]);
+        frag_paths.push_back(get_source_id_path(rid, source_id));
       }
     }
   }
@@ -753,7 +3207,7 @@ HDF5RawDataFile::get_fragment_dataset_paths(const record_id_t& rid, const daqdat
     std::vector<std::string> frag_paths;
     std::set<daqdataformats::SourceID> source_id_list = get_source_ids_for_subsystem(rid, subsystem);
     for (auto const& source_id : source_id_list) {
-      frag_paths.push_back(m_source_id_path_cache[rid][source_id]);
+      frag_paths.push_back(get_source_id_path(rid, source_id));
     }
     return frag_paths;
   }
@@ -844,10 +3298,8 @@ HDF5RawDataFile::get_geo_ids(const record_id_t& rid)
   if (rec_id == get_all_record_ids().end())
     throw RecordIDNotFound(ERS_HERE, rid.first, rid.second);
 
-  add_record_level_info_to_caches_if_needed(rid);
-
   std::set<uint64_t> set_of_geo_ids;
-  for (auto const& map_entry : m_source_id_geo_id_cache[rid]) {
+  for (auto const& map_entry : get_record_layout(rid).source_id_geo_id_map) {
     for (auto const& geo_id : map_entry.second) {
       set_of_geo_ids.insert(geo_id);
     }
@@ -863,10 +3315,8 @@ HDF5RawDataFile::get_geo_ids_for_subdetector(const record_id_t& rid,
   if (rec_id == get_all_record_ids().end())
     throw RecordIDNotFound(ERS_HERE, rid.first, rid.second);
 
-  add_record_level_info_to_caches_if_needed(rid);
-
   std::set<uint64_t> set_of_geo_ids;
-  for (auto const& map_entry : m_source_id_geo_id_cache[rid]) {
+  for (auto const& map_entry : get_record_layout(rid).source_id_geo_id_map) {
     for (auto const& geo_id : map_entry.second) {
       // FIXME: replace with a proper coder/decoder
 
@@ -888,9 +3338,7 @@ HDF5RawDataFile::get_source_ids(const record_id_t& rid)
   if (rec_id == get_all_record_ids().end())
     throw RecordIDNotFound(ERS_HERE, rid.first, rid.second);
 
-  add_record_level_info_to_caches_if_needed(rid);
-
-  return m_source_id_cache[rid];
+  return get_record_layout(rid).source_ids;
 }
 
 daqdataformats::SourceID
@@ -900,9 +3348,7 @@ HDF5RawDataFile::get_record_header_source_id(const record_id_t& rid)
   if (rec_id == get_all_record_ids().end())
     throw RecordIDNotFound(ERS_HERE, rid.first, rid.second);
 
-  add_record_level_info_to_caches_if_needed(rid);
-
-  return m_record_header_source_id_cache[rid];
+  return get_record_layout(rid).record_header_source_id;
 }
 
 std::set<daqdataformats::SourceID>
@@ -912,9 +3358,7 @@ HDF5RawDataFile::get_fragment_source_ids(const record_id_t& rid)
   if (rec_id == get_all_record_ids().end())
     throw RecordIDNotFound(ERS_HERE, rid.first, rid.second);
 
-  add_record_level_info_to_caches_if_needed(rid);
-
-  return m_fragment_source_id_cache[rid];
+  return get_record_layout(rid).fragment_source_ids;
 }
 
 std::set<daqdataformats::SourceID>
@@ -925,9 +3369,7 @@ HDF5RawDataFile::get_source_ids_for_subsystem(const record_id_t& rid,
   if (rec_id == get_all_record_ids().end())
     throw RecordIDNotFound(ERS_HERE, rid.first, rid.second);
 
-  add_record_level_info_to_caches_if_needed(rid);
-
-  return m_subsystem_source_id_cache[rid][subsystem];
+  return get_map_value(get_record_layout(rid).subsystem_source_id_map, subsystem);
 }
 
 std::set<daqdataformats::SourceID>
@@ -937,9 +3379,7 @@ HDF5RawDataFile::get_source_ids_for_fragment_type(const record_id_t& rid, const
   if (rec_id == get_all_record_ids().end())
     throw RecordIDNotFound(ERS_HERE, rid.first, rid.second);
 
-  add_record_level_info_to_caches_if_needed(rid);
-
-  return m_fragment_type_source_id_cache[rid][frag_type];
+  return get_map_value(get_record_layout(rid).fragment_type_source_id_map, frag_type);
 }
 
 std::set<daqdataformats::SourceID>
@@ -949,14 +3389,19 @@ HDF5RawDataFile::get_source_ids_for_subdetector(const record_id_t& rid, const de
   if (rec_id == get_all_record_ids().end())
     throw RecordIDNotFound(ERS_HERE, rid.first, rid.second);
 
-  add_record_level_info_to_caches_if_needed(rid);
-
-  return m_subdetector_source_id_cache[rid][subdet];
+  return get_map_value(get_record_layout(rid).subdetector_source_id_map, subdet);
 }
 
 std::unique_ptr<char[]>
 HDF5RawDataFile::get_dataset_raw_data(const std::string& dataset_path)
 {
+  if (m_packed_store_ptr && m_open_flags == HighFive::File::ReadOnly) {
+    auto entry_iter = m_packed_store_entries.find(
+      (!dataset_path.empty() && dataset_path.front() == '/') ? dataset_path : "/" + dataset_path);
+    if (entry_iter == m_packed_store_entries.end())
+      throw InvalidHDF5Dataset(ERS_HERE, dataset_path, get_file_name());
+    return m_packed_store_ptr->read(entry_iter->second);
+  }
 
   HighFive::Group parent_group = m_file_ptr->getGroup("/");
   HighFive::DataSet data_set = parent_group.getDataSet(dataset_path);
@@ -964,7 +3409,8 @@ HDF5RawDataFile::get_dataset_raw_data(const std::string& dataset_path)
   if (!data_set.isValid())
     throw InvalidHDF5Dataset(ERS_HERE, dataset_path, get_file_name());
 
-  size_t data_size = data_set.getStorageSize();
+  // use the logical size rather than the storage size, which differs for compressed datasets
+  size_t data_size = data_set.getSpace().getElementCount();
 
   auto membuffer = std::make_unique<char[]>(data_size);
   data_set.read(membuffer.get());
@@ -990,9 +3436,7 @@ HDF5RawDataFile::get_frag_ptr(const record_id_t& rid, const daqdataformats::Sour
   if (rec_id == get_all_record_ids().end())
     throw RecordIDNotFound(ERS_HERE, rid.first, rid.second);
 
-  add_record_level_info_to_caches_if_needed(rid);
-
-  return get_frag_ptr(m_source_id_path_cache[rid][source_id]);
+  return get_frag_ptr(get_source_id_path(rid, source_id));
 }
 
 std::unique_ptr<daqdataformats::Fragment>
@@ -1079,10 +3523,7 @@ HDF5RawDataFile::get_trh_ptr(const record_id_t& rid)
   if (rec_id == get_all_record_ids().end())
     throw RecordIDNotFound(ERS_HERE, rid.first, rid.second);
 
-  add_record_level_info_to_caches_if_needed(rid);
-
-  daqdataformats::SourceID rh_source_id = m_record_header_source_id_cache[rid];
-  return get_trh_ptr(m_source_id_path_cache[rid][rh_source_id]);
+  return get_trh_ptr(get_source_id_path(rid, get_record_layout(rid).record_header_source_id));
 }
 
 std::unique_ptr<daqdataformats::TimeSliceHeader>
@@ -1104,10 +3545,7 @@ HDF5RawDataFile::get_tsh_ptr(const record_id_t& rid)
   if (rec_id == get_all_record_ids().end())
     throw RecordIDNotFound(ERS_HERE, rid.first, rid.second);
 
-  add_record_level_info_to_caches_if_needed(rid);
-
-  daqdataformats::SourceID rh_source_id = m_record_header_source_id_cache[rid];
-  return get_tsh_ptr(m_source_id_path_cache[rid][rh_source_id]);
+  return get_tsh_ptr(get_source_id_path(rid, get_record_layout(rid).record_header_source_id));
 }
 
 daqdataformats::TriggerRecord
@@ -1139,9 +3577,7 @@ HDF5RawDataFile::get_geo_ids_for_source_id(const record_id_t& rid, const daqdata
   if (rec_id == get_all_record_ids().end())
     throw RecordIDNotFound(ERS_HERE, rid.first, rid.second);
 
-  add_record_level_info_to_caches_if_needed(rid);
-
-  return m_source_id_geo_id_cache[rid][source_id];
+  return get_map_value(get_record_layout(rid).source_id_geo_id_map, source_id);
 }
 
 daqdataformats::SourceID
@@ -1152,11 +3588,9 @@ HDF5RawDataFile::get_source_id_for_geo_id(const record_id_t& rid,
   if (rec_id == get_all_record_ids().end())
     throw RecordIDNotFound(ERS_HERE, rid.first, rid.second);
 
-  add_record_level_info_to_caches_if_needed(rid);
-
   // if we want to make this faster, we could build a reverse lookup cache in
   // add_record_level_info_to_caches_if_needed() and just look up the requested geo_id here
-  for (auto const& map_entry : m_source_id_geo_id_cache[rid]) {
+  for (auto const& map_entry : get_record_layout(rid).source_id_geo_id_map) {
     auto geoid_list = map_entry.second;
     for (auto const& geoid_from_list : geoid_list) {
       if (geoid_from_list == requested_geo_id) {
@@ -0,0 +1,241 @@
+/**
+ * This is part of the DUNE DAQ Application Framework, copyright 2020.
+ * Licensing/copyright details are in the COPYING file that you should have
+ * received with this code.
+ *
+ */
+
+#include "hdf5libs/HDF5RawDataFileSequence.hpp"
+
+#include "logging/Logging.hpp"
+
+#include <filesystem>
+#include <memory>
+#include <string>
+#include <utility>
+
+namespace dunedaq {
+namespace hdf5libs {
+
+namespace {
+
+size_t
+get_record_size(const daqdataformats::TriggerRecord& tr)
+{
+  size_t record_size_bytes = tr.get_header_ref().get_total_size_bytes();
+  for (auto const& frag_ptr : tr.get_fragments_ref())
+    record_size_bytes += frag_ptr->get_size();
+  return record_size_bytes;
+}
+
+size_t
+get_record_size(const daqdataformats::TimeSlice& ts)
+{
+  size_t record_size_bytes = sizeof(daqdataformats::TimeSliceHeader);
+  for (auto const& frag_ptr : ts.get_fragments_ref())
+    record_size_bytes += frag_ptr->get_size();
+  return record_size_bytes;
+}
+
+} // namespace
+
+HDF5RawDataFileSequence::HDF5RawDataFileSequence(file_name_function_t file_name_function,
+                                                 daqdataformats::run_number_t run_number,
+                                                 size_t first_file_index,
+                                                 std::string application_name,
+                                                 const hdf5filelayout::FileLayoutParams& fl_params,
+                                                 hdf5rawdatafile::SrcIDGeoIDMap srcid_geoid_map,
+                                                 const hdf5rawdatafile::FileSequenceParams& sequence_params,
+                                                 const hdf5rawdatafile::WriterParams& writer_params,
+                                                 std::string inprogress_filename_suffix)
+  : m_file_name_function(std::move(file_name_function))
+  , m_run_number(run_number)
+  , m_application_name(std::move(application_name))
+  , m_fl_params(fl_params)
+  , m_srcid_geoid_map(std::move(srcid_geoid_map))
+  , m_sequence_params(sequence_params)
+  , m_writer_params(writer_params)
+  , m_inprogress_filename_suffix(std::move(inprogress_filename_suffix))
+  , m_current_file_index(first_file_index)
+{
+  m_current_file_ptr = open_file(m_current_file_index);
+  m_current_file_start_time = std::chrono::steady_clock::now();
+  m_file_count = 1;
+
+  // the background thread makes HDF5 calls while records are being written
+  if (m_sequence_params.preopen_next_file) {
+    hbool_t library_is_threadsafe = false;
+    H5is_library_threadsafe(&library_is_threadsafe);
+    if (library_is_threadsafe) {
+      m_background_pool_ptr = std::make_unique<WorkStealingThreadPool>(1);
+      preopen_next_file();
+    } else {
+      ers::warning(HDF5LibraryNotThreadSafe(ERS_HERE, m_current_file_ptr->get_file_name()));
+    }
+  }
+}
+
+HDF5RawDataFileSequence::~HDF5RawDataFileSequence()
+{
+  close();
+}
+
+void
+HDF5RawDataFileSequence::write(const daqdataformats::TriggerRecord& tr)
+{
+  do_write(tr, tr.get_header_ref().get_trigger_number(), get_record_size(tr));
+}
+
+void
+HDF5RawDataFileSequence::write(const daqdataformats::TimeSlice& ts)
+{
+  do_write(ts, ts.get_header().timeslice_number, get_record_size(ts));
+}
+
+template<typename RecordT>
+void
+HDF5RawDataFileSequence::do_write(const RecordT& record,
+                                  uint64_t record_number, // NOLINT(build/unsigned)
+                                  size_t record_size_bytes)
+{
+  if (m_closed)
+    throw FileSequenceClosed(ERS_HERE, record_number, m_application_name);
+
+  if (roll_over_needed(record_size_bytes))
+    switch_file();
+  m_current_file_ptr->write(record);
+  ++m_records_in_current_file;
+}
+
+void
+HDF5RawDataFileSequence::roll_over()
+{
+  if (!m_closed && m_records_in_current_file > 0)
+    switch_file();
+}
+
+bool
+HDF5RawDataFileSequence::roll_over_needed(size_t record_size_bytes) const
+{
+  if (m_records_in_current_file == 0)
+    return false;
+
+  if (m_sequence_params.max_records_per_file > 0 &&
+      m_records_in_current_file >= static_cast<size_t>(m_sequence_params.max_records_per_file))
+    return true;
+  if (m_sequence_params.max_file_size_bytes > 0 &&
+      m_current_file_ptr->get_recorded_size() + record_size_bytes > m_sequence_params.max_file_size_bytes)
+    return true;
+  if (m_sequence_params.max_file_duration_ms > 0 &&
+      std::chrono::steady_clock::now() - m_current_file_start_time >=
+        std::chrono::milliseconds(m_sequence_params.max_file_duration_ms))
+    return true;
+  return false;
+}
+
+std::unique_ptr<HDF5RawDataFile>
+HDF5RawDataFileSequence::open_file(size_t file_index) const
+{
+  return std::make_unique<HDF5RawDataFile>(m_file_name_function(file_index),
+                                           m_run_number,
+                                           file_index,
+                                           m_application_name,
+                                           m_fl_params,
+                                           m_srcid_geoid_map,
+                                           m_inprogress_filename_suffix,
+                                           HighFive::File::Create,
+                                           m_writer_params);
+}
+
+/**
+ * @brief Start the creation and initialization of the file that follows the current one
+ */
+void
+HDF5RawDataFileSequence::preopen_next_file()
+{
+  size_t file_index = m_current_file_index + 1;
+  m_next_file = m_background_pool_ptr->submit([this, file_index]() { return open_file(file_index); });
+}
+
+/**
+ * @brief Make the next file the current one, and finalize the previous one. Without the background thread,
+ * or if it has not got to it yet, the next file is opened here. Failures to open it are rethrown here.
+ */
+void
+HDF5RawDataFileSequence::switch_file()
+{
+  std::unique_ptr<HDF5RawDataFile> next_file_ptr =
+    m_next_file.valid() ? m_next_file.get() : open_file(m_current_file_index + 1);
+
+  std::swap(m_current_file_ptr, next_file_ptr);
+  ++m_current_file_index;
+  m_records_in_current_file = 0;
+  m_current_file_start_time = std::chrono::steady_clock::now();
+  ++m_file_count;
+  TLOG_DEBUG(HDF5RawDataFile::TLVL_BASIC) << "Switched to file " << m_current_file_ptr->get_file_name();
+
+  finalize_file(std::move(next_file_ptr));
+  if (m_background_pool_ptr)
+    preopen_next_file();
+}
+
+/**
+ * @brief Start the closing of a file that holds all of its records, on the finalizer thread
+ */
+void
+HDF5RawDataFileSequence::finalize_file(std::unique_ptr<HDF5RawDataFile> file_ptr)
+{
+  file_ptr->close_async();
+  m_closing_files.push_back(std::move(file_ptr));
+
+  // forget about the files that are closed
+  while (!m_closing_files.empty() &&
+         m_closing_files.front()->close_async().wait_for(std::chrono::seconds(0)) == std::future_status::ready) {
+    wait_for_closing(*m_closing_files.front());
+    m_closing_files.pop_front();
+  }
+}
+
+void
+HDF5RawDataFileSequence::wait_for_closing(HDF5RawDataFile& file)
+{
+  try {
+    file.close_async().get();
+  } catch (std::exception const& excpt) {
+    ers::error(FileCloseFailed(ERS_HERE, file.get_bare_file_name(), excpt.what()));
+  }
+}
+
+void
+HDF5RawDataFileSequence::close()
+{
+  if (m_closed)
+    return;
+  m_closed = true;
+
+  // the pre-opened file holds no records, so it is removed, with all of the files that make it up
+  if (m_next_file.valid()) {
+    std::string next_file_name = m_file_name_function(m_current_file_index + 1);
+    try {
+      std::unique_ptr<HDF5RawDataFile> next_file_ptr = m_next_file.get();
+      std::vector<std::string> next_file_names = next_file_ptr->get_final_file_names();
+      next_file_ptr.reset();
+      for (auto const& file_name : next_file_names)
+        std::filesystem::remove(file_name);
+    } catch (std::exception const& excpt) {
+      ers::warning(FileOpenFailed(ERS_HERE, next_file_name + m_inprogress_filename_suffix, excpt.what()));
+    }
+  }
+
+  if (m_current_file_ptr) {
+    wait_for_closing(*m_current_file_ptr);
+    m_current_file_ptr.reset();
+  }
+  for (auto& file_ptr : m_closing_files)
+    wait_for_closing(*file_ptr);
+  m_closing_files.clear();
+  m_background_pool_ptr.reset();
+}
+
+} // namespace hdf5libs
+} // namespace dunedaq
@@ -11,9 +11,61 @@
 
 #include "logging/Logging.hpp"
 
+#include <highfive/H5DataType.hpp>
+
+#include <map>
+#include <set>
+#include <string>
+#include <vector>
+
+namespace {
+
+// the offsets are computed with the natural alignment of the members, as for the C++ structs
+HighFive::CompoundType
+create_source_id_element_type()
+{
+  return { { "subsys", HighFive::create_datatype<uint32_t>() }, // NOLINT(build/unsigned)
+           { "id", HighFive::create_datatype<uint32_t>() } };   // NOLINT(build/unsigned)
+}
+
+HighFive::CompoundType
+create_source_id_path_element_type()
+{
+  return { { "subsys", HighFive::create_datatype<uint32_t>() },      // NOLINT(build/unsigned)
+           { "id", HighFive::create_datatype<uint32_t>() },          // NOLINT(build/unsigned)
+           { "path_offset", HighFive::create_datatype<uint32_t>() }, // NOLINT(build/unsigned)
+           { "path_size", HighFive::create_datatype<uint32_t>() } }; // NOLINT(build/unsigned)
+}
+
+HighFive::CompoundType
+create_keyed_source_id_element_type()
+{
+  return { { "key", HighFive::create_datatype<uint32_t>() },    // NOLINT(build/unsigned)
+           { "subsys", HighFive::create_datatype<uint32_t>() }, // NOLINT(build/unsigned)
+           { "id", HighFive::create_datatype<uint32_t>() } };   // NOLINT(build/unsigned)
+}
+
+} // namespace
+
+HIGHFIVE_REGISTER_TYPE(dunedaq::hdf5libs::HDF5SourceIDHandler::SourceIDElement, create_source_id_element_type)
+HIGHFIVE_REGISTER_TYPE(dunedaq::hdf5libs::HDF5SourceIDHandler::SourceIDPathElement, create_source_id_path_element_type)
+HIGHFIVE_REGISTER_TYPE(dunedaq::hdf5libs::HDF5SourceIDHandler::KeyedSourceIDElement,
+                       create_keyed_source_id_element_type)
+
 namespace dunedaq {
 namespace hdf5libs {
 
+namespace {
+
+daqdataformats::SourceID
+make_source_id(uint32_t subsys, uint32_t id) // NOLINT(build/unsigned)
+{
+  return daqdataformats::SourceID(static_cast<daqdataformats::SourceID::Subsystem>(subsys),
+                                  static_cast<daqdataformats::SourceID::ID_t>(id));
+}
+
+} // namespace
+
 void 
 HDF5SourceIDHandler::populate_source_id_geo_id_map(dunedaq::hdf5libs::hdf5rawdatafile::SrcIDGeoIDMap  src_id_geo_id_mp_struct,
                                   source_id_geo_id_map_t& source_id_geo_id_map)
@@ -55,36 +107,107 @@ HDF5SourceIDHandler::store_file_level_geo_id_info(HighFive::File& h5_file, const
   write_attribute(h5_file, "source_id_geo_id_map", get_json_string(the_map));
 }
 
+HDF5SourceIDHandler::HDF5SourceIDHandler(const uint32_t version) // NOLINT(build/unsigned)
+  : m_version(version)
+{}
+
 void
 HDF5SourceIDHandler::store_record_header_source_id(HighFive::Group& record_group,
                                                    const daqdataformats::SourceID& source_id)
 {
-  write_attribute(record_group, "record_header_source_id", get_json_string(source_id));
+  if (m_version >= s_first_binary_map_version) {
+    SourceIDElement element;
+    element.subsys = static_cast<uint32_t>(source_id.subsystem); // NOLINT(build/unsigned)
+    element.id = source_id.id;
+    write_attribute(record_group, "record_header_source_id", std::vector<SourceIDElement>{ element });
+  } else {
+    write_attribute(record_group, "record_header_source_id", get_json_string(source_id));
+  }
 }
 
 void
 HDF5SourceIDHandler::store_record_level_path_info(HighFive::Group& record_group, const source_id_path_map_t& the_map)
 {
-  write_attribute(record_group, "source_id_path_map", get_json_string(the_map));
+  if (m_version >= s_first_binary_map_version) {
+    std::vector<SourceIDPathElement> elements;
+    elements.reserve(the_map.size());
+    std::string all_paths;
+    for (auto const& map_element : the_map) {
+      SourceIDPathElement element;
+      element.subsys = static_cast<uint32_t>(map_element.first.subsystem); // NOLINT(build/unsigned)
+      element.id = map_element.first.id;
+      element.path_offset = all_paths.size();
+      element.path_size = map_element.second.size();
+      all_paths += map_element.second;
+      elements.push_back(element);
+    }
+    write_attribute(record_group, "source_id_path_map", elements);
+    write_attribute(record_group, "source_id_paths", all_paths);
+  } else {
+    write_attribute(record_group, "source_id_path_map", get_json_string(the_map));
+  }
 }
 
 void
 HDF5SourceIDHandler::store_record_level_fragment_type_map(HighFive::Group& record_group,
                                                           const fragment_type_source_id_map_t& the_map)
 {
-  write_attribute(record_group, "fragment_type_source_id_map", get_json_string(the_map));
+  if (m_version >= s_first_binary_map_version)
+    write_attribute(record_group, "fragment_type_source_id_map", get_binary_elements(the_map));
+  else
+    write_attribute(record_group, "fragment_type_source_id_map", get_json_string(the_map));
 }
 
 void
 HDF5SourceIDHandler::store_record_level_subdetector_map(HighFive::Group& record_group,
                                                         const subdetector_source_id_map_t& the_map)
 {
-  write_attribute(record_group, "subdetector_source_id_map", get_json_string(the_map));
+  if (m_version >= s_first_binary_map_version)
+    write_attribute(record_group, "subdetector_source_id_map", get_binary_elements(the_map));
+  else
+    write_attribute(record_group, "subdetector_source_id_map", get_json_string(the_map));
 }
 
-HDF5SourceIDHandler::HDF5SourceIDHandler(const uint32_t version) // NOLINT(build/unsigned)
-  : m_version(version)
-{}
+void
+HDF5SourceIDHandler::store_record_layout_index(HighFive::Group& record_group,
+                                               uint32_t layout_index) // NOLINT(build/unsigned)
+{
+  write_attribute(record_group, "record_layout_index", layout_index);
+}
+
+std::string
+HDF5SourceIDHandler::get_record_layout_key(const daqdataformats::SourceID& record_header_source_id,
+                                           const source_id_path_map_t& relative_path_map,
+                                           const fragment_type_source_id_map_t& fragment_type_map,
+                                           const subdetector_source_id_map_t& subdetector_map)
+{
+  // the binary elements of the maps, with each path after its element; the element counts
+  // separate the maps, so that different maps cannot produce the same key
+  std::string key;
+  auto append_value = [&](uint32_t value) { // NOLINT(build/unsigned)
+    key.append(reinterpret_cast<const char*>(&value), sizeof(value)); // NOLINT
+  };
+  append_value(static_cast<uint32_t>(record_header_source_id.subsystem)); // NOLINT(build/unsigned)
+  append_value(record_header_source_id.id);
+
+  append_value(relative_path_map.size());
+  for (auto const& map_element : relative_path_map) {
+    append_value(static_cast<uint32_t>(map_element.first.subsystem)); // NOLINT(build/unsigned)
+    append_value(map_element.first.id);
+    append_value(map_element.second.size());
+    key += map_element.second;
+  }
+
+  for (auto const& elements : { get_binary_elements(fragment_type_map), get_binary_elements(subdetector_map) }) {
+    append_value(elements.size());
+    for (auto const& element : elements) {
+      append_value(element.key);
+      append_value(element.subsys);
+      append_value(element.id);
+    }
+  }
+  return key;
+}
 
 void
 HDF5SourceIDHandler::fetch_file_level_geo_id_info(const HighFive::File& h5_file,
@@ -113,7 +236,15 @@ daqdataformats::SourceID
 HDF5SourceIDHandler::fetch_record_header_source_id(const HighFive::Group& record_group)
 {
   daqdataformats::SourceID source_id;
-  if (m_version >= 3) {
+  if (m_version >= s_first_binary_map_version) {
+    try {
+      auto elements =
+        get_attribute<HighFive::Group, std::vector<SourceIDElement>>(record_group, "record_header_source_id");
+      if (!elements.empty())
+        source_id = make_source_id(elements[0].subsys, elements[0].id);
+    } catch (...) {
+    }
+  } else if (m_version >= 3) {
     try {
       std::string sid_string = get_attribute<HighFive::Group, std::string>(record_group, "record_header_source_id");
       parse_json_string(sid_string, source_id);
@@ -123,11 +254,32 @@ HDF5SourceIDHandler::fetch_record_header_source_id(const HighFive::Group& record
   return source_id;
 }
 
+bool
+HDF5SourceIDHandler::fetch_record_layout_index(const HighFive::Group& record_group,
+                                               uint32_t& layout_index) // NOLINT(build/unsigned)
+{
+  if (m_version < s_first_record_layout_version || !record_group.hasAttribute("record_layout_index"))
+    return false;
+  layout_index = get_attribute<HighFive::Group, uint32_t>(record_group, "record_layout_index"); // NOLINT
+  return true;
+}
+
 void
 HDF5SourceIDHandler::fetch_source_id_path_info(const HighFive::Group& record_group,
                                                source_id_path_map_t& source_id_path_map)
 {
-  if (m_version >= 3) {
+  if (m_version >= s_first_binary_map_version) {
+    try {
+      auto elements =
+        get_attribute<HighFive::Group, std::vector<SourceIDPathElement>>(record_group, "source_id_path_map");
+      auto all_paths = get_attribute<HighFive::Group, std::string>(record_group, "source_id_paths");
+      for (auto const& element : elements) {
+        source_id_path_map[make_source_id(element.subsys, element.id)] =
+          all_paths.substr(element.path_offset, element.path_size);
+      }
+    } catch (...) {
+    }
+  } else if (m_version >= 3) {
     try {
       std::string map_string = get_attribute<HighFive::Group, std::string>(record_group, "source_id_path_map");
       parse_json_string(map_string, source_id_path_map);
@@ -140,7 +292,14 @@ void
 HDF5SourceIDHandler::fetch_fragment_type_source_id_info(const HighFive::Group& record_group,
                                                         fragment_type_source_id_map_t& fragment_type_source_id_map)
 {
-  if (m_version >= 3) {
+  if (m_version >= s_first_binary_map_version) {
+    try {
+      parse_binary_elements(
+        get_attribute<HighFive::Group, std::vector<KeyedSourceIDElement>>(record_group, "fragment_type_source_id_map"),
+        fragment_type_source_id_map);
+    } catch (...) {
+    }
+  } else if (m_version >= 3) {
     try {
       std::string map_string = get_attribute<HighFive::Group, std::string>(record_group, "fragment_type_source_id_map");
       parse_json_string(map_string, fragment_type_source_id_map);
@@ -153,7 +312,14 @@ void
 HDF5SourceIDHandler::fetch_subdetector_source_id_info(const HighFive::Group& record_group,
                                                       subdetector_source_id_map_t& subdetector_source_id_map)
 {
-  if (m_version >= 3) {
+  if (m_version >= s_first_binary_map_version) {
+    try {
+      parse_binary_elements(
+        get_attribute<HighFive::Group, std::vector<KeyedSourceIDElement>>(record_group, "subdetector_source_id_map"),
+        subdetector_source_id_map);
+    } catch (...) {
+    }
+  } else if (m_version >= 3) {
     try {
       std::string map_string = get_attribute<HighFive::Group, std::string>(record_group, "subdetector_source_id_map");
       parse_json_string(map_string, subdetector_source_id_map);
@@ -317,6 +483,35 @@ HDF5SourceIDHandler::get_json_string(const HDF5SourceIDHandler::subdetector_sour
   return json_tmp_data.dump();
 }
 
+template<typename K>
+std::vector<HDF5SourceIDHandler::KeyedSourceIDElement>
+HDF5SourceIDHandler::get_binary_elements(const std::map<K, std::set<daqdataformats::SourceID>>& keyed_source_id_map)
+{
+  std::vector<KeyedSourceIDElement> elements;
+  for (auto const& map_element : keyed_source_id_map) {
+    for (auto const& source_id_from_map : map_element.second) {
+      KeyedSourceIDElement element;
+      element.key = static_cast<uint32_t>(map_element.first);            // NOLINT(build/unsigned)
+      element.subsys = static_cast<uint32_t>(source_id_from_map.subsystem); // NOLINT(build/unsigned)
+      element.id = source_id_from_map.id;
+      elements.push_back(element);
+    }
+  }
+  return elements;
+}
+
+template<typename K>
+void
+HDF5SourceIDHandler::parse_binary_elements(const std::vector<KeyedSourceIDElement>& elements,
+                                           std::map<K, std::set<daqdataformats::SourceID>>& keyed_source_id_map)
+{
+  // the elements were written in map order, so each insertion is at the end of its set
+  for (auto const& element : elements) {
+    auto& source_id_set = keyed_source_id_map[static_cast<K>(element.key)];
+    source_id_set.insert(source_id_set.end(), make_source_id(element.subsys, element.id));
+  }
+}
+
 void
 HDF5SourceIDHandler::parse_json_string(const std::string& json_string, daqdataformats::SourceID& source_id)
 {
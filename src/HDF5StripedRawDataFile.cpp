@@ -0,0 +1,293 @@
+/**
+ * This is part of the DUNE DAQ Application Framework, copyright 2020.
+ * Licensing/copyright details are in the COPYING file that you should have
+ * received with this code.
+ *
+ */
+
+#include "hdf5libs/HDF5StripedRawDataFile.hpp"
+
+#include "logging/Logging.hpp"
+
+#include <nlohmann/json.hpp>
+
+#include <exception>
+#include <filesystem>
+#include <fstream>
+#include <memory>
+#include <set>
+#include <string>
+#include <utility>
+#include <vector>
+
+namespace dunedaq {
+namespace hdf5libs {
+
+namespace {
+
+constexpr int MANIFEST_VERSION = 1;
+
+} // namespace
+
+HDF5StripedRawDataFile::PlacementPolicy
+HDF5StripedRawDataFile::string_to_placement_policy(const std::string& policy_name)
+{
+  if (policy_name == "round_robin")
+    return PlacementPolicy::kRoundRobin;
+  if (policy_name == "least_loaded")
+    return PlacementPolicy::kLeastLoaded;
+  throw InvalidStripePlacementPolicy(ERS_HERE, policy_name);
+}
+
+HDF5StripedRawDataFile::HDF5StripedRawDataFile(std::string manifest_file_name,
+                                               const std::vector<std::string>& file_names,
+                                               daqdataformats::run_number_t run_number,
+                                               size_t file_index,
+                                               std::string application_name,
+                                               const hdf5filelayout::FileLayoutParams& fl_params,
+                                               const hdf5rawdatafile::SrcIDGeoIDMap& srcid_geoid_map,
+                                               const hdf5rawdatafile::StripeParams& stripe_params,
+                                               const hdf5rawdatafile::WriterParams& writer_params,
+                                               std::string inprogress_filename_suffix)
+  : m_manifest_file_name(std::move(manifest_file_name))
+  , m_inprogress_filename_suffix(std::move(inprogress_filename_suffix))
+  , m_placement_policy(string_to_placement_policy(stripe_params.placement_policy))
+  , m_writing(true)
+  , m_file_names(file_names)
+{
+  if (m_file_names.empty())
+    throw StripeManifestFailed(ERS_HERE, m_manifest_file_name, "no files were given for the stripes");
+
+  // the stripes are written concurrently by their I/O threads, which needs a thread-safe HDF5 library
+  hdf5rawdatafile::WriterParams stripe_writer_params = writer_params;
+  hbool_t library_is_threadsafe = false;
+  H5is_library_threadsafe(&library_is_threadsafe);
+  if (library_is_threadsafe) {
+    if (stripe_writer_params.async_write_queue_depth <= 0)
+      stripe_writer_params.async_write_queue_depth = DEFAULT_STRIPE_QUEUE_DEPTH;
+  } else {
+    ers::warning(HDF5LibraryNotThreadSafe(ERS_HERE, m_manifest_file_name));
+    stripe_writer_params.async_write_queue_depth = 0;
+    m_async = false;
+  }
+
+  for (size_t stripe_index = 0; stripe_index < m_file_names.size(); ++stripe_index) {
+    m_stripes.push_back(std::make_unique<HDF5RawDataFile>(m_file_names[stripe_index],
+                                                          run_number,
+                                                          file_index,
+                                                          application_name,
+                                                          fl_params,
+                                                          srcid_geoid_map,
+                                                          m_inprogress_filename_suffix,
+                                                          HighFive::File::Create,
+                                                          stripe_writer_params));
+
+    // no records are queued yet, so the I/O thread of the stripe is not making HDF5 calls
+    m_stripes.back()->write_attribute("stripe_index", stripe_index);
+    m_stripes.back()->write_attribute("stripe_count", m_file_names.size());
+    m_stripes.back()->write_attribute("stripe_manifest_file_name", m_manifest_file_name);
+  }
+  TLOG_DEBUG(HDF5RawDataFile::TLVL_BASIC) << "Opened " << m_stripes.size() << " stripes for "
+                                          << m_manifest_file_name;
+}
+
+HDF5StripedRawDataFile::HDF5StripedRawDataFile(const std::string& manifest_file_name)
+  : m_manifest_file_name(manifest_file_name)
+{
+  read_manifest();
+
+  // files that are listed with relative paths are next to the manifest
+  std::filesystem::path manifest_directory = std::filesystem::path(m_manifest_file_name).parent_path();
+  for (auto const& file_name : m_file_names) {
+    std::filesystem::path file_path(file_name);
+    if (file_path.is_relative())
+      file_path = manifest_directory / file_path;
+    m_stripes.push_back(std::make_unique<HDF5RawDataFile>(file_path.string()));
+  }
+}
+
+HDF5StripedRawDataFile::~HDF5StripedRawDataFile()
+{
+  close();
+}
+
+std::future<void>
+HDF5StripedRawDataFile::write(std::unique_ptr<daqdataformats::TriggerRecord> tr)
+{
+  record_id_t rid = std::make_pair(tr->get_header_ref().get_trigger_number(),
+                                   tr->get_header_ref().get_sequence_number());
+  return do_write(std::move(tr), rid);
+}
+
+std::future<void>
+HDF5StripedRawDataFile::write(std::unique_ptr<daqdataformats::TimeSlice> ts)
+{
+  record_id_t rid = std::make_pair(ts->get_header().timeslice_number, 0);
+  return do_write(std::move(ts), rid);
+}
+
+template<typename RecordT>
+std::future<void>
+HDF5StripedRawDataFile::do_write(std::unique_ptr<RecordT> record_ptr, const record_id_t& rid)
+{
+  if (m_closed || !m_writing)
+    throw StripedFileClosed(ERS_HERE, rid.first, m_manifest_file_name);
+
+  size_t stripe_index = choose_stripe();
+  std::future<void> completion;
+  if (m_async) {
+    completion = m_stripes[stripe_index]->write_async(std::move(record_ptr));
+  } else {
+    // failures are handed over through the future, as they are by the I/O threads
+    std::promise<void> write_promise;
+    completion = write_promise.get_future();
+    try {
+      m_stripes[stripe_index]->write(*record_ptr);
+      write_promise.set_value();
+    } catch (...) {
+      write_promise.set_exception(std::current_exception());
+      return completion;
+    }
+  }
+
+  add_record(rid, stripe_index);
+  m_next_stripe = (stripe_index + 1) % m_stripes.size();
+  return completion;
+}
+
+size_t
+HDF5StripedRawDataFile::choose_stripe() const
+{
+  if (m_placement_policy == PlacementPolicy::kRoundRobin)
+    return m_next_stripe;
+
+  // the scan starts after the previous stripe, so that ties go to the stripes in turn
+  size_t chosen_index = m_next_stripe;
+  for (size_t offset = 1; offset < m_stripes.size(); ++offset) {
+    size_t stripe_index = (m_next_stripe + offset) % m_stripes.size();
+    auto const& stripe = *m_stripes[stripe_index];
+    auto const& chosen_stripe = *m_stripes[chosen_index];
+    if (std::make_pair(stripe.get_write_queue_depth(), stripe.get_recorded_size()) <
+        std::make_pair(chosen_stripe.get_write_queue_depth(), chosen_stripe.get_recorded_size()))
+      chosen_index = stripe_index;
+  }
+  return chosen_index;
+}
+
+void
+HDF5StripedRawDataFile::add_record(const record_id_t& rid, size_t stripe_index)
+{
+  m_record_stripe_index[rid] = stripe_index;
+  m_record_ids.push_back(rid);
+  m_record_stripes.push_back(stripe_index);
+}
+
+size_t
+HDF5StripedRawDataFile::get_stripe_index(const record_id_t& rid) const
+{
+  auto stripe_iter = m_record_stripe_index.find(rid);
+  if (stripe_iter == m_record_stripe_index.end())
+    throw RecordIDNotFound(ERS_HERE, rid.first, rid.second);
+  return stripe_iter->second;
+}
+
+void
+HDF5StripedRawDataFile::close()
+{
+  if (m_closed)
+    return;
+  m_closed = true;
+
+  if (!m_writing) {
+    m_stripes.clear();
+    return;
+  }
+
+  // the stripes are on different file systems, so they are finalized concurrently
+  std::vector<std::shared_future<void>> close_futures;
+  for (auto& stripe_ptr : m_stripes)
+    close_futures.push_back(stripe_ptr->close_async());
+  for (size_t stripe_index = 0; stripe_index < m_stripes.size(); ++stripe_index) {
+    try {
+      close_futures[stripe_index].get();
+    } catch (std::exception const& excpt) {
+      ers::error(FileCloseFailed(ERS_HERE, m_stripes[stripe_index]->get_bare_file_name(), excpt.what()));
+    }
+  }
+
+  try {
+    write_manifest();
+  } catch (std::exception const& excpt) {
+    ers::error(StripeManifestFailed(ERS_HERE, m_manifest_file_name, excpt.what()));
+  }
+  m_stripes.clear();
+}
+
+/**
+ * @brief Write the list of files, and the stripe of each record in the order in which the records were handed
+ * over. Records whose writing failed are not in the record directory of their file, and are left out.
+ */
+void
+HDF5StripedRawDataFile::write_manifest()
+{
+  std::vector<std::set<record_id_t>> written_record_ids(m_stripes.size());
+  for (size_t stripe_index = 0; stripe_index < m_stripes.size(); ++stripe_index) {
+    for (auto const& directory_entry : m_stripes[stripe_index]->get_record_directory())
+      written_record_ids[stripe_index].emplace(directory_entry.record_number, directory_entry.sequence_number);
+  }
+
+  nlohmann::json manifest;
+  manifest["manifest_version"] = MANIFEST_VERSION;
+  manifest["record_type"] = m_stripes.front()->get_record_type();
+  manifest["files"] = m_file_names;
+  nlohmann::json records = nlohmann::json::array();
+  for (size_t record_index = 0; record_index < m_record_ids.size(); ++record_index) {
+    auto const& rid = m_record_ids[record_index];
+    size_t stripe_index = m_record_stripes[record_index];
+    if (written_record_ids[stripe_index].count(rid) > 0)
+      records.push_back({ rid.first, rid.second, stripe_index });
+  }
+  manifest["records"] = std::move(records);
+
+  // the manifest only appears under its name once it is complete
+  std::string inprogress_file_name = m_manifest_file_name + m_inprogress_filename_suffix;
+  {
+    std::ofstream manifest_stream(inprogress_file_name, std::ios::trunc);
+    manifest_stream << manifest.dump();
+    if (!manifest_stream.flush())
+      throw StripeManifestFailed(ERS_HERE, inprogress_file_name, "unable to write the file");
+  }
+  std::filesystem::rename(inprogress_file_name, m_manifest_file_name);
+  TLOG_DEBUG(HDF5RawDataFile::TLVL_BASIC) << "Wrote the manifest of " << m_record_ids.size() << " records in "
+                                          << m_stripes.size() << " stripes to " << m_manifest_file_name;
+}
+
+void
+HDF5StripedRawDataFile::read_manifest()
+{
+  std::ifstream manifest_stream(m_manifest_file_name);
+  if (!manifest_stream)
+    throw FileOpenFailed(ERS_HERE, m_manifest_file_name, "unable to open the stripe manifest");
+
+  nlohmann::json manifest;
+  try {
+    manifest = nlohmann::json::parse(manifest_stream);
+  } catch (nlohmann::json::exception const& excpt) {
+    throw StripeManifestFailed(ERS_HERE, m_manifest_file_name, excpt.what());
+  }
+  if (manifest.value("manifest_version", 0) != MANIFEST_VERSION)
+    throw StripeManifestFailed(ERS_HERE, m_manifest_file_name, "unknown manifest version");
+
+  m_file_names = manifest.at("files").get<std::vector<std::string>>();
+  for (auto const& record : manifest.at("records")) {
+    record_id_t rid = std::make_pair(record.at(0).get<uint64_t>(), // NOLINT(build/unsigned)
+                                     record.at(1).get<daqdataformats::sequence_number_t>());
+    size_t stripe_index = record.at(2).get<size_t>();
+    if (stripe_index >= m_file_names.size())
+      throw StripeManifestFailed(ERS_HERE, m_manifest_file_name, "record listed in a stripe that does not exist");
+    add_record(rid, stripe_index);
+  }
+}
+
+} // namespace hdf5libs
+} // namespace dunedaq
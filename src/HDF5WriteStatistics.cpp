@@ -0,0 +1,179 @@
+/**
+ * This is part of the DUNE DAQ Application Framework, copyright 2020.
+ * Licensing/copyright details are in the COPYING file that you should have
+ * received with this code.
+ *
+ */
+
+#include "hdf5libs/HDF5WriteStatistics.hpp"
+
+#include <algorithm>
+#include <cmath>
+
+namespace dunedaq {
+namespace hdf5libs {
+
+namespace {
+
+size_t
+get_bucket_index(uint64_t value) // NOLINT(build/unsigned)
+{
+  // the number of significant bits of the value
+  size_t bucket_index = (value == 0) ? 0 : 64 - __builtin_clzll(value);
+  return std::min(bucket_index, HistogramSnapshot::s_bucket_count - 1);
+}
+
+int64_t
+get_time_ns(std::chrono::steady_clock::time_point time)
+{
+  return std::chrono::duration_cast<std::chrono::nanoseconds>(time.time_since_epoch()).count();
+}
+
+} // namespace
+
+uint64_t // NOLINT(build/unsigned)
+HistogramSnapshot::get_quantile(double quantile) const noexcept
+{
+  if (count == 0)
+    return 0;
+
+  uint64_t target_count = static_cast<uint64_t>(std::ceil(std::clamp(quantile, 0.0, 1.0) * count)); // NOLINT
+  uint64_t cumulative_count = 0;                                                                       // NOLINT
+  for (size_t idx = 0; idx < s_bucket_count; ++idx) {
+    cumulative_count += bucket_counts[idx];
+    if (cumulative_count >= target_count && cumulative_count > 0) {
+      uint64_t bucket_upper_edge = (idx == 0) ? 0 : (uint64_t(1) << idx) - 1; // NOLINT(build/unsigned)
+      return std::min(bucket_upper_edge, max);
+    }
+  }
+  return max;
+}
+
+void
+Log2Histogram::add(uint64_t value) noexcept // NOLINT(build/unsigned)
+{
+  m_bucket_counts[get_bucket_index(value)].fetch_add(1, std::memory_order_relaxed);
+  m_count.fetch_add(1, std::memory_order_relaxed);
+  m_sum.fetch_add(value, std::memory_order_relaxed);
+
+  uint64_t current_max = m_max.load(std::memory_order_relaxed); // NOLINT(build/unsigned)
+  while (value > current_max && !m_max.compare_exchange_weak(current_max, value, std::memory_order_relaxed)) {
+  }
+}
+
+HistogramSnapshot
+Log2Histogram::get_snapshot() const noexcept
+{
+  HistogramSnapshot snapshot;
+  for (size_t idx = 0; idx < HistogramSnapshot::s_bucket_count; ++idx)
+    snapshot.bucket_counts[idx] = m_bucket_counts[idx].load(std::memory_order_relaxed);
+  snapshot.count = m_count.load(std::memory_order_relaxed);
+  snapshot.sum = m_sum.load(std::memory_order_relaxed);
+  snapshot.max = m_max.load(std::memory_order_relaxed);
+  return snapshot;
+}
+
+void
+WriteStatisticsCollector::AtomicRecordWriteSummary::store(const RecordWriteSummary& record_summary) noexcept
+{
+  record_number.store(record_summary.record_number, std::memory_order_relaxed);
+  sequence_number.store(record_summary.sequence_number, std::memory_order_relaxed);
+  size_bytes.store(record_summary.size_bytes, std::memory_order_relaxed);
+  write_time_ns.store(record_summary.write_time_ns, std::memory_order_relaxed);
+  fragment_count.store(record_summary.fragment_count, std::memory_order_relaxed);
+}
+
+RecordWriteSummary
+WriteStatisticsCollector::AtomicRecordWriteSummary::load() const noexcept
+{
+  RecordWriteSummary record_summary;
+  record_summary.record_number = record_number.load(std::memory_order_relaxed);
+  record_summary.sequence_number = sequence_number.load(std::memory_order_relaxed);
+  record_summary.size_bytes = size_bytes.load(std::memory_order_relaxed);
+  record_summary.write_time_ns = write_time_ns.load(std::memory_order_relaxed);
+  record_summary.fragment_count = fragment_count.load(std::memory_order_relaxed);
+  return record_summary;
+}
+
+WriteStatisticsCollector::WriteStatisticsCollector(std::chrono::milliseconds averaging_interval)
+  : m_averaging_interval_s(std::max(averaging_interval.count(), int64_t(1)) / 1000.0)
+  , m_last_record_end_ns(get_time_ns(std::chrono::steady_clock::now()))
+{}
+
+void
+WriteStatisticsCollector::add_record(const RecordWriteSummary& record_summary,
+                                     std::chrono::steady_clock::time_point end_time) noexcept
+{
+  m_record_write_time_ns.add(record_summary.write_time_ns);
+  m_fragments_per_record.add(record_summary.fragment_count);
+  m_record_count.fetch_add(1, std::memory_order_relaxed);
+  m_bytes_written.fetch_add(record_summary.size_bytes, std::memory_order_relaxed);
+
+  // the rates since the end of the previous record are averaged with a weight that grows with the time they cover,
+  // so that the averages do not depend on how the records are spread in time
+  int64_t end_time_ns = get_time_ns(end_time);
+  double interval_s =
+    std::max(end_time_ns - m_last_record_end_ns.load(std::memory_order_relaxed), int64_t(1)) / 1.0e9;
+  double weight = 1.0 - std::exp(-interval_s / m_averaging_interval_s);
+  double bytes_per_second = m_bytes_per_second.load(std::memory_order_relaxed);
+  double records_per_second = m_records_per_second.load(std::memory_order_relaxed);
+  m_bytes_per_second.store(bytes_per_second + weight * (record_summary.size_bytes / interval_s - bytes_per_second),
+                           std::memory_order_relaxed);
+  m_records_per_second.store(records_per_second + weight * (1.0 / interval_s - records_per_second),
+                             std::memory_order_relaxed);
+  m_last_record_end_ns.store(end_time_ns, std::memory_order_relaxed);
+
+  bool is_largest = record_summary.size_bytes > m_largest_record.size_bytes.load(std::memory_order_relaxed);
+  bool is_slowest = record_summary.write_time_ns > m_slowest_record.write_time_ns.load(std::memory_order_relaxed);
+  if (is_largest || is_slowest) {
+    uint64_t sequence = m_summary_sequence.load(std::memory_order_relaxed); // NOLINT(build/unsigned)
+    m_summary_sequence.store(sequence + 1, std::memory_order_relaxed);
+    std::atomic_thread_fence(std::memory_order_release);
+    if (is_largest)
+      m_largest_record.store(record_summary);
+    if (is_slowest)
+      m_slowest_record.store(record_summary);
+    m_summary_sequence.store(sequence + 2, std::memory_order_release);
+  }
+}
+
+WriteStatistics
+WriteStatisticsCollector::get_statistics() const
+{
+  WriteStatistics statistics;
+  for (size_t idx = 0; idx < m_phase_latency_ns.size(); ++idx)
+    statistics.phase_latency_ns[idx] = m_phase_latency_ns[idx].get_snapshot();
+  statistics.record_write_time_ns = m_record_write_time_ns.get_snapshot();
+  statistics.fragments_per_record = m_fragments_per_record.get_snapshot();
+  statistics.record_count = m_record_count.load(std::memory_order_relaxed);
+  statistics.bytes_written = m_bytes_written.load(std::memory_order_relaxed);
+
+  // nothing has been written since the last record, which lowers the averages
+  double idle_time_s =
+    std::max(get_time_ns(std::chrono::steady_clock::now()) - m_last_record_end_ns.load(std::memory_order_relaxed),
+             int64_t(0)) /
+    1.0e9;
+  double decay = std::exp(-idle_time_s / m_averaging_interval_s);
+  statistics.bytes_per_second = m_bytes_per_second.load(std::memory_order_relaxed) * decay;
+  statistics.records_per_second = m_records_per_second.load(std::memory_order_relaxed) * decay;
+
+  statistics.preallocated_bytes = m_preallocated_bytes.load(std::memory_order_relaxed);
+  statistics.free_disk_space_bytes = m_free_disk_space_bytes.load(std::memory_order_relaxed);
+  statistics.delayed_record_count = m_delayed_record_count.load(std::memory_order_relaxed);
+  statistics.rejected_record_count = m_rejected_record_count.load(std::memory_order_relaxed);
+  statistics.free_space_wait_seconds = m_free_space_wait_ns.load(std::memory_order_relaxed) / 1.0e9;
+  statistics.file_image_bytes = m_file_image_bytes.load(std::memory_order_relaxed);
+
+  uint64_t sequence_before = 0; // NOLINT(build/unsigned)
+  do {
+    sequence_before = m_summary_sequence.load(std::memory_order_acquire);
+    statistics.largest_record = m_largest_record.load();
+    statistics.slowest_record = m_slowest_record.load();
+    std::atomic_thread_fence(std::memory_order_acquire);
+  } while ((sequence_before & 1) != 0 || sequence_before != m_summary_sequence.load(std::memory_order_relaxed));
+
+  return statistics;
+}
+
+} // namespace hdf5libs
+} // namespace dunedaq
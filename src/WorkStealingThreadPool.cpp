@@ -0,0 +1,105 @@
+/**
+ * This is part of the DUNE DAQ Application Framework, copyright 2020.
+ * Licensing/copyright details are in the COPYING file that you should have
+ * received with this code.
+ *
+ */
+
+#include "hdf5libs/WorkStealingThreadPool.hpp"
+
+#include <memory>
+#include <utility>
+
+namespace dunedaq {
+namespace hdf5libs {
+
+WorkStealingThreadPool::WorkStealingThreadPool(size_t thread_count)
+{
+  if (thread_count == 0)
+    thread_count = 1;
+
+  for (size_t idx = 0; idx < thread_count; ++idx)
+    m_task_queues.push_back(std::make_unique<TaskQueue>());
+  for (size_t idx = 0; idx < thread_count; ++idx)
+    m_workers.emplace_back(&WorkStealingThreadPool::run_worker, this, idx);
+}
+
+WorkStealingThreadPool::~WorkStealingThreadPool()
+{
+  {
+    std::lock_guard<std::mutex> lk(m_wait_mutex);
+    m_stop_requested = true;
+  }
+  m_task_available_cv.notify_all();
+  for (auto& worker : m_workers)
+    worker.join();
+}
+
+/**
+ * @brief Tasks are spread over the worker queues in turn; idle workers steal from the others.
+ */
+void
+WorkStealingThreadPool::push_task(std::function<void()> task)
+{
+  auto& task_queue = *m_task_queues[m_next_queue_index++ % m_task_queues.size()];
+
+  // the task is counted before it can be popped, so that the count never drops below zero; a worker that looks
+  // in between finds no task yet, and tries again
+  {
+    std::lock_guard<std::mutex> lk(m_wait_mutex);
+    ++m_queued_task_count;
+  }
+  {
+    std::lock_guard<std::mutex> lk(task_queue.mutex);
+    task_queue.tasks.push_back(std::move(task));
+  }
+  m_task_available_cv.notify_one();
+}
+
+/**
+ * @brief Takes the oldest task of the worker's own queue, since results are consumed in submission order.
+ * Otherwise steals the newest task of another queue, to keep out of the way of its owner.
+ */
+bool
+WorkStealingThreadPool::try_pop_task(size_t worker_index, std::function<void()>& task)
+{
+  const size_t queue_count = m_task_queues.size();
+  for (size_t offset = 0; offset < queue_count; ++offset) {
+    auto& task_queue = *m_task_queues[(worker_index + offset) % queue_count];
+    std::lock_guard<std::mutex> lk(task_queue.mutex);
+    if (task_queue.tasks.empty())
+      continue;
+    if (offset == 0) {
+      task = std::move(task_queue.tasks.front());
+      task_queue.tasks.pop_front();
+    } else {
+      task = std::move(task_queue.tasks.back());
+      task_queue.tasks.pop_back();
+    }
+    std::lock_guard<std::mutex> wait_lk(m_wait_mutex);
+    --m_queued_task_count;
+    return true;
+  }
+  return false;
+}
+
+void
+WorkStealingThreadPool::run_worker(size_t worker_index)
+{
+  std::function<void()> task;
+  while (true) {
+    if (try_pop_task(worker_index, task)) {
+      task();
+      task = nullptr;
+      continue;
+    }
+
+    std::unique_lock<std::mutex> lk(m_wait_mutex);
+    if (m_stop_requested && m_queued_task_count == 0)
+      break;
+    m_task_available_cv.wait(lk, [this] { return m_stop_requested || m_queued_task_count > 0; });
+  }
+}
+
+} // namespace hdf5libs
+} // namespace dunedaq
@@ -0,0 +1,158 @@
+/**
+ * @file HDF5LIBS_PathBenchmark.cpp
+ *
+ * Measures the time that it takes to build the path elements of the fragment datasets
+ * of a record, with the stream-based formatting that the writer used before, with
+ * HDF5FileLayout::get_path_elements(), and with the DatasetPathBuilder of the writer.
+ * No file is written.
+ *
+ * This is part of the DUNE DAQ Software Suite, copyright 2020.
+ * Licensing/copyright details are in the COPYING file that you should have
+ * received with this code.
+ */
+
+#include "hdf5libs/HDF5FileLayout.hpp"
+
+#include "logging/Logging.hpp"
+
+#include <chrono>
+#include <iomanip>
+#include <sstream>
+#include <string>
+#include <vector>
+
+using namespace dunedaq::hdf5libs;
+using namespace dunedaq::daqdataformats;
+
+namespace {
+
+struct BenchmarkConfig
+{
+  int record_count = 1000;
+  int fragment_count = 1000;
+};
+
+hdf5filelayout::FileLayoutParams
+create_file_layout_params()
+{
+  hdf5filelayout::PathParams params_tpc;
+  params_tpc.detector_group_type = "Detector_Readout";
+  params_tpc.detector_group_name = "TPC";
+  params_tpc.element_name_prefix = "Link";
+  params_tpc.digits_for_element_number = 5;
+
+  hdf5filelayout::FileLayoutParams layout_params;
+  layout_params.path_param_list.push_back(params_tpc);
+  layout_params.record_name_prefix = "TriggerRecord";
+  layout_params.digits_for_record_number = 6;
+  layout_params.digits_for_sequence_number = 4;
+  layout_params.record_header_dataset_name = "TriggerRecordHeader";
+  return layout_params;
+}
+
+// the formatting of the fragment path elements with a string stream, a new vector and new strings per fragment
+std::vector<std::string>
+get_stream_path_elements(const hdf5filelayout::FileLayoutParams& fl_params, const FragmentHeader& fh)
+{
+  std::ostringstream record_number_string;
+  record_number_string << fl_params.record_name_prefix << std::setw(fl_params.digits_for_record_number)
+                       << std::setfill('0') << fh.trigger_number << "."
+                       << std::setw(fl_params.digits_for_sequence_number) << std::setfill('0') << fh.sequence_number;
+
+  std::vector<std::string> path_elements;
+  path_elements.push_back(record_number_string.str());
+  path_elements.push_back(fl_params.raw_data_group_name);
+  path_elements.push_back(fh.element_id.to_string() + "_" +
+                          fragment_type_to_string(static_cast<FragmentType>(fh.fragment_type)));
+  return path_elements;
+}
+
+std::vector<FragmentHeader>
+create_fragment_headers(const BenchmarkConfig& config)
+{
+  std::vector<FragmentHeader> fragment_headers;
+  for (int ele_num = 0; ele_num < config.fragment_count; ++ele_num) {
+    FragmentHeader fh;
+    fh.fragment_type = static_cast<fragment_type_t>(FragmentType::kWIB);
+    fh.sequence_number = 0;
+    fh.element_id = SourceID(SourceID::Subsystem::kDetectorReadout, ele_num);
+    fragment_headers.push_back(fh);
+  }
+  return fragment_headers;
+}
+
+// runs the path formatting over all the fragments of all the records, and returns the time per fragment
+template<typename PathFunction>
+double
+time_path_formatting(const BenchmarkConfig& config, std::vector<FragmentHeader>& fragment_headers, PathFunction&& func)
+{
+  size_t total_length = 0;
+  auto start_time = std::chrono::steady_clock::now();
+  for (int trig_num = 1; trig_num <= config.record_count; ++trig_num) {
+    for (auto& fh : fragment_headers) {
+      fh.trigger_number = trig_num;
+      auto const& path_elements = func(fh);
+      total_length += path_elements[0].size() + path_elements[2].size();
+    }
+  }
+  auto end_time = std::chrono::steady_clock::now();
+
+  // the lengths are used, so that the formatting is not optimized away
+  if (total_length == 0)
+    TLOG() << "No path was formatted";
+  return std::chrono::duration<double, std::nano>(end_time - start_time).count() /
+         (static_cast<double>(config.record_count) * config.fragment_count);
+}
+
+void
+print_result(const std::string& label, double ns_per_fragment)
+{
+  std::ostringstream oss;
+  oss << std::left << std::setw(28) << label << std::right << std::fixed << std::setprecision(1) << std::setw(10)
+      << ns_per_fragment << " ns/fragment";
+  TLOG() << oss.str();
+}
+
+void
+print_usage()
+{
+  TLOG() << "Usage: HDF5LIBS_PathBenchmark [record_count] [fragments_per_record]";
+}
+
+} // namespace
+
+int
+main(int argc, char** argv)
+{
+  if (argc > 3) {
+    print_usage();
+    return 1;
+  }
+
+  BenchmarkConfig config;
+  if (argc > 1)
+    config.record_count = std::stoi(argv[1]);
+  if (argc > 2)
+    config.fragment_count = std::stoi(argv[2]);
+
+  TLOG() << "Building the dataset paths of " << config.record_count << " records of " << config.fragment_count
+         << " fragments";
+
+  const auto fl_params = create_file_layout_params();
+  HDF5FileLayout file_layout(fl_params);
+  DatasetPathBuilder path_builder(file_layout);
+  auto fragment_headers = create_fragment_headers(config);
+
+  print_result("string_stream", time_path_formatting(config, fragment_headers, [&](const FragmentHeader& fh) {
+                 return get_stream_path_elements(fl_params, fh);
+               }));
+  print_result("file_layout", time_path_formatting(config, fragment_headers, [&](const FragmentHeader& fh) {
+                 return file_layout.get_path_elements(fh);
+               }));
+  print_result("dataset_path_builder",
+               time_path_formatting(config, fragment_headers, [&](const FragmentHeader& fh) -> auto const& {
+                 return path_builder.get_path_elements(fh);
+               }));
+
+  return 0;
+}
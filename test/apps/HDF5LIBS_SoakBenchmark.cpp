@@ -0,0 +1,231 @@
+/**
+ * @file HDF5LIBS_SoakBenchmark.cpp
+ *
+ * Writes many small TriggerRecords into a single file, as a writer that stays open for a
+ * whole run does, and reports at regular intervals the mean write time per record, the
+ * size of the HDF5 metadata cache and the resident memory of the process. With the
+ * metadata of the written records evicted, these should stay flat over the life of the file.
+ *
+ * This is part of the DUNE DAQ Software Suite, copyright 2020.
+ * Licensing/copyright details are in the COPYING file that you should have
+ * received with this code.
+ */
+
+#include "hdf5libs/HDF5RawDataFile.hpp"
+
+#include "detdataformats/DetID.hpp"
+#include "logging/Logging.hpp"
+
+#include <unistd.h>
+
+#include <algorithm>
+#include <chrono>
+#include <filesystem>
+#include <fstream>
+#include <iomanip>
+#include <memory>
+#include <sstream>
+#include <string>
+#include <utility>
+#include <vector>
+
+using namespace dunedaq::hdf5libs;
+using namespace dunedaq::daqdataformats;
+using namespace dunedaq::detdataformats;
+
+namespace {
+
+struct BenchmarkConfig
+{
+  std::string output_dir;
+  int record_count = 100000;
+  int report_interval = 10000;
+  int fragment_count = 10;
+  int fragment_size = 1000;
+};
+
+hdf5filelayout::FileLayoutParams
+create_file_layout_params()
+{
+  hdf5filelayout::PathParams params_tpc;
+  params_tpc.detector_group_type = "Detector_Readout";
+  params_tpc.detector_group_name = "TPC";
+  params_tpc.element_name_prefix = "Link";
+  params_tpc.digits_for_element_number = 5;
+
+  hdf5filelayout::FileLayoutParams layout_params;
+  layout_params.path_param_list.push_back(params_tpc);
+  layout_params.record_name_prefix = "TriggerRecord";
+  layout_params.digits_for_record_number = 6;
+  layout_params.digits_for_sequence_number = 4;
+  layout_params.record_header_dataset_name = "TriggerRecordHeader";
+  return layout_params;
+}
+
+std::unique_ptr<TriggerRecord>
+create_trigger_record(const BenchmarkConfig& config, int trig_num, std::vector<char> const& dummy_data)
+{
+  uint64_t ts = std::chrono::duration_cast<std::chrono::milliseconds>( // NOLINT(build/unsigned)
+                  system_clock::now().time_since_epoch())
+                  .count();
+
+  TriggerRecordHeaderData trh_data;
+  trh_data.trigger_number = trig_num;
+  trh_data.trigger_timestamp = ts;
+  trh_data.num_requested_components = config.fragment_count;
+  trh_data.run_number = 1;
+  trh_data.sequence_number = 0;
+  trh_data.max_sequence_number = 1;
+  trh_data.element_id = SourceID(SourceID::Subsystem::kTRBuilder, 0);
+
+  TriggerRecordHeader trh(&trh_data);
+  auto tr_ptr = std::make_unique<TriggerRecord>(trh);
+
+  for (int ele_num = 0; ele_num < config.fragment_count; ++ele_num) {
+    FragmentHeader fh;
+    fh.trigger_number = trig_num;
+    fh.trigger_timestamp = ts;
+    fh.window_begin = ts - 10;
+    fh.window_end = ts;
+    fh.run_number = 1;
+    fh.fragment_type = static_cast<fragment_type_t>(FragmentType::kWIB);
+    fh.sequence_number = 0;
+    fh.detector_id = static_cast<uint16_t>(DetID::Subdetector::kHD_TPC);
+    fh.element_id = SourceID(SourceID::Subsystem::kDetectorReadout, ele_num);
+
+    auto frag_ptr = std::make_unique<Fragment>(dummy_data.data(), dummy_data.size());
+    frag_ptr->set_header_fields(fh);
+    tr_ptr->add_fragment(std::move(frag_ptr));
+  }
+  return tr_ptr;
+}
+
+// resident memory of the process, from the second field of /proc/self/statm
+size_t
+get_resident_bytes()
+{
+  std::ifstream statm("/proc/self/statm");
+  size_t total_pages = 0;
+  size_t resident_pages = 0;
+  statm >> total_pages >> resident_pages;
+  return resident_pages * static_cast<size_t>(sysconf(_SC_PAGESIZE));
+}
+
+void
+print_interval(int records_written, double mean_write_us, const HDF5RawDataFile::MetadataCacheStatus& cache_status)
+{
+  std::ostringstream oss;
+  oss << std::fixed << std::setprecision(1) << std::setw(10) << records_written << " records" << std::setw(10)
+      << mean_write_us << " us/record" << std::setw(10) << (cache_status.current_size_bytes / 1.0e6) << " MB cache"
+      << std::setw(8) << cache_status.entry_count << " entries" << std::setprecision(3) << std::setw(7)
+      << cache_status.hit_rate << " hit rate" << std::setprecision(1) << std::setw(10)
+      << (get_resident_bytes() / 1.0e6) << " MB resident";
+  TLOG() << oss.str();
+}
+
+void
+run_benchmark(const BenchmarkConfig& config,
+              const std::string& label,
+              const hdf5filelayout::FileLayoutParams& fl_params,
+              const hdf5rawdatafile::WriterParams& writer_params)
+{
+  const std::string file_name = config.output_dir + "/hdf5libs_soak_benchmark_" + label + ".hdf5";
+  std::filesystem::remove(file_name);
+
+  auto h5file_ptr = std::make_unique<HDF5RawDataFile>(file_name,
+                                                      1, // run_number
+                                                      0, // file_index
+                                                      "HDF5LIBS_SoakBenchmark",
+                                                      fl_params,
+                                                      hdf5rawdatafile::SrcIDGeoIDMap(),
+                                                      ".writing",
+                                                      HighFive::File::Overwrite,
+                                                      writer_params);
+
+  // each record is built just before it is written, and only the writing is timed
+  std::vector<char> dummy_data(config.fragment_size);
+  std::chrono::steady_clock::duration interval_write_time{ 0 };
+  std::vector<double> interval_means_us;
+  for (int trig_num = 1; trig_num <= config.record_count; ++trig_num) {
+    auto tr_ptr = create_trigger_record(config, trig_num, dummy_data);
+    auto start_time = std::chrono::steady_clock::now();
+    h5file_ptr->write(*tr_ptr);
+    interval_write_time += std::chrono::steady_clock::now() - start_time;
+
+    if (trig_num % config.report_interval == 0 || trig_num == config.record_count) {
+      int interval_records = (trig_num % config.report_interval == 0) ? config.report_interval
+                                                                        : trig_num % config.report_interval;
+      double mean_write_us = std::chrono::duration<double, std::micro>(interval_write_time).count() / interval_records;
+      print_interval(trig_num, mean_write_us, h5file_ptr->get_metadata_cache_status());
+      interval_means_us.push_back(mean_write_us);
+      interval_write_time = std::chrono::steady_clock::duration{ 0 };
+    }
+  }
+  h5file_ptr.reset();
+
+  // a constant write cost keeps the ratio close to 1
+  if (!interval_means_us.empty()) {
+    std::ostringstream oss;
+    oss << std::fixed << std::setprecision(2) << "    last/first interval write time: "
+        << (interval_means_us.back() / interval_means_us.front());
+    TLOG() << oss.str();
+  }
+
+  std::filesystem::remove(file_name);
+}
+
+void
+print_usage()
+{
+  TLOG() << "Usage: HDF5LIBS_SoakBenchmark <output_directory> [record_count] [report_interval] "
+            "[fragments_per_record] [fragment_payload_bytes]";
+}
+
+} // namespace
+
+int
+main(int argc, char** argv)
+{
+  if (argc < 2 || argc > 6) {
+    print_usage();
+    return 1;
+  }
+
+  BenchmarkConfig config;
+  config.output_dir = argv[1];
+  if (argc > 2)
+    config.record_count = std::stoi(argv[2]);
+  if (argc > 3)
+    config.report_interval = std::max(std::stoi(argv[3]), 1);
+  if (argc > 4)
+    config.fragment_count = std::stoi(argv[4]);
+  if (argc > 5)
+    config.fragment_size = std::stoi(argv[5]);
+  config.fragment_size += sizeof(FragmentHeader);
+
+  TLOG() << "Writing " << config.record_count << " records of " << config.fragment_count << " fragments of "
+         << config.fragment_size << " bytes (incl. header) into one file in " << config.output_dir;
+
+  const auto fl_params = create_file_layout_params();
+
+  std::vector<std::pair<std::string, hdf5rawdatafile::WriterParams>> cache_configs;
+  {
+    hdf5rawdatafile::WriterParams writer_params;
+    writer_params.evict_on_close = false;
+    cache_configs.emplace_back("no_eviction", writer_params);
+  }
+  cache_configs.emplace_back("evict_on_close", hdf5rawdatafile::WriterParams());
+  {
+    hdf5rawdatafile::WriterParams writer_params;
+    writer_params.metadata_cache_max_bytes = 4 * 1024 * 1024;
+    writer_params.metadata_cache_initial_bytes = 1024 * 1024;
+    cache_configs.emplace_back("evict_on_close_4MiB_cache", writer_params);
+  }
+
+  for (auto const& [label, writer_params] : cache_configs) {
+    TLOG() << "--- " << label << " ---";
+    run_benchmark(config, label, fl_params, writer_params);
+  }
+
+  return 0;
+}
@@ -0,0 +1,352 @@
+/**
+ * @file HDF5LIBS_WriteBenchmark.cpp
+ *
+ * Measures the write throughput of HDF5RawDataFile for the different
+ * flush policies, compression settings and in-memory staging, using synthetic TriggerRecords
+ * like the ones that are produced by HDF5LIBS_TestWriter.
+ *
+ * This is part of the DUNE DAQ Software Suite, copyright 2020.
+ * Licensing/copyright details are in the COPYING file that you should have
+ * received with this code.
+ */
+
+#include "hdf5libs/HDF5RawDataFile.hpp"
+
+#include "detdataformats/DetID.hpp"
+#include "logging/Logging.hpp"
+
+#include <chrono>
+#include <filesystem>
+#include <iomanip>
+#include <iostream>
+#include <memory>
+#include <random>
+#include <sstream>
+#include <string>
+#include <utility>
+#include <vector>
+
+using namespace dunedaq::hdf5libs;
+using namespace dunedaq::daqdataformats;
+using namespace dunedaq::detdataformats;
+
+namespace {
+
+struct BenchmarkConfig
+{
+  std::string output_dir;
+  int record_count = 100;
+  int fragment_count = 100;
+  int fragment_size = 10000;
+  // fraction of the payload bytes that are pseudo-random, the others being zero: 0 gives payloads that
+  // compress to almost nothing, 1 payloads that do not compress at all
+  double payload_random_fraction = 0.5;
+};
+
+struct BenchmarkResult
+{
+  double write_seconds = 0;
+  double close_seconds = 0;
+  size_t recorded_size = 0;
+  HDF5RawDataFile::PipelineStageTimings timings;
+  WriteStatistics statistics;
+};
+
+hdf5filelayout::FileLayoutParams
+create_file_layout_params()
+{
+  hdf5filelayout::PathParams params_tpc;
+  params_tpc.detector_group_type = "Detector_Readout";
+  params_tpc.detector_group_name = "TPC";
+  params_tpc.element_name_prefix = "Link";
+  params_tpc.digits_for_element_number = 5;
+
+  hdf5filelayout::FileLayoutParams layout_params;
+  layout_params.path_param_list.push_back(params_tpc);
+  layout_params.record_name_prefix = "TriggerRecord";
+  layout_params.digits_for_record_number = 6;
+  layout_params.digits_for_sequence_number = 4;
+  layout_params.record_header_dataset_name = "TriggerRecordHeader";
+  return layout_params;
+}
+
+std::vector<char>
+create_payload(const BenchmarkConfig& config)
+{
+  // a fixed seed, so that all the configurations write the same data
+  std::mt19937 generator(12345);
+  std::bernoulli_distribution is_random(config.payload_random_fraction);
+  std::uniform_int_distribution<int> random_byte(0, 255);
+
+  std::vector<char> payload(config.fragment_size);
+  for (auto& byte : payload)
+    byte = is_random(generator) ? static_cast<char>(random_byte(generator)) : 0;
+  return payload;
+}
+
+std::unique_ptr<TriggerRecord>
+create_trigger_record(const BenchmarkConfig& config, int trig_num, std::vector<char> const& dummy_data)
+{
+  uint64_t ts = std::chrono::duration_cast<std::chrono::milliseconds>( // NOLINT(build/unsigned)
+                  system_clock::now().time_since_epoch())
+                  .count();
+
+  TriggerRecordHeaderData trh_data;
+  trh_data.trigger_number = trig_num;
+  trh_data.trigger_timestamp = ts;
+  trh_data.num_requested_components = config.fragment_count;
+  trh_data.run_number = 1;
+  trh_data.sequence_number = 0;
+  trh_data.max_sequence_number = 1;
+  trh_data.element_id = SourceID(SourceID::Subsystem::kTRBuilder, 0);
+
+  TriggerRecordHeader trh(&trh_data);
+  auto tr_ptr = std::make_unique<TriggerRecord>(trh);
+
+  for (int ele_num = 0; ele_num < config.fragment_count; ++ele_num) {
+    FragmentHeader fh;
+    fh.trigger_number = trig_num;
+    fh.trigger_timestamp = ts;
+    fh.window_begin = ts - 10;
+    fh.window_end = ts;
+    fh.run_number = 1;
+    fh.fragment_type = static_cast<fragment_type_t>(FragmentType::kWIB);
+    fh.sequence_number = 0;
+    fh.detector_id = static_cast<uint16_t>(DetID::Subdetector::kHD_TPC);
+    fh.element_id = SourceID(SourceID::Subsystem::kDetectorReadout, ele_num);
+
+    auto frag_ptr = std::make_unique<Fragment>(dummy_data.data(), dummy_data.size());
+    frag_ptr->set_header_fields(fh);
+    tr_ptr->add_fragment(std::move(frag_ptr));
+  }
+  return tr_ptr;
+}
+
+BenchmarkResult
+run_benchmark(const BenchmarkConfig& config,
+              const std::string& label,
+              const hdf5filelayout::FileLayoutParams& fl_params,
+              const hdf5rawdatafile::WriterParams& writer_params)
+{
+  const std::string file_name = config.output_dir + "/hdf5libs_write_benchmark_" + label + ".hdf5";
+  std::filesystem::remove(file_name);
+
+  // the records are built up front, so that only the writing is timed
+  std::vector<char> dummy_data = create_payload(config);
+  std::vector<std::unique_ptr<TriggerRecord>> records;
+  for (int trig_num = 1; trig_num <= config.record_count; ++trig_num)
+    records.push_back(create_trigger_record(config, trig_num, dummy_data));
+
+  BenchmarkResult result;
+  auto start_time = std::chrono::steady_clock::now();
+  auto h5file_ptr = std::make_unique<HDF5RawDataFile>(file_name,
+                                                      1, // run_number
+                                                      0, // file_index
+                                                      "HDF5LIBS_WriteBenchmark",
+                                                      fl_params,
+                                                      hdf5rawdatafile::SrcIDGeoIDMap(),
+                                                      ".writing",
+                                                      HighFive::File::Overwrite,
+                                                      writer_params);
+  for (auto const& tr_ptr : records)
+    h5file_ptr->write(*tr_ptr);
+  auto write_done_time = std::chrono::steady_clock::now();
+  result.recorded_size = h5file_ptr->get_recorded_size();
+  result.timings = h5file_ptr->get_pipeline_stage_timings();
+  h5file_ptr->finalize();
+  auto close_done_time = std::chrono::steady_clock::now();
+  result.statistics = h5file_ptr->get_write_statistics();
+  h5file_ptr.reset();
+
+  result.write_seconds = std::chrono::duration<double>(write_done_time - start_time).count();
+  result.close_seconds = std::chrono::duration<double>(close_done_time - write_done_time).count();
+
+  std::filesystem::remove(file_name);
+  return result;
+}
+
+void
+print_result(const BenchmarkConfig& config, const std::string& label, const BenchmarkResult& result)
+{
+  double total_seconds = result.write_seconds + result.close_seconds;
+  std::ostringstream oss;
+  oss << std::left << std::setw(28) << label << std::right << std::fixed << std::setprecision(1) << std::setw(12)
+      << (config.record_count / total_seconds) << " records/s" << std::setw(12)
+      << (result.recorded_size / total_seconds / 1.0e6) << " MB/s" << std::setprecision(3) << std::setw(10)
+      << result.close_seconds << " s close";
+  TLOG() << oss.str();
+}
+
+void
+print_stage_timings(const BenchmarkResult& result)
+{
+  auto const& timings = result.timings;
+  std::ostringstream oss;
+  oss << std::fixed << std::setprecision(3) << "    compression " << timings.compression_seconds
+      << " s (thread total), wait " << timings.compression_wait_seconds << " s, write " << timings.write_seconds
+      << " s";
+  if (timings.compression_input_bytes > 0)
+    oss << ", ratio " << std::setprecision(2)
+        << (static_cast<double>(timings.compression_input_bytes) / timings.compression_output_bytes);
+  TLOG() << oss.str();
+}
+
+void
+print_phase_latencies(const BenchmarkResult& result)
+{
+  const std::vector<std::pair<WritePhase, std::string>> phases = { { WritePhase::kGroupCreation, "group" },
+                                                                   { WritePhase::kDatasetCreation, "dataset" },
+                                                                   { WritePhase::kRawWrite, "write" },
+                                                                   { WritePhase::kFlush, "flush" },
+                                                                   { WritePhase::kAttributeStore, "attributes" },
+                                                                   { WritePhase::kPreallocation, "prealloc" },
+                                                                   { WritePhase::kFileImageWrite, "image" },
+                                                                   { WritePhase::kRecordDirectory, "directory" } };
+  std::ostringstream oss;
+  oss << std::fixed << std::setprecision(1) << "    p50/p99 us:";
+  for (auto const& [phase, phase_name] : phases) {
+    auto const& latency = result.statistics.get_phase_latency_ns(phase);
+    if (latency.count == 0)
+      continue;
+    oss << " " << phase_name << " " << (latency.get_quantile(0.5) / 1.0e3) << "/"
+        << (latency.get_quantile(0.99) / 1.0e3);
+  }
+  oss << ", slowest record " << result.statistics.slowest_record.record_number << " ("
+      << (result.statistics.slowest_record.write_time_ns / 1.0e6) << " ms)";
+  TLOG() << oss.str();
+}
+
+void
+print_file_image_write(const BenchmarkResult& result)
+{
+  auto const& image_write_time = result.statistics.get_phase_latency_ns(WritePhase::kFileImageWrite);
+  std::ostringstream oss;
+  oss << std::fixed << std::setprecision(1) << "    " << image_write_time.count << " image writes, "
+      << (result.statistics.file_image_bytes / 1.0e6) << " MB";
+  if (image_write_time.sum > 0)
+    oss << " at " << (result.statistics.file_image_bytes / (image_write_time.sum / 1.0e9) / 1.0e6) << " MB/s";
+  TLOG() << oss.str();
+}
+
+void
+print_usage()
+{
+  TLOG() << "Usage: HDF5LIBS_WriteBenchmark <output_directory> [record_count] [fragments_per_record] "
+            "[fragment_payload_bytes] [payload_random_fraction]";
+}
+
+} // namespace
+
+int
+main(int argc, char** argv)
+{
+  if (argc < 2 || argc > 6) {
+    print_usage();
+    return 1;
+  }
+
+  BenchmarkConfig config;
+  config.output_dir = argv[1];
+  if (argc > 2)
+    config.record_count = std::stoi(argv[2]);
+  if (argc > 3)
+    config.fragment_count = std::stoi(argv[3]);
+  if (argc > 4)
+    config.fragment_size = std::stoi(argv[4]) + sizeof(FragmentHeader);
+  if (argc > 5)
+    config.payload_random_fraction = std::stod(argv[5]);
+  if (config.payload_random_fraction < 0 || config.payload_random_fraction > 1) {
+    print_usage();
+    return 1;
+  }
+
+  TLOG() << "Writing " << config.record_count << " records of " << config.fragment_count << " fragments of "
+         << config.fragment_size << " bytes (incl. header, " << config.payload_random_fraction
+         << " of them random) to " << config.output_dir;
+
+  const auto fl_params = create_file_layout_params();
+
+  // flush policies
+  std::vector<std::pair<std::string, hdf5rawdatafile::WriterParams>> flush_configs;
+  for (auto const& policy : { "per_dataset", "per_record", "on_close" }) {
+    hdf5rawdatafile::WriterParams writer_params;
+    writer_params.flush_policy = policy;
+    flush_configs.emplace_back(policy, writer_params);
+  }
+  {
+    hdf5rawdatafile::WriterParams writer_params;
+    writer_params.flush_policy = "every_n_records";
+    writer_params.flush_interval_records = 10;
+    flush_configs.emplace_back("every_10_records", writer_params);
+  }
+  {
+    hdf5rawdatafile::WriterParams writer_params;
+    writer_params.flush_policy = "every_n_bytes";
+    writer_params.flush_interval_bytes = 64 * 1024 * 1024;
+    flush_configs.emplace_back("every_64MiB", writer_params);
+  }
+  {
+    hdf5rawdatafile::WriterParams writer_params;
+    writer_params.flush_policy = "time_interval";
+    writer_params.flush_interval_ms = 1000;
+    flush_configs.emplace_back("every_1000ms", writer_params);
+  }
+  {
+    hdf5rawdatafile::WriterParams writer_params;
+    writer_params.flush_policy = "on_close";
+    writer_params.preallocation_extent_bytes = 64 * 1024 * 1024;
+    flush_configs.emplace_back("on_close_prealloc_64MiB", writer_params);
+  }
+
+  TLOG() << "--- flush policy ---";
+  for (auto const& [label, writer_params] : flush_configs) {
+    auto result = run_benchmark(config, "flush_" + label, fl_params, writer_params);
+    print_result(config, label, result);
+    print_phase_latencies(result);
+  }
+
+  // files built in memory and written to disk at once, compared with writing on disk
+  std::vector<std::pair<std::string, hdf5rawdatafile::WriterParams>> staging_configs;
+  {
+    hdf5rawdatafile::WriterParams writer_params;
+    writer_params.flush_policy = "on_close";
+    staging_configs.emplace_back("on_disk", writer_params);
+  }
+  const size_t data_size = static_cast<size_t>(config.record_count) * config.fragment_count * config.fragment_size;
+  for (bool direct_io : { false, true }) {
+    hdf5rawdatafile::WriterParams writer_params;
+    writer_params.flush_policy = "on_close";
+    writer_params.core_staging_max_bytes = 2 * data_size + 64 * 1024 * 1024;
+    writer_params.core_staging_direct_io = direct_io;
+    staging_configs.emplace_back(direct_io ? "core_direct_io" : "core", writer_params);
+  }
+  {
+    hdf5rawdatafile::WriterParams writer_params;
+    writer_params.flush_policy = "on_close";
+    writer_params.core_staging_max_bytes = data_size / 4;
+    staging_configs.emplace_back("core_spill_at_quarter", writer_params);
+  }
+
+  TLOG() << "--- in-memory staging ---";
+  for (auto const& [label, writer_params] : staging_configs) {
+    auto result = run_benchmark(config, "staging_" + label, fl_params, writer_params);
+    print_result(config, label, result);
+    print_file_image_write(result);
+  }
+
+  // compression in the HDF5 filter pipeline, and on compression threads ahead of the writing
+  auto compressed_fl_params = fl_params;
+  compressed_fl_params.path_param_list[0].deflate_level = 4;
+
+  TLOG() << "--- compression ---";
+  for (int thread_count : { 0, 1, 2, 4, 8 }) {
+    hdf5rawdatafile::WriterParams writer_params;
+    writer_params.compression_thread_count = thread_count;
+    std::string label = "deflate_" + std::to_string(thread_count) + "_threads";
+    auto result = run_benchmark(config, label, compressed_fl_params, writer_params);
+    print_result(config, label, result);
+    print_stage_timings(result);
+  }
+
+  return 0;
+}
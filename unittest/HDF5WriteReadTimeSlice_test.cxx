@@ -508,4 +508,56 @@ BOOST_AUTO_TEST_CASE(ReadFileMaxSequence)
   delete_files_matching_pattern(file_path, hdf5_filename);
 }
 
+BOOST_AUTO_TEST_CASE(BucketedRecords)
+{
+  std::string file_path(std::filesystem::temp_directory_path());
+  std::string hdf5_filename = "demo" + std::to_string(getpid()) + "_" + std::string(getenv("USER")) + ".hdf5";
+  const int timeslice_count = 25;
+
+  // delete any pre-existing files so that we start with a clean slate
+  delete_files_matching_pattern(file_path, hdf5_filename);
+
+  // the timeslices are put in groups of 10 record numbers
+  auto fl_pars = create_file_layout_params();
+  fl_pars.records_per_bucket = 10;
+  std::unique_ptr<HDF5RawDataFile> h5file_ptr(new HDF5RawDataFile(
+    file_path + "/" + hdf5_filename, run_number, file_index, application_name, fl_pars, create_srcid_geoid_map()));
+  for (int timeslice_number = 1; timeslice_number <= timeslice_count; ++timeslice_number)
+    h5file_ptr->write(create_timeslice(timeslice_number));
+  h5file_ptr.reset(); // explicit destruction
+
+  // the root group holds the bucket groups, and the records are found without the record directory as well
+  {
+    HighFive::File h5file(file_path + "/" + hdf5_filename, HighFive::File::ReadWrite);
+    BOOST_REQUIRE(h5file.exist("TimeSliceBucket000000/TimeSlice000001"));
+    BOOST_REQUIRE(h5file.exist("TimeSliceBucket000010/TimeSlice000010"));
+    BOOST_REQUIRE(h5file.exist("TimeSliceBucket000020/TimeSlice000025"));
+    BOOST_REQUIRE(!h5file.exist("TimeSlice000001"));
+    BOOST_REQUIRE_EQUAL(h5file.getGroup("TimeSliceBucket000010").getNumberObjects(), 10);
+    h5file.getGroup("FileLevel").unlink("RecordDirectory");
+  }
+
+  // open file for reading now
+  h5file_ptr.reset(new HDF5RawDataFile(file_path + "/" + hdf5_filename));
+  BOOST_REQUIRE_EQUAL(h5file_ptr->get_version(), 9);
+  BOOST_REQUIRE_EQUAL(h5file_ptr->get_file_layout().get_record_number_string(12),
+                      "TimeSliceBucket000010/TimeSlice000012");
+
+  auto timeslices = h5file_ptr->get_all_timeslice_numbers();
+  BOOST_REQUIRE_EQUAL(timeslice_count, timeslices.size());
+  BOOST_REQUIRE_EQUAL(1, *timeslices.begin());
+  BOOST_REQUIRE_EQUAL(timeslice_count, *timeslices.rbegin());
+  BOOST_REQUIRE_EQUAL(timeslice_count * (1 + components_per_record), h5file_ptr->get_dataset_paths().size());
+
+  for (int timeslice_number : { 1, 10, 25 }) {
+    auto timeslice = h5file_ptr->get_timeslice(timeslice_number);
+    BOOST_REQUIRE_EQUAL(timeslice.get_header().timeslice_number, timeslice_number);
+    BOOST_REQUIRE_EQUAL(timeslice.get_fragments_ref().size(), components_per_record);
+  }
+  h5file_ptr.reset();
+
+  // clean up the files that were created
+  delete_files_matching_pattern(file_path, hdf5_filename);
+}
+
 BOOST_AUTO_TEST_SUITE_END()
@@ -8,6 +8,8 @@
  */
 
 #include "hdf5libs/HDF5RawDataFile.hpp"
+#include "hdf5libs/HDF5RawDataFileSequence.hpp"
+#include "hdf5libs/HDF5StripedRawDataFile.hpp"
 #include "hdf5libs/hdf5filelayout/Structs.hpp"
 #include "hdf5libs/hdf5filelayout/Nljs.hpp"
 #include "hdf5libs/hdf5rawdatafile/Structs.hpp"
@@ -19,13 +21,23 @@
 
 #include "boost/test/unit_test.hpp"
 
+#include <sys/stat.h>
+#include <sys/wait.h>
+#include <unistd.h>
+
+#include <algorithm>
+#include <atomic>
+#include <chrono>
 #include <cstdlib>
 #include <filesystem>
 #include <fstream>
+#include <future>
 #include <iostream>
 #include <memory>
+#include <mutex>
 #include <regex>
 #include <string>
+#include <thread>
 #include <utility>
 #include <vector>
 
@@ -318,6 +330,70 @@ create_trigger_record(uint64_t trig_num)
   return tr;
 }
 
+// keeps the Fragments that are handed back after writing
+class CollectingFragmentBufferPool : public FragmentBufferPool
+{
+public:
+  void release(std::unique_ptr<dunedaq::daqdataformats::Fragment> frag_ptr) override
+  {
+    std::lock_guard<std::mutex> lk(m_mutex);
+    m_fragments.push_back(std::move(frag_ptr));
+  }
+
+  size_t get_fragment_count()
+  {
+    std::lock_guard<std::mutex> lk(m_mutex);
+    return m_fragments.size();
+  }
+
+private:
+  std::mutex m_mutex;
+  std::vector<std::unique_ptr<dunedaq::daqdataformats::Fragment>> m_fragments;
+};
+
+// Follows a file that another process writes, as a monitoring application does. Each step starts when the writer
+// sends a byte on step_fd, and sends back whether its checks passed on result_fd. Returns 0 if all of them did.
+int
+follow_live_file(const std::string& file_name, int trigger_count, int step_fd, int result_fd)
+{
+  char step = 0;
+  auto report = [result_fd](bool passed) {
+    char result = passed ? 1 : 0;
+    return write(result_fd, &result, 1) == 1 && passed;
+  };
+  const size_t record_count = trigger_count;
+  try {
+    // the writer has written the first two records
+    if (read(step_fd, &step, 1) != 1)
+      return 1;
+    HDF5RawDataFile h5reader(file_name, true);
+    if (!report(h5reader.is_being_written() && h5reader.get_all_trigger_record_ids().size() == 2))
+      return 1;
+
+    // the writer has written the other records
+    if (read(step_fd, &step, 1) != 1)
+      return 2;
+    bool passed = h5reader.refresh() == record_count - 2 &&
+                  h5reader.get_all_trigger_record_ids().size() == record_count &&
+                  h5reader.get_record_directory().back().record_number == record_count &&
+                  h5reader.get_frag_ptr(trigger_count, 0, "Detector_Readout", 0)->get_trigger_number() == record_count;
+    if (!report(passed))
+      return 2;
+
+    // the writer has closed the file
+    if (read(step_fd, &step, 1) != 1)
+      return 3;
+    passed = h5reader.refresh() == 0 && !h5reader.is_being_written() &&
+             h5reader.get_all_trigger_record_ids().size() == record_count &&
+             h5reader.get_attribute<size_t>("recorded_size") == h5reader.get_recorded_size();
+    if (!report(passed))
+      return 3;
+  } catch (std::exception const&) {
+    return 4;
+  }
+  return 0;
+}
+
 BOOST_AUTO_TEST_SUITE(HDF5WriteReadTriggerRecord_test)
 
 BOOST_AUTO_TEST_CASE(WriteFileAndAttributes)
@@ -360,10 +436,12 @@ BOOST_AUTO_TEST_CASE(WriteFileAndAttributes)
   auto run_number_attr = h5file_ptr->get_attribute<size_t>("run_number");
   auto file_index_attr = h5file_ptr->get_attribute<size_t>("file_index");
   auto app_name_attr = h5file_ptr->get_attribute<std::string>("application_name");
+  auto flush_policy_attr = h5file_ptr->get_attribute<std::string>("flush_policy");
   BOOST_REQUIRE_EQUAL(recorded_size_at_write, recorded_size_attr);
   BOOST_REQUIRE_EQUAL(run_number, run_number_attr);
   BOOST_REQUIRE_EQUAL(file_index, file_index_attr);
   BOOST_REQUIRE_EQUAL(application_name, app_name_attr);
+  BOOST_REQUIRE_EQUAL("per_dataset", flush_policy_attr);
 
   // extract and check file layout parameters
   auto file_layout_parameters_read = h5file_ptr->get_file_layout().get_file_layout_params();
@@ -608,4 +686,1592 @@ BOOST_AUTO_TEST_CASE(LargeTriggerRecordNumbers)
   delete_files_matching_pattern(file_path, hdf5_filename);
 }
 
+BOOST_AUTO_TEST_CASE(AsyncWrite)
+{
+  std::string file_path(std::filesystem::temp_directory_path());
+  std::string hdf5_filename = "demo" + std::to_string(getpid()) + "_" + std::string(getenv("USER")) + ".hdf5";
+  const int trigger_count = 10;
+
+  // delete any pre-existing files so that we start with a clean slate
+  delete_files_matching_pattern(file_path, hdf5_filename);
+
+  hdf5rawdatafile::WriterParams writer_params;
+  writer_params.async_write_queue_depth = 3;
+
+  // create the file
+  std::unique_ptr<HDF5RawDataFile> h5file_ptr(new HDF5RawDataFile(file_path + "/" + hdf5_filename,
+                                                                  run_number,
+                                                                  file_index,
+                                                                  application_name,
+                                                                  create_file_layout_params(),
+                                                                  create_srcid_geoid_map(),
+                                                                  ".writing",
+                                                                  HighFive::File::Create,
+                                                                  writer_params));
+  BOOST_REQUIRE(h5file_ptr->is_async());
+  BOOST_REQUIRE_EQUAL(h5file_ptr->get_write_queue_capacity(), 3);
+
+  // queue the first half of the records and wait for them to complete
+  std::vector<std::future<void>> completions;
+  for (int trigger_number = 1; trigger_number <= trigger_count / 2; ++trigger_number) {
+    auto tr_ptr = std::make_unique<dunedaq::daqdataformats::TriggerRecord>(create_trigger_record(trigger_number));
+    completions.push_back(h5file_ptr->write_async(std::move(tr_ptr)));
+  }
+  for (auto& completion : completions)
+    completion.get();
+  BOOST_REQUIRE(h5file_ptr->get_recorded_size() > 0);
+
+  // the second half uses the non-blocking interface; records that do not fit stay with us
+  for (int trigger_number = trigger_count / 2 + 1; trigger_number <= trigger_count; ++trigger_number) {
+    auto tr_ptr = std::make_unique<dunedaq::daqdataformats::TriggerRecord>(create_trigger_record(trigger_number));
+    std::future<void> completion;
+    while (!h5file_ptr->try_write_async(tr_ptr, completion)) {
+      BOOST_REQUIRE(tr_ptr != nullptr);
+      std::this_thread::sleep_for(std::chrono::milliseconds(1));
+    }
+    BOOST_REQUIRE(tr_ptr == nullptr);
+  }
+
+  // the destructor drains the queue before closing the file
+  h5file_ptr.reset();
+
+  // open file for reading now
+  h5file_ptr.reset(new HDF5RawDataFile(file_path + "/" + hdf5_filename));
+  BOOST_REQUIRE(!h5file_ptr->is_async());
+
+  auto trigger_record_ids = h5file_ptr->get_all_trigger_record_ids();
+  BOOST_REQUIRE_EQUAL(trigger_count, trigger_record_ids.size());
+
+  auto all_frag_paths = h5file_ptr->get_all_fragment_dataset_paths();
+  BOOST_REQUIRE_EQUAL(trigger_count * components_per_record, all_frag_paths.size());
+
+  auto record = h5file_ptr->get_trigger_record(trigger_count, 0);
+  BOOST_REQUIRE_EQUAL(record.get_header_ref().get_trigger_number(), trigger_count);
+  BOOST_REQUIRE_EQUAL(record.get_fragments_ref().size(), components_per_record);
+
+  // clean up the files that were created
+  delete_files_matching_pattern(file_path, hdf5_filename);
+}
+
+BOOST_AUTO_TEST_CASE(FragmentBufferHandBack)
+{
+  std::string file_path(std::filesystem::temp_directory_path());
+  std::string hdf5_filename = "demo" + std::to_string(getpid()) + "_" + std::string(getenv("USER")) + ".hdf5";
+  const int trigger_count = 6;
+
+  // delete any pre-existing files so that we start with a clean slate
+  delete_files_matching_pattern(file_path, hdf5_filename);
+
+  hdf5rawdatafile::WriterParams writer_params;
+  writer_params.async_write_queue_depth = 2;
+
+  // create the file
+  std::unique_ptr<HDF5RawDataFile> h5file_ptr(new HDF5RawDataFile(file_path + "/" + hdf5_filename,
+                                                                  run_number,
+                                                                  file_index,
+                                                                  application_name,
+                                                                  create_file_layout_params(),
+                                                                  create_srcid_geoid_map(),
+                                                                  ".writing",
+                                                                  HighFive::File::Create,
+                                                                  writer_params));
+
+  CollectingFragmentBufferPool buffer_pool;
+
+  // synchronous writes hand the fragments back before returning
+  for (int trigger_number = 1; trigger_number <= trigger_count / 2; ++trigger_number) {
+    auto tr_ptr = std::make_unique<dunedaq::daqdataformats::TriggerRecord>(create_trigger_record(trigger_number));
+    h5file_ptr->write(std::move(tr_ptr), buffer_pool);
+    BOOST_REQUIRE_EQUAL(buffer_pool.get_fragment_count(), trigger_number * components_per_record);
+  }
+
+  // asynchronous writes hand them back by the time that the record is complete
+  std::vector<std::future<void>> completions;
+  for (int trigger_number = trigger_count / 2 + 1; trigger_number <= trigger_count; ++trigger_number) {
+    auto tr_ptr = std::make_unique<dunedaq::daqdataformats::TriggerRecord>(create_trigger_record(trigger_number));
+    completions.push_back(h5file_ptr->write_async(std::move(tr_ptr), buffer_pool));
+  }
+  for (auto& completion : completions)
+    completion.get();
+  h5file_ptr->drain();
+  BOOST_REQUIRE_EQUAL(buffer_pool.get_fragment_count(), trigger_count * components_per_record);
+
+  h5file_ptr.reset(); // explicit destruction
+
+  // open file for reading now
+  h5file_ptr.reset(new HDF5RawDataFile(file_path + "/" + hdf5_filename));
+  BOOST_REQUIRE_EQUAL(h5file_ptr->get_all_trigger_record_ids().size(), trigger_count);
+  auto frag_ptr = h5file_ptr->get_frag_ptr(trigger_count, 0, "Detector_Readout", 2);
+  BOOST_REQUIRE_EQUAL(frag_ptr->get_trigger_number(), trigger_count);
+  BOOST_REQUIRE_EQUAL(frag_ptr->get_data_size(), fragment_size);
+
+  // clean up the files that were created
+  delete_files_matching_pattern(file_path, hdf5_filename);
+}
+
+BOOST_AUTO_TEST_CASE(CompactDatasets)
+{
+  std::string file_path(std::filesystem::temp_directory_path());
+  std::string hdf5_filename = "demo" + std::to_string(getpid()) + "_" + std::string(getenv("USER")) + ".hdf5";
+  const int trigger_count = 3;
+  const size_t fragment_dataset_size = sizeof(dunedaq::daqdataformats::FragmentHeader) + fragment_size;
+
+  // fragments at the threshold are compact, and larger ones are not
+  for (size_t threshold : { fragment_dataset_size, fragment_dataset_size - 1 }) {
+    // delete any pre-existing files so that we start with a clean slate
+    delete_files_matching_pattern(file_path, hdf5_filename);
+
+    auto fl_pars = create_file_layout_params();
+    fl_pars.compact_dataset_threshold_bytes = threshold;
+
+    // create the file
+    std::unique_ptr<HDF5RawDataFile> h5file_ptr(new HDF5RawDataFile(file_path + "/" + hdf5_filename,
+                                                                    run_number,
+                                                                    file_index,
+                                                                    application_name,
+                                                                    fl_pars,
+                                                                    create_srcid_geoid_map()));
+    for (int trigger_number = 1; trigger_number <= trigger_count; ++trigger_number)
+      h5file_ptr->write(create_trigger_record(trigger_number));
+    h5file_ptr.reset(); // explicit destruction
+
+    // compact datasets are read like any other
+    h5file_ptr.reset(new HDF5RawDataFile(file_path + "/" + hdf5_filename));
+    auto frag_ptr = h5file_ptr->get_frag_ptr(2, 0, "Detector_Readout", 2);
+    BOOST_REQUIRE_EQUAL(frag_ptr->get_trigger_number(), 2);
+    BOOST_REQUIRE_EQUAL(frag_ptr->get_size(), fragment_dataset_size);
+    auto record = h5file_ptr->get_trigger_record(trigger_count, 0);
+    BOOST_REQUIRE_EQUAL(record.get_fragments_ref().size(), components_per_record);
+    std::string dataset_path = h5file_ptr->get_fragment_dataset_paths(std::make_pair(1, 0)).front();
+    h5file_ptr.reset();
+
+    HighFive::File h5file(file_path + "/" + hdf5_filename, HighFive::File::ReadOnly);
+    auto create_props = h5file.getDataSet(dataset_path).getCreatePropertyList();
+    H5D_layout_t expected_layout = (threshold >= fragment_dataset_size) ? H5D_COMPACT : H5D_CONTIGUOUS;
+    BOOST_REQUIRE_EQUAL(H5Pget_layout(create_props.getId()), expected_layout);
+  }
+
+  // clean up the files that were created
+  delete_files_matching_pattern(file_path, hdf5_filename);
+}
+
+BOOST_AUTO_TEST_CASE(RecordLayoutDictionary)
+{
+  std::string file_path(std::filesystem::temp_directory_path());
+  std::string hdf5_filename = "demo" + std::to_string(getpid()) + "_" + std::string(getenv("USER")) + ".hdf5";
+  std::string reference_filename = "reference_" + hdf5_filename;
+  const int trigger_count = 5;
+
+  // delete any pre-existing files so that we start with a clean slate
+  delete_files_matching_pattern(file_path, ".*" + hdf5_filename);
+
+  // the same records, with the maps on each record and in the record layout dictionary
+  for (bool record_layout_dictionary : { false, true }) {
+    auto fl_pars = create_file_layout_params();
+    fl_pars.record_layout_dictionary = record_layout_dictionary;
+    std::unique_ptr<HDF5RawDataFile> h5file_ptr(
+      new HDF5RawDataFile(file_path + "/" + (record_layout_dictionary ? hdf5_filename : reference_filename),
+                          run_number,
+                          file_index,
+                          application_name,
+                          fl_pars,
+                          create_srcid_geoid_map()));
+    for (int trigger_number = 1; trigger_number <= trigger_count; ++trigger_number)
+      h5file_ptr->write(create_trigger_record(trigger_number));
+    h5file_ptr.reset(); // explicit destruction
+  }
+
+  // the records share a single record layout, and do not carry the maps themselves
+  {
+    HighFive::File h5file(file_path + "/" + hdf5_filename, HighFive::File::ReadOnly);
+    BOOST_REQUIRE_EQUAL(h5file.getGroup("FileLevel/RecordLayouts").getNumberObjects(), 1);
+    for (int trigger_number = 1; trigger_number <= trigger_count; ++trigger_number) {
+      auto record_group = h5file.getGroup("TriggerRecord00000" + std::to_string(trigger_number) + ".0000");
+      BOOST_REQUIRE(record_group.hasAttribute("record_layout_index"));
+      BOOST_REQUIRE(!record_group.hasAttribute("source_id_path_map"));
+    }
+  }
+
+  // the reader resolves the maps of the layout for each record
+  HDF5RawDataFile h5file(file_path + "/" + hdf5_filename);
+  HDF5RawDataFile reference_file(file_path + "/" + reference_filename);
+  BOOST_REQUIRE_EQUAL(h5file.get_version(), 8);
+  BOOST_REQUIRE_EQUAL(reference_file.get_version(), 7);
+  for (auto const& rid : reference_file.get_all_record_ids()) {
+    BOOST_REQUIRE(h5file.get_source_ids(rid) == reference_file.get_source_ids(rid));
+    BOOST_REQUIRE(h5file.get_record_header_source_id(rid) == reference_file.get_record_header_source_id(rid));
+    BOOST_REQUIRE(h5file.get_geo_ids(rid) == reference_file.get_geo_ids(rid));
+    BOOST_REQUIRE(h5file.get_fragment_dataset_paths(rid) == reference_file.get_fragment_dataset_paths(rid));
+    BOOST_REQUIRE_EQUAL(h5file.get_record_header_dataset_path(rid), reference_file.get_record_header_dataset_path(rid));
+    BOOST_REQUIRE(h5file.get_source_ids_for_fragment_type(rid, dunedaq::daqdataformats::FragmentType::kWIB) ==
+                  reference_file.get_source_ids_for_fragment_type(rid, dunedaq::daqdataformats::FragmentType::kWIB));
+    auto record = h5file.get_trigger_record(rid);
+    BOOST_REQUIRE_EQUAL(record.get_header_ref().get_trigger_number(), rid.first);
+    BOOST_REQUIRE_EQUAL(record.get_fragments_ref().size(), components_per_record);
+  }
+
+  // clean up the files that were created
+  delete_files_matching_pattern(file_path, ".*" + hdf5_filename);
+}
+
+BOOST_AUTO_TEST_CASE(CompressedDatasets)
+{
+  std::string file_path(std::filesystem::temp_directory_path());
+  std::string hdf5_filename = "demo" + std::to_string(getpid()) + "_" + std::string(getenv("USER")) + ".hdf5";
+  const int trigger_count = 5;
+
+  // delete any pre-existing files so that we start with a clean slate
+  delete_files_matching_pattern(file_path, hdf5_filename);
+
+  auto fl_pars = create_file_layout_params();
+  fl_pars.path_param_list[0].chunk_size_bytes = 64;
+  fl_pars.path_param_list[0].shuffle = true;
+  fl_pars.path_param_list[0].deflate_level = 4;
+
+  // create the file
+  std::unique_ptr<HDF5RawDataFile> h5file_ptr(new HDF5RawDataFile(file_path + "/" + hdf5_filename,
+                                                                  run_number,
+                                                                  file_index,
+                                                                  application_name,
+                                                                  fl_pars,
+                                                                  create_srcid_geoid_map()));
+
+  // write several events, each with several fragments, whose payloads are not all the same
+  auto payload_byte = [](int trigger_number, size_t idx) {
+    return static_cast<char>((trigger_number + 7 * idx) % 251);
+  };
+  for (int trigger_number = 1; trigger_number <= trigger_count; ++trigger_number) {
+    auto tr = create_trigger_record(trigger_number);
+    for (auto const& frag_ptr : tr.get_fragments_ref()) {
+      char* payload = static_cast<char*>(frag_ptr->get_data());
+      for (size_t idx = 0; idx < fragment_size; ++idx)
+        payload[idx] = payload_byte(trigger_number, idx);
+    }
+    h5file_ptr->write(tr);
+  }
+
+  h5file_ptr.reset(); // explicit destruction
+
+  // open file for reading now
+  h5file_ptr.reset(new HDF5RawDataFile(file_path + "/" + hdf5_filename));
+
+  auto file_layout_parameters_read = h5file_ptr->get_file_layout().get_file_layout_params();
+  BOOST_REQUIRE_EQUAL(file_layout_parameters_read.path_param_list[0].deflate_level, 4);
+
+  // the detector readout fragment datasets are chunked, and shuffled and deflated
+  auto frag_paths = h5file_ptr->get_fragment_dataset_paths(std::make_pair(3, 0), "Detector_Readout");
+  BOOST_REQUIRE(!frag_paths.empty());
+  {
+    HighFive::File h5file(file_path + "/" + hdf5_filename, HighFive::File::ReadOnly);
+    for (auto const& frag_path : frag_paths) {
+      hid_t create_plist = H5Dget_create_plist(h5file.getDataSet(frag_path).getId());
+      BOOST_REQUIRE_EQUAL(H5Pget_layout(create_plist), H5D_CHUNKED);
+      hsize_t chunk_dims[2] = { 0, 0 };
+      BOOST_REQUIRE_EQUAL(H5Pget_chunk(create_plist, 2, chunk_dims), 2);
+      BOOST_REQUIRE_EQUAL(chunk_dims[0], 64);
+      BOOST_REQUIRE_EQUAL(chunk_dims[1], 1);
+
+      BOOST_REQUIRE_EQUAL(H5Pget_nfilters(create_plist), 2);
+      unsigned filter_flags = 0;  // NOLINT(build/unsigned)
+      size_t value_count = 1;
+      unsigned deflate_level = 0; // NOLINT(build/unsigned)
+      BOOST_REQUIRE_EQUAL(H5Pget_filter2(create_plist, 0, &filter_flags, &value_count, &deflate_level, 0, nullptr,
+                                         nullptr), H5Z_FILTER_SHUFFLE);
+      value_count = 1;
+      BOOST_REQUIRE_EQUAL(H5Pget_filter2(create_plist, 1, &filter_flags, &value_count, &deflate_level, 0, nullptr,
+                                         nullptr), H5Z_FILTER_DEFLATE);
+      BOOST_REQUIRE_EQUAL(value_count, 1);
+      BOOST_REQUIRE_EQUAL(deflate_level, 4);
+      H5Pclose(create_plist);
+    }
+  }
+
+  // compressed fragments are decompressed transparently
+  auto frag_ptr = h5file_ptr->get_frag_ptr(3, 0, "Detector_Readout", 2);
+  BOOST_REQUIRE_EQUAL(frag_ptr->get_trigger_number(), 3);
+  BOOST_REQUIRE_EQUAL(frag_ptr->get_size(), sizeof(dunedaq::daqdataformats::FragmentHeader) + fragment_size);
+  const char* payload = static_cast<const char*>(frag_ptr->get_data());
+  for (size_t idx = 0; idx < fragment_size; ++idx)
+    BOOST_REQUIRE_EQUAL(payload[idx], payload_byte(3, idx));
+
+  auto record = h5file_ptr->get_trigger_record(trigger_count, 0);
+  BOOST_REQUIRE_EQUAL(record.get_fragments_ref().size(), components_per_record);
+
+  // clean up the files that were created
+  delete_files_matching_pattern(file_path, hdf5_filename);
+}
+
+BOOST_AUTO_TEST_CASE(PrecompressedFragments)
+{
+  std::string file_path(std::filesystem::temp_directory_path());
+  std::string hdf5_filename = "demo" + std::to_string(getpid()) + "_" + std::string(getenv("USER")) + ".hdf5";
+  const int trigger_count = 5;
+
+  // delete any pre-existing files so that we start with a clean slate
+  delete_files_matching_pattern(file_path, hdf5_filename);
+
+  auto fl_pars = create_file_layout_params();
+  fl_pars.path_param_list[0].deflate_level = 4;
+
+  // create the file
+  std::unique_ptr<HDF5RawDataFile> h5file_ptr(new HDF5RawDataFile(file_path + "/" + hdf5_filename,
+                                                                  run_number,
+                                                                  file_index,
+                                                                  application_name,
+                                                                  fl_pars,
+                                                                  create_srcid_geoid_map()));
+
+  // compress the fragments ahead of the writing, and write them with direct chunk writes
+  for (int trigger_number = 1; trigger_number <= trigger_count; ++trigger_number) {
+    auto tr = create_trigger_record(trigger_number);
+    std::vector<dunedaq::hdf5libs::PrecompressedFragment> precompressed_frags;
+    for (auto const& frag_ptr : tr.get_fragments_ref())
+      precompressed_frags.push_back(h5file_ptr->compress_fragment(*frag_ptr));
+
+    // the (zero-filled) TPC fragments are compressed, the others are stored as they are
+    BOOST_REQUIRE_LT(precompressed_frags[0].data.size(), precompressed_frags[0].header.size);
+    BOOST_REQUIRE_EQUAL(precompressed_frags.back().data.size(), precompressed_frags.back().header.size);
+
+    h5file_ptr->write(tr.get_header_ref(), precompressed_frags);
+  }
+
+  // the recorded size counts the uncompressed bytes
+  const size_t uncompressed_fragment_bytes =
+    trigger_count * components_per_record * (sizeof(dunedaq::daqdataformats::FragmentHeader) + fragment_size);
+  BOOST_REQUIRE_GT(h5file_ptr->get_recorded_size(), uncompressed_fragment_bytes);
+
+  h5file_ptr.reset(); // explicit destruction
+
+  // open file for reading now
+  h5file_ptr.reset(new HDF5RawDataFile(file_path + "/" + hdf5_filename));
+
+  auto frag_ptr = h5file_ptr->get_frag_ptr(3, 0, "Detector_Readout", 2);
+  BOOST_REQUIRE_EQUAL(frag_ptr->get_trigger_number(), 3);
+  BOOST_REQUIRE_EQUAL(frag_ptr->get_size(), sizeof(dunedaq::daqdataformats::FragmentHeader) + fragment_size);
+  const char* payload = static_cast<const char*>(frag_ptr->get_data());
+  BOOST_REQUIRE(std::all_of(payload, payload + fragment_size, [](char c) { return c == 0; }));
+
+  auto record = h5file_ptr->get_trigger_record(trigger_count, 0);
+  BOOST_REQUIRE_EQUAL(record.get_fragments_ref().size(), components_per_record);
+
+  // clean up the files that were created
+  delete_files_matching_pattern(file_path, hdf5_filename);
+}
+
+BOOST_AUTO_TEST_CASE(PrecompressedFragmentsWithSkippedFilter)
+{
+  std::string file_path(std::filesystem::temp_directory_path());
+  std::string hdf5_filename = "demo" + std::to_string(getpid()) + "_" + std::string(getenv("USER")) + ".hdf5";
+  const int trigger_count = 3;
+
+  // delete any pre-existing files so that we start with a clean slate
+  delete_files_matching_pattern(file_path, hdf5_filename);
+
+  // an additional filter (here the built-in Fletcher32 checksum) is not applied by compress_fragment()
+  auto fl_pars = create_file_layout_params();
+  fl_pars.path_param_list[0].deflate_level = 4;
+  fl_pars.path_param_list[0].filter_id = H5Z_FILTER_FLETCHER32;
+
+  // create the file
+  std::unique_ptr<HDF5RawDataFile> h5file_ptr(new HDF5RawDataFile(file_path + "/" + hdf5_filename,
+                                                                  run_number,
+                                                                  file_index,
+                                                                  application_name,
+                                                                  fl_pars,
+                                                                  create_srcid_geoid_map()));
+
+  for (int trigger_number = 1; trigger_number <= trigger_count; ++trigger_number) {
+    auto tr = create_trigger_record(trigger_number);
+    std::vector<dunedaq::hdf5libs::PrecompressedFragment> precompressed_frags;
+    for (auto const& frag_ptr : tr.get_fragments_ref())
+      precompressed_frags.push_back(h5file_ptr->compress_fragment(*frag_ptr));
+
+    // deflate (the first filter) is applied, the additional filter (the second) is marked as skipped
+    BOOST_REQUIRE_LT(precompressed_frags[0].data.size(), precompressed_frags[0].header.size);
+    BOOST_REQUIRE_EQUAL(precompressed_frags[0].filter_mask, 2);
+
+    h5file_ptr->write(tr.get_header_ref(), precompressed_frags);
+  }
+  h5file_ptr.reset(); // explicit destruction
+
+  // the datasets have both filters, and HDF5 only decodes the filters that were applied
+  h5file_ptr.reset(new HDF5RawDataFile(file_path + "/" + hdf5_filename));
+  auto frag_paths = h5file_ptr->get_fragment_dataset_paths(std::make_pair(2, 0));
+  {
+    HighFive::File h5file(file_path + "/" + hdf5_filename, HighFive::File::ReadOnly);
+    hid_t create_plist = H5Dget_create_plist(h5file.getDataSet(frag_paths.front()).getId());
+    BOOST_REQUIRE_EQUAL(H5Pget_nfilters(create_plist), 2);
+    H5Pclose(create_plist);
+  }
+  for (int trigger_number = 1; trigger_number <= trigger_count; ++trigger_number) {
+    auto record = h5file_ptr->get_trigger_record(trigger_number, 0);
+    BOOST_REQUIRE_EQUAL(record.get_fragments_ref().size(), components_per_record);
+    for (auto const& frag_ptr : record.get_fragments_ref()) {
+      BOOST_REQUIRE_EQUAL(frag_ptr->get_trigger_number(), trigger_number);
+      BOOST_REQUIRE_EQUAL(frag_ptr->get_size(), sizeof(dunedaq::daqdataformats::FragmentHeader) + fragment_size);
+      const char* payload = static_cast<const char*>(frag_ptr->get_data());
+      BOOST_REQUIRE(std::all_of(payload, payload + fragment_size, [](char c) { return c == 0; }));
+    }
+  }
+
+  // clean up the files that were created
+  delete_files_matching_pattern(file_path, hdf5_filename);
+}
+
+BOOST_AUTO_TEST_CASE(ScatteredFragments)
+{
+  std::string file_path(std::filesystem::temp_directory_path());
+  std::string hdf5_filename = "demo" + std::to_string(getpid()) + "_" + std::string(getenv("USER")) + ".hdf5";
+  const int trigger_count = 3;
+
+  // the payloads come from three separate buffers, one of them empty
+  std::vector<char> payload(fragment_size);
+  for (size_t idx = 0; idx < payload.size(); ++idx)
+    payload[idx] = static_cast<char>(idx % 251);
+  const size_t first_piece_size = 30;
+  std::vector<char> first_piece(payload.begin(), payload.begin() + first_piece_size);
+  std::vector<char> empty_piece;
+  std::vector<char> last_piece(payload.begin() + first_piece_size, payload.end());
+
+  // compressed datasets whose chunks are smaller than the pieces, and the packed fragment store
+  auto compressed_fl_pars = create_file_layout_params();
+  compressed_fl_pars.path_param_list[0].deflate_level = 4;
+  compressed_fl_pars.path_param_list[0].chunk_size_bytes = 64;
+  auto packed_fl_pars = create_file_layout_params();
+  packed_fl_pars.packed_fragment_store = true;
+
+  for (auto const& fl_pars : { compressed_fl_pars, packed_fl_pars }) {
+    // delete any pre-existing files so that we start with a clean slate
+    delete_files_matching_pattern(file_path, hdf5_filename);
+
+    // create the file
+    std::unique_ptr<HDF5RawDataFile> h5file_ptr(new HDF5RawDataFile(file_path + "/" + hdf5_filename,
+                                                                    run_number,
+                                                                    file_index,
+                                                                    application_name,
+                                                                    fl_pars,
+                                                                    create_srcid_geoid_map()));
+
+    for (int trigger_number = 1; trigger_number <= trigger_count; ++trigger_number) {
+      auto tr = create_trigger_record(trigger_number);
+      std::vector<dunedaq::hdf5libs::ScatteredFragment> scattered_frags;
+      for (auto const& frag_ptr : tr.get_fragments_ref()) {
+        dunedaq::hdf5libs::ScatteredFragment scattered_frag;
+        scattered_frag.header = frag_ptr->get_header();
+        scattered_frag.payload_pieces = { { first_piece.data(), first_piece.size() },
+                                          { empty_piece.data(), empty_piece.size() },
+                                          { last_piece.data(), last_piece.size() } };
+        scattered_frags.push_back(scattered_frag);
+      }
+      h5file_ptr->write(tr.get_header_ref(), scattered_frags);
+    }
+
+    // the size in the header has to match the pieces; the record is refused before anything is written
+    auto tr = create_trigger_record(trigger_count + 1);
+    std::vector<dunedaq::hdf5libs::ScatteredFragment> short_frags(1);
+    short_frags[0].header = tr.get_fragments_ref()[0]->get_header();
+    short_frags[0].payload_pieces = { { first_piece.data(), first_piece.size() } };
+    BOOST_REQUIRE_THROW(h5file_ptr->write(tr.get_header_ref(), short_frags), ScatteredFragmentSizeMismatch);
+
+    h5file_ptr.reset(); // explicit destruction
+
+    // open file for reading now
+    h5file_ptr.reset(new HDF5RawDataFile(file_path + "/" + hdf5_filename));
+
+    auto frag_ptr = h5file_ptr->get_frag_ptr(2, 0, "Detector_Readout", 2);
+    BOOST_REQUIRE_EQUAL(frag_ptr->get_trigger_number(), 2);
+    BOOST_REQUIRE_EQUAL(frag_ptr->get_size(), sizeof(dunedaq::daqdataformats::FragmentHeader) + fragment_size);
+    const char* frag_payload = static_cast<const char*>(frag_ptr->get_data());
+    BOOST_REQUIRE(std::equal(payload.begin(), payload.end(), frag_payload));
+
+    auto record = h5file_ptr->get_trigger_record(trigger_count, 0);
+    BOOST_REQUIRE_EQUAL(record.get_fragments_ref().size(), components_per_record);
+    BOOST_REQUIRE_EQUAL(h5file_ptr->get_all_trigger_record_ids().size(), trigger_count);
+  }
+
+  // clean up the files that were created
+  delete_files_matching_pattern(file_path, hdf5_filename);
+}
+
+BOOST_AUTO_TEST_CASE(CompressionPool)
+{
+  std::string file_path(std::filesystem::temp_directory_path());
+  std::string hdf5_filename = "demo" + std::to_string(getpid()) + "_" + std::string(getenv("USER")) + ".hdf5";
+  const int trigger_count = 6;
+
+  // delete any pre-existing files so that we start with a clean slate
+  delete_files_matching_pattern(file_path, hdf5_filename);
+
+  auto fl_pars = create_file_layout_params();
+  fl_pars.path_param_list[0].deflate_level = 4;
+
+  hdf5rawdatafile::WriterParams writer_params;
+  writer_params.async_write_queue_depth = 2;
+  writer_params.compression_thread_count = 3;
+
+  // create the file
+  std::unique_ptr<HDF5RawDataFile> h5file_ptr(new HDF5RawDataFile(file_path + "/" + hdf5_filename,
+                                                                  run_number,
+                                                                  file_index,
+                                                                  application_name,
+                                                                  fl_pars,
+                                                                  create_srcid_geoid_map(),
+                                                                  ".writing",
+                                                                  HighFive::File::Create,
+                                                                  writer_params));
+  BOOST_REQUIRE_EQUAL(h5file_ptr->get_compression_thread_count(), 3);
+
+  // mix queued and direct writes; both go through the compression pool
+  std::vector<std::future<void>> completions;
+  for (int trigger_number = 1; trigger_number <= trigger_count; ++trigger_number) {
+    if (trigger_number % 2 == 0) {
+      h5file_ptr->write(create_trigger_record(trigger_number));
+    } else {
+      auto tr_ptr = std::make_unique<dunedaq::daqdataformats::TriggerRecord>(create_trigger_record(trigger_number));
+      completions.push_back(h5file_ptr->write_async(std::move(tr_ptr)));
+    }
+  }
+  for (auto& completion : completions)
+    completion.get();
+
+  auto timings = h5file_ptr->get_pipeline_stage_timings();
+  BOOST_REQUIRE_EQUAL(timings.compressed_fragment_count, trigger_count * components_per_record);
+  BOOST_REQUIRE_LT(timings.compression_output_bytes, timings.compression_input_bytes);
+  BOOST_REQUIRE_EQUAL(timings.written_record_count, trigger_count);
+  BOOST_REQUIRE_GT(timings.write_seconds, 0);
+
+  h5file_ptr.reset(); // explicit destruction
+
+  // open file for reading now
+  h5file_ptr.reset(new HDF5RawDataFile(file_path + "/" + hdf5_filename));
+
+  auto trigger_record_ids = h5file_ptr->get_all_trigger_record_ids();
+  BOOST_REQUIRE_EQUAL(trigger_count, trigger_record_ids.size());
+
+  auto frag_ptr = h5file_ptr->get_frag_ptr(3, 0, "Detector_Readout", 2);
+  BOOST_REQUIRE_EQUAL(frag_ptr->get_trigger_number(), 3);
+  BOOST_REQUIRE_EQUAL(frag_ptr->get_size(), sizeof(dunedaq::daqdataformats::FragmentHeader) + fragment_size);
+
+  // clean up the files that were created
+  delete_files_matching_pattern(file_path, hdf5_filename);
+}
+
+BOOST_AUTO_TEST_CASE(CompressionPoolFilterPipeline)
+{
+  std::string file_path(std::filesystem::temp_directory_path());
+  std::string hdf5_filename = "demo" + std::to_string(getpid()) + "_" + std::string(getenv("USER")) + ".hdf5";
+  const int trigger_count = 3;
+
+  // the pool only produces single deflate chunks: fragments with another filter (here the built-in Fletcher32
+  // checksum, as an additional filter) or with smaller chunks go through the HDF5 filter pipeline instead
+  for (bool extra_filter : { true, false }) {
+    // delete any pre-existing files so that we start with a clean slate
+    delete_files_matching_pattern(file_path, hdf5_filename);
+
+    auto fl_pars = create_file_layout_params();
+    fl_pars.path_param_list[0].deflate_level = 4;
+    if (extra_filter)
+      fl_pars.path_param_list[0].filter_id = H5Z_FILTER_FLETCHER32;
+    else
+      fl_pars.path_param_list[0].chunk_size_bytes = 64;
+
+    hdf5rawdatafile::WriterParams writer_params;
+    writer_params.compression_thread_count = 2;
+    std::unique_ptr<HDF5RawDataFile> h5file_ptr(new HDF5RawDataFile(file_path + "/" + hdf5_filename,
+                                                                    run_number,
+                                                                    file_index,
+                                                                    application_name,
+                                                                    fl_pars,
+                                                                    create_srcid_geoid_map(),
+                                                                    ".writing",
+                                                                    HighFive::File::Create,
+                                                                    writer_params));
+    for (int trigger_number = 1; trigger_number <= trigger_count; ++trigger_number)
+      h5file_ptr->write(create_trigger_record(trigger_number));
+    BOOST_REQUIRE_EQUAL(h5file_ptr->get_pipeline_stage_timings().compressed_fragment_count, 0);
+    h5file_ptr.reset(); // explicit destruction
+
+    // the datasets have all of their filters applied, with the configured chunks
+    h5file_ptr.reset(new HDF5RawDataFile(file_path + "/" + hdf5_filename));
+    auto frag_paths = h5file_ptr->get_fragment_dataset_paths(std::make_pair(2, 0));
+    BOOST_REQUIRE_EQUAL(frag_paths.size(), components_per_record);
+    {
+      HighFive::File h5file(file_path + "/" + hdf5_filename, HighFive::File::ReadOnly);
+      hid_t create_plist = H5Dget_create_plist(h5file.getDataSet(frag_paths.front()).getId());
+      BOOST_REQUIRE_EQUAL(H5Pget_nfilters(create_plist), extra_filter ? 2 : 1);
+      unsigned filter_flags = 0; // NOLINT(build/unsigned)
+      BOOST_REQUIRE_EQUAL(H5Pget_filter_by_id2(create_plist, H5Z_FILTER_DEFLATE, &filter_flags, nullptr, nullptr, 0,
+                                               nullptr, nullptr), 0);
+      if (!extra_filter) {
+        hsize_t chunk_dims[2] = { 0, 0 };
+        BOOST_REQUIRE_EQUAL(H5Pget_chunk(create_plist, 2, chunk_dims), 2);
+        BOOST_REQUIRE_EQUAL(chunk_dims[0], 64);
+      }
+      H5Pclose(create_plist);
+    }
+    auto frag_ptr = h5file_ptr->get_frag_ptr(2, 0, "Detector_Readout", 1);
+    BOOST_REQUIRE_EQUAL(frag_ptr->get_trigger_number(), 2);
+    BOOST_REQUIRE_EQUAL(frag_ptr->get_size(), sizeof(dunedaq::daqdataformats::FragmentHeader) + fragment_size);
+    h5file_ptr.reset();
+  }
+
+  // clean up the files that were created
+  delete_files_matching_pattern(file_path, hdf5_filename);
+}
+
+BOOST_AUTO_TEST_CASE(WriteStatisticsCounters)
+{
+  std::string file_path(std::filesystem::temp_directory_path());
+  std::string hdf5_filename = "demo" + std::to_string(getpid()) + "_" + std::string(getenv("USER")) + ".hdf5";
+  const int trigger_count = 5;
+
+  // delete any pre-existing files so that we start with a clean slate
+  delete_files_matching_pattern(file_path, hdf5_filename);
+
+  // create the file
+  std::unique_ptr<HDF5RawDataFile> h5file_ptr(new HDF5RawDataFile(file_path + "/" + hdf5_filename,
+                                                                  run_number,
+                                                                  file_index,
+                                                                  application_name,
+                                                                  create_file_layout_params(),
+                                                                  create_srcid_geoid_map()));
+  BOOST_REQUIRE_EQUAL(h5file_ptr->get_write_statistics().record_count, 0);
+
+  for (int trigger_number = 1; trigger_number <= trigger_count; ++trigger_number)
+    h5file_ptr->write(create_trigger_record(trigger_number));
+
+  auto statistics = h5file_ptr->get_write_statistics();
+  BOOST_REQUIRE_EQUAL(statistics.record_count, trigger_count);
+  BOOST_REQUIRE_EQUAL(statistics.bytes_written, h5file_ptr->get_recorded_size());
+  BOOST_REQUIRE_GT(statistics.bytes_per_second, 0);
+  BOOST_REQUIRE_GT(statistics.records_per_second, 0);
+
+  // one dataset, one write and one flush (with the per_dataset flush policy) per record header and fragment
+  const size_t dataset_count = trigger_count * (components_per_record + 1);
+  BOOST_REQUIRE_EQUAL(statistics.get_phase_latency_ns(WritePhase::kDatasetCreation).count, dataset_count);
+  BOOST_REQUIRE_EQUAL(statistics.get_phase_latency_ns(WritePhase::kRawWrite).count, dataset_count);
+  BOOST_REQUIRE_EQUAL(statistics.get_phase_latency_ns(WritePhase::kFlush).count, dataset_count);
+  BOOST_REQUIRE_GT(statistics.get_phase_latency_ns(WritePhase::kGroupCreation).count, trigger_count);
+  // the record header SourceID and the three record-level maps are stored together
+  BOOST_REQUIRE_EQUAL(statistics.get_phase_latency_ns(WritePhase::kAttributeStore).count, trigger_count);
+
+  auto const& raw_write_latency = statistics.get_phase_latency_ns(WritePhase::kRawWrite);
+  BOOST_REQUIRE_LE(raw_write_latency.get_quantile(0.5), raw_write_latency.get_quantile(0.99));
+  BOOST_REQUIRE_LE(raw_write_latency.get_quantile(0.99), raw_write_latency.max);
+
+  BOOST_REQUIRE_EQUAL(statistics.fragments_per_record.count, trigger_count);
+  BOOST_REQUIRE_EQUAL(statistics.fragments_per_record.max, components_per_record);
+  BOOST_REQUIRE_EQUAL(statistics.record_write_time_ns.count, trigger_count);
+  BOOST_REQUIRE_EQUAL(statistics.slowest_record.write_time_ns, statistics.record_write_time_ns.max);
+  BOOST_REQUIRE_GE(statistics.largest_record.record_number, 1);
+  BOOST_REQUIRE_LE(statistics.largest_record.record_number, trigger_count);
+  BOOST_REQUIRE_EQUAL(statistics.largest_record.fragment_count, components_per_record);
+  BOOST_REQUIRE_GT(statistics.largest_record.size_bytes, components_per_record * fragment_size);
+
+  h5file_ptr.reset(); // explicit destruction
+
+  // clean up the files that were created
+  delete_files_matching_pattern(file_path, hdf5_filename);
+}
+
+BOOST_AUTO_TEST_CASE(DiskSpaceManagement)
+{
+  std::string file_path(std::filesystem::temp_directory_path());
+  std::string hdf5_filename = "demo" + std::to_string(getpid()) + "_" + std::string(getenv("USER")) + ".hdf5";
+  const int trigger_count = 5;
+  const size_t extent_size = 1024 * 1024;
+
+  // delete any pre-existing files so that we start with a clean slate
+  delete_files_matching_pattern(file_path, hdf5_filename);
+
+  // space is preallocated in whole extents ahead of the records
+  hdf5rawdatafile::WriterParams writer_params;
+  writer_params.preallocation_extent_bytes = extent_size;
+  std::unique_ptr<HDF5RawDataFile> h5file_ptr(new HDF5RawDataFile(file_path + "/" + hdf5_filename,
+                                                                  run_number,
+                                                                  file_index,
+                                                                  application_name,
+                                                                  create_file_layout_params(),
+                                                                  create_srcid_geoid_map(),
+                                                                  ".writing",
+                                                                  HighFive::File::Create,
+                                                                  writer_params));
+  for (int trigger_number = 1; trigger_number <= trigger_count; ++trigger_number)
+    h5file_ptr->write(create_trigger_record(trigger_number));
+  auto statistics = h5file_ptr->get_write_statistics();
+  BOOST_REQUIRE_GE(statistics.preallocated_bytes, extent_size);
+  BOOST_REQUIRE_EQUAL(statistics.free_disk_space_bytes, 0);
+  BOOST_REQUIRE_GT(h5file_ptr->get_free_disk_space(), 0);
+  h5file_ptr.reset(); // explicit destruction
+
+  // the preallocated space past the end of the file is given back when it is closed, so the blocks of the small
+  // file add up to less than one extent
+  struct stat file_stat;
+  BOOST_REQUIRE_EQUAL(stat((file_path + "/" + hdf5_filename).c_str(), &file_stat), 0);
+  BOOST_REQUIRE_LT(static_cast<size_t>(file_stat.st_blocks) * 512, extent_size);
+  h5file_ptr.reset(new HDF5RawDataFile(file_path + "/" + hdf5_filename));
+  BOOST_REQUIRE_EQUAL(h5file_ptr->get_all_trigger_record_ids().size(), trigger_count);
+  h5file_ptr.reset();
+  delete_files_matching_pattern(file_path, hdf5_filename);
+
+  // no file system has this much free space, so records are rejected
+  writer_params = hdf5rawdatafile::WriterParams();
+  writer_params.free_space_reserve_bytes = size_t(1) << 62;
+  h5file_ptr.reset(new HDF5RawDataFile(file_path + "/" + hdf5_filename,
+                                       run_number,
+                                       file_index,
+                                       application_name,
+                                       create_file_layout_params(),
+                                       create_srcid_geoid_map(),
+                                       ".writing",
+                                       HighFive::File::Create,
+                                       writer_params));
+  BOOST_REQUIRE_THROW(h5file_ptr->write(create_trigger_record(1)), InsufficientDiskSpace);
+  statistics = h5file_ptr->get_write_statistics();
+  BOOST_REQUIRE_EQUAL(statistics.rejected_record_count, 1);
+  BOOST_REQUIRE_EQUAL(statistics.record_count, 0);
+  BOOST_REQUIRE_GT(statistics.free_disk_space_bytes, 0);
+
+  // the callback can make the record wait for space, up to the timeout
+  size_t callback_count = 0;
+  h5file_ptr->set_low_disk_space_callback([&callback_count](const HDF5RawDataFile::DiskSpaceStatus& status) {
+    ++callback_count;
+    return status.wait_time < std::chrono::milliseconds(250);
+  });
+  BOOST_REQUIRE_THROW(h5file_ptr->write(create_trigger_record(2)), InsufficientDiskSpace);
+  BOOST_REQUIRE_GT(callback_count, 1);
+  BOOST_REQUIRE_EQUAL(h5file_ptr->get_write_statistics().rejected_record_count, 2);
+  h5file_ptr.reset();
+
+  // an unknown policy is refused
+  writer_params.free_space_policy = "ignore";
+  BOOST_REQUIRE_THROW(HDF5RawDataFile(file_path + "/" + hdf5_filename,
+                                      run_number,
+                                      file_index,
+                                      application_name,
+                                      create_file_layout_params(),
+                                      create_srcid_geoid_map(),
+                                      ".writing",
+                                      HighFive::File::Overwrite,
+                                      writer_params),
+                      InvalidFreeSpacePolicy);
+
+  // clean up the files that were created
+  delete_files_matching_pattern(file_path, hdf5_filename);
+}
+
+BOOST_AUTO_TEST_CASE(CoreStaging)
+{
+  std::string file_path(std::filesystem::temp_directory_path());
+  std::string hdf5_filename = "demo" + std::to_string(getpid()) + "_" + std::string(getenv("USER")) + ".hdf5";
+  const int trigger_count = 10;
+
+  // a cap that holds the whole file, and one that is reached after a few records
+  for (size_t max_bytes : { size_t(1) << 30, size_t(40000) }) {
+    // delete any pre-existing files so that we start with a clean slate
+    delete_files_matching_pattern(file_path, hdf5_filename);
+
+    hdf5rawdatafile::WriterParams writer_params;
+    writer_params.core_staging_max_bytes = max_bytes;
+    writer_params.core_staging_direct_io = true;
+
+    // create the file
+    std::unique_ptr<HDF5RawDataFile> h5file_ptr(new HDF5RawDataFile(file_path + "/" + hdf5_filename,
+                                                                    run_number,
+                                                                    file_index,
+                                                                    application_name,
+                                                                    create_file_layout_params(),
+                                                                    create_srcid_geoid_map(),
+                                                                    ".writing",
+                                                                    HighFive::File::Create,
+                                                                    writer_params));
+    // the image is written to disk once, when the file outgrows the cap; the on-disk file then starts as the image
+    size_t spill_image_bytes = 0;
+    for (int trigger_number = 1; trigger_number <= trigger_count; ++trigger_number) {
+      h5file_ptr->write(create_trigger_record(trigger_number));
+      std::string inprogress_name = file_path + "/" + hdf5_filename + ".writing";
+      if (spill_image_bytes == 0 && std::filesystem::exists(inprogress_name)) {
+        spill_image_bytes = h5file_ptr->get_write_statistics().file_image_bytes;
+        BOOST_REQUIRE_GT(spill_image_bytes, 0);
+        BOOST_REQUIRE_LE(spill_image_bytes, std::filesystem::file_size(inprogress_name));
+      }
+    }
+
+    // the file only reaches the disk once it outgrows the cap
+    bool spilled = std::filesystem::exists(file_path + "/" + hdf5_filename + ".writing");
+    BOOST_REQUIRE_EQUAL(spilled, max_bytes < (size_t(1) << 30));
+    h5file_ptr->finalize();
+    auto statistics = h5file_ptr->get_write_statistics();
+    BOOST_REQUIRE_EQUAL(statistics.get_phase_latency_ns(WritePhase::kFileImageWrite).count, 1);
+    if (spilled) {
+      // the records after the spill go straight to the disk file
+      BOOST_REQUIRE_EQUAL(statistics.file_image_bytes, spill_image_bytes);
+      BOOST_REQUIRE_LT(statistics.file_image_bytes, std::filesystem::file_size(file_path + "/" + hdf5_filename));
+    } else {
+      BOOST_REQUIRE_EQUAL(statistics.file_image_bytes, std::filesystem::file_size(file_path + "/" + hdf5_filename));
+    }
+    h5file_ptr.reset();
+
+    // open file for reading now
+    h5file_ptr.reset(new HDF5RawDataFile(file_path + "/" + hdf5_filename));
+    BOOST_REQUIRE_EQUAL(h5file_ptr->get_all_trigger_record_ids().size(), trigger_count);
+    BOOST_REQUIRE_EQUAL(h5file_ptr->get_record_directory().size(), trigger_count);
+    auto frag_ptr = h5file_ptr->get_frag_ptr(trigger_count, 0, "Detector_Readout", 2);
+    BOOST_REQUIRE_EQUAL(frag_ptr->get_trigger_number(), trigger_count);
+    h5file_ptr.reset();
+  }
+
+  // clean up the files that were created
+  delete_files_matching_pattern(file_path, hdf5_filename);
+}
+
+BOOST_AUTO_TEST_CASE(SplitFiles)
+{
+  std::string file_path(std::filesystem::temp_directory_path());
+  std::string hdf5_filename = "demo" + std::to_string(getpid()) + "_" + std::string(getenv("USER")) + "_split.hdf5";
+  std::string metadata_path = file_path + "/" + hdf5_filename + "_metadata";
+  const int trigger_count = 5;
+
+  // delete any pre-existing files so that we start with a clean slate
+  std::filesystem::remove_all(metadata_path);
+  delete_files_matching_pattern(file_path, hdf5_filename + ".*");
+  std::filesystem::create_directory(metadata_path);
+
+  hdf5rawdatafile::WriterParams writer_params;
+  writer_params.split_files = true;
+  writer_params.split_metadata_directory = metadata_path;
+
+  // create the file
+  std::unique_ptr<HDF5RawDataFile> h5file_ptr(new HDF5RawDataFile(file_path + "/" + hdf5_filename,
+                                                                  run_number,
+                                                                  file_index,
+                                                                  application_name,
+                                                                  create_file_layout_params(),
+                                                                  create_srcid_geoid_map(),
+                                                                  ".writing",
+                                                                  HighFive::File::Create,
+                                                                  writer_params));
+  BOOST_REQUIRE(h5file_ptr->is_split());
+  for (int trigger_number = 1; trigger_number <= trigger_count; ++trigger_number)
+    h5file_ptr->write(create_trigger_record(trigger_number));
+  h5file_ptr.reset(); // explicit destruction
+
+  // the raw data stays next to the file name, and the metadata file is linked from there
+  std::string metadata_file_name = metadata_path + "/" + hdf5_filename + HDF5RawDataFile::SPLIT_METADATA_SUFFIX;
+  BOOST_REQUIRE(!std::filesystem::exists(file_path + "/" + hdf5_filename));
+  BOOST_REQUIRE(std::filesystem::exists(file_path + "/" + hdf5_filename + HDF5RawDataFile::SPLIT_RAW_DATA_SUFFIX));
+  BOOST_REQUIRE(std::filesystem::exists(metadata_file_name));
+  BOOST_REQUIRE(
+    std::filesystem::is_symlink(file_path + "/" + hdf5_filename + HDF5RawDataFile::SPLIT_METADATA_SUFFIX));
+  BOOST_REQUIRE(HDF5RawDataFile::is_split_file(file_path + "/" + hdf5_filename));
+
+  // open file for reading now, by its name
+  h5file_ptr.reset(new HDF5RawDataFile(file_path + "/" + hdf5_filename));
+  BOOST_REQUIRE(h5file_ptr->is_split());
+  BOOST_REQUIRE_EQUAL(h5file_ptr->get_all_trigger_record_ids().size(), trigger_count);
+  auto record = h5file_ptr->get_trigger_record(trigger_count);
+  BOOST_REQUIRE_EQUAL(record.get_header_ref().get_trigger_number(), trigger_count);
+  BOOST_REQUIRE_EQUAL(record.get_fragments_ref().size(), components_per_record);
+  h5file_ptr.reset();
+
+  // clean up the files that were created
+  std::filesystem::remove_all(metadata_path);
+  delete_files_matching_pattern(file_path, hdf5_filename + ".*");
+}
+
+BOOST_AUTO_TEST_CASE(MetadataCache)
+{
+  std::string file_path(std::filesystem::temp_directory_path());
+  std::string hdf5_filename = "demo" + std::to_string(getpid()) + "_" + std::string(getenv("USER")) + ".hdf5";
+  const int trigger_count = 20;
+  const size_t max_cache_bytes = 1024 * 1024;
+
+  // delete any pre-existing files so that we start with a clean slate
+  delete_files_matching_pattern(file_path, hdf5_filename);
+
+  // the same records, with and without the eviction of the metadata of each written record
+  std::vector<size_t> entry_counts;
+  for (bool evict_on_close : { false, true }) {
+    hdf5rawdatafile::WriterParams writer_params;
+    writer_params.metadata_cache_max_bytes = max_cache_bytes;
+    writer_params.evict_on_close = evict_on_close;
+    std::unique_ptr<HDF5RawDataFile> h5file_ptr(new HDF5RawDataFile(file_path + "/" + hdf5_filename,
+                                                                    run_number,
+                                                                    file_index,
+                                                                    application_name,
+                                                                    create_file_layout_params(),
+                                                                    create_srcid_geoid_map(),
+                                                                    ".writing",
+                                                                    HighFive::File::Create,
+                                                                    writer_params));
+    for (int trigger_number = 1; trigger_number <= trigger_count; ++trigger_number)
+      h5file_ptr->write(create_trigger_record(trigger_number));
+
+    auto cache_status = h5file_ptr->get_metadata_cache_status();
+    BOOST_REQUIRE_LE(cache_status.max_size_bytes, max_cache_bytes);
+    BOOST_REQUIRE_LE(cache_status.current_size_bytes, max_cache_bytes);
+    BOOST_REQUIRE_GT(cache_status.entry_count, 0);
+    entry_counts.push_back(cache_status.entry_count);
+    h5file_ptr.reset(); // explicit destruction
+
+    // open file for reading now
+    h5file_ptr.reset(new HDF5RawDataFile(file_path + "/" + hdf5_filename));
+    BOOST_REQUIRE_EQUAL(h5file_ptr->get_all_trigger_record_ids().size(), trigger_count);
+    auto record = h5file_ptr->get_trigger_record(1);
+    BOOST_REQUIRE_EQUAL(record.get_fragments_ref().size(), components_per_record);
+    h5file_ptr.reset();
+    delete_files_matching_pattern(file_path, hdf5_filename);
+  }
+
+  // the objects of the written records do not stay in the cache
+  BOOST_REQUIRE_LT(entry_counts[1], entry_counts[0]);
+
+  // the cache bounds are checked before the file is created
+  hdf5rawdatafile::WriterParams writer_params;
+  writer_params.metadata_cache_max_bytes = 100;
+  BOOST_REQUIRE_THROW(HDF5RawDataFile(file_path + "/" + hdf5_filename,
+                                      run_number,
+                                      file_index,
+                                      application_name,
+                                      create_file_layout_params(),
+                                      create_srcid_geoid_map(),
+                                      ".writing",
+                                      HighFive::File::Create,
+                                      writer_params),
+                      InvalidMetadataCacheConfig);
+  writer_params.metadata_cache_max_bytes = max_cache_bytes;
+  writer_params.metadata_cache_initial_bytes = 2 * max_cache_bytes;
+  BOOST_REQUIRE_THROW(HDF5RawDataFile(file_path + "/" + hdf5_filename,
+                                      run_number,
+                                      file_index,
+                                      application_name,
+                                      create_file_layout_params(),
+                                      create_srcid_geoid_map(),
+                                      ".writing",
+                                      HighFive::File::Create,
+                                      writer_params),
+                      InvalidMetadataCacheConfig);
+
+  // clean up the files that were created
+  delete_files_matching_pattern(file_path, hdf5_filename);
+}
+
+BOOST_AUTO_TEST_CASE(DatasetPaths)
+{
+  // the reused path elements of the writer are the same as the ones that the file layout returns
+  dunedaq::hdf5libs::HDF5FileLayout layout(create_file_layout_params());
+  dunedaq::hdf5libs::DatasetPathBuilder path_builder(layout);
+
+  for (uint64_t trig_num : { 1, 2, 1234567 }) { // NOLINT(build/unsigned)
+    dunedaq::daqdataformats::TriggerRecordHeaderData trh_data;
+    trh_data.trigger_number = trig_num;
+    trh_data.sequence_number = 3;
+    trh_data.element_id =
+      dunedaq::daqdataformats::SourceID(dunedaq::daqdataformats::SourceID::Subsystem::kTRBuilder, 0);
+    dunedaq::daqdataformats::TriggerRecordHeader trh(&trh_data);
+    BOOST_REQUIRE(path_builder.get_path_elements(trh) == layout.get_path_elements(trh));
+
+    for (int ele_num = 0; ele_num < 3; ++ele_num) {
+      dunedaq::daqdataformats::FragmentHeader fh;
+      fh.trigger_number = trig_num;
+      fh.sequence_number = 3;
+      fh.fragment_type = static_cast<dunedaq::daqdataformats::fragment_type_t>(
+        (ele_num == 2) ? dunedaq::daqdataformats::FragmentType::kTriggerPrimitive
+                       : dunedaq::daqdataformats::FragmentType::kWIB);
+      fh.element_id =
+        dunedaq::daqdataformats::SourceID(dunedaq::daqdataformats::SourceID::Subsystem::kDetectorReadout, ele_num);
+      BOOST_REQUIRE(path_builder.get_path_elements(fh) == layout.get_path_elements(fh));
+    }
+  }
+  BOOST_REQUIRE_EQUAL(layout.get_record_number_string(42, 3), "TriggerRecord000042.0003");
+}
+
+BOOST_AUTO_TEST_CASE(FileProperties)
+{
+  std::string file_path(std::filesystem::temp_directory_path());
+  std::string hdf5_filename = "demo" + std::to_string(getpid()) + "_" + std::string(getenv("USER")) + ".hdf5";
+  const int trigger_count = 3;
+
+  // presets are filled in, and fields that are set override them
+  auto fl_pars = create_file_layout_params();
+  fl_pars.file_properties.preset = "local-nvme";
+  fl_pars.file_properties.file_space_page_size_bytes = 16384;
+  dunedaq::hdf5libs::HDF5FileLayout layout(fl_pars);
+  auto file_properties = layout.get_file_properties();
+  BOOST_REQUIRE_EQUAL(file_properties.file_space_strategy, "page");
+  BOOST_REQUIRE_EQUAL(file_properties.file_space_page_size_bytes, 16384);
+  BOOST_REQUIRE_EQUAL(file_properties.libver_low_bound, "latest");
+
+  auto bad_fl_pars = create_file_layout_params();
+  bad_fl_pars.file_properties.preset = "floppy";
+  BOOST_REQUIRE_THROW(dunedaq::hdf5libs::HDF5FileLayout{ bad_fl_pars },
+                      dunedaq::hdf5libs::FileLayoutInvalidFileProperties);
+
+  for (auto const& preset : { "lustre", "local-nvme" }) {
+    // delete any pre-existing files so that we start with a clean slate
+    delete_files_matching_pattern(file_path, hdf5_filename);
+
+    fl_pars = create_file_layout_params();
+    fl_pars.file_properties.preset = preset;
+
+    // create the file
+    std::unique_ptr<HDF5RawDataFile> h5file_ptr(new HDF5RawDataFile(file_path + "/" + hdf5_filename,
+                                                                    run_number,
+                                                                    file_index,
+                                                                    application_name,
+                                                                    fl_pars,
+                                                                    create_srcid_geoid_map()));
+
+    // the last record has a fragment above the alignment threshold of the lustre preset
+    const size_t large_fragment_size = 2 * 1024 * 1024;
+    for (int trigger_number = 1; trigger_number <= trigger_count; ++trigger_number) {
+      auto tr = create_trigger_record(trigger_number);
+      if (trigger_number == trigger_count) {
+        std::vector<char> large_payload(large_fragment_size);
+        std::unique_ptr<dunedaq::daqdataformats::Fragment> large_frag_ptr(
+          new dunedaq::daqdataformats::Fragment(large_payload.data(), large_payload.size()));
+        large_frag_ptr->set_header_fields(tr.get_fragments_ref()[0]->get_header());
+        tr.get_fragments_ref()[0] = std::move(large_frag_ptr);
+      }
+      h5file_ptr->write(tr);
+    }
+
+    h5file_ptr.reset(); // explicit destruction
+
+    // open file for reading now
+    h5file_ptr.reset(new HDF5RawDataFile(file_path + "/" + hdf5_filename));
+    BOOST_REQUIRE_EQUAL(h5file_ptr->get_file_layout().get_file_layout_params().file_properties.preset, preset);
+
+    // the file creation properties are stored in the file. The access properties are not, but show in the file:
+    // the low libver bound of "latest" gives the latest superblock version, and large datasets are aligned.
+    auto preset_properties = dunedaq::hdf5libs::HDF5FileLayout::get_file_properties_preset(preset);
+    {
+      HighFive::File h5file(file_path + "/" + hdf5_filename, HighFive::File::ReadOnly);
+      hid_t create_plist = H5Fget_create_plist(h5file.getId());
+      H5F_fspace_strategy_t strategy = H5F_FSPACE_STRATEGY_NTYPES;
+      hbool_t persist = false;
+      hsize_t threshold = 0;
+      hsize_t page_size = 0;
+      BOOST_REQUIRE_GE(H5Pget_file_space_strategy(create_plist, &strategy, &persist, &threshold), 0);
+      BOOST_REQUIRE_GE(H5Pget_file_space_page_size(create_plist, &page_size), 0);
+      H5Pclose(create_plist);
+      if (preset_properties.file_space_strategy == "page") {
+        BOOST_REQUIRE_EQUAL(strategy, H5F_FSPACE_STRATEGY_PAGE);
+        BOOST_REQUIRE_EQUAL(page_size, preset_properties.file_space_page_size_bytes);
+      } else {
+        BOOST_REQUIRE_EQUAL(strategy, H5F_FSPACE_STRATEGY_FSM_AGGR);
+      }
+
+      H5F_info2_t file_info;
+      BOOST_REQUIRE_GE(H5Fget_info2(h5file.getId(), &file_info), 0);
+      BOOST_REQUIRE_EQUAL(preset_properties.libver_low_bound, "latest");
+      BOOST_REQUIRE_EQUAL(file_info.super.version, 3);
+
+      size_t large_dataset_count = 0;
+      for (auto const& frag_path : h5file_ptr->get_fragment_dataset_paths(std::make_pair(trigger_count, 0))) {
+        auto dataset = h5file.getDataSet(frag_path);
+        if (dataset.getStorageSize() < large_fragment_size)
+          continue;
+        ++large_dataset_count;
+        haddr_t offset = H5Dget_offset(dataset.getId());
+        BOOST_REQUIRE(offset != HADDR_UNDEF);
+        if (preset_properties.alignment_bytes > 0)
+          BOOST_REQUIRE_EQUAL(offset % preset_properties.alignment_bytes, 0);
+      }
+      BOOST_REQUIRE_EQUAL(large_dataset_count, 1);
+    }
+
+    auto trigger_record_ids = h5file_ptr->get_all_trigger_record_ids();
+    BOOST_REQUIRE_EQUAL(trigger_count, trigger_record_ids.size());
+    auto record = h5file_ptr->get_trigger_record(trigger_count, 0);
+    BOOST_REQUIRE_EQUAL(record.get_fragments_ref().size(), components_per_record);
+  }
+
+  // clean up the files that were created
+  delete_files_matching_pattern(file_path, hdf5_filename);
+}
+
+BOOST_AUTO_TEST_CASE(PackedFragmentStore)
+{
+  std::string file_path(std::filesystem::temp_directory_path());
+  std::string hdf5_filename = "demo" + std::to_string(getpid()) + "_" + std::string(getenv("USER")) + ".hdf5";
+  const int trigger_count = 5;
+
+  // delete any pre-existing files so that we start with a clean slate
+  delete_files_matching_pattern(file_path, hdf5_filename);
+
+  auto fl_pars = create_file_layout_params();
+  fl_pars.packed_fragment_store = true;
+  fl_pars.path_param_list[0].deflate_level = 4;
+
+  // create the file
+  std::unique_ptr<HDF5RawDataFile> h5file_ptr(new HDF5RawDataFile(file_path + "/" + hdf5_filename,
+                                                                  run_number,
+                                                                  file_index,
+                                                                  application_name,
+                                                                  fl_pars,
+                                                                  create_srcid_geoid_map()));
+  BOOST_REQUIRE_GE(h5file_ptr->get_version(), 6);
+
+  for (int trigger_number = 1; trigger_number <= trigger_count; ++trigger_number)
+    h5file_ptr->write(create_trigger_record(trigger_number));
+
+  h5file_ptr.reset(); // explicit destruction
+
+  // open file for reading now
+  h5file_ptr.reset(new HDF5RawDataFile(file_path + "/" + hdf5_filename));
+  BOOST_REQUIRE(h5file_ptr->get_file_layout().is_packed_fragment_store());
+
+  // the file-level group is not mistaken for a record
+  auto trigger_record_ids = h5file_ptr->get_all_trigger_record_ids();
+  BOOST_REQUIRE_EQUAL(trigger_count, trigger_record_ids.size());
+
+  auto frag_paths = h5file_ptr->get_all_fragment_dataset_paths();
+  BOOST_REQUIRE_EQUAL(frag_paths.size(), trigger_count * components_per_record);
+  BOOST_REQUIRE_EQUAL(h5file_ptr->get_trigger_record_header_dataset_paths().size(), trigger_count);
+
+  auto source_ids = h5file_ptr->get_source_ids(3, 0);
+  BOOST_REQUIRE_EQUAL(source_ids.size(), components_per_record + 1);
+
+  auto frag_ptr = h5file_ptr->get_frag_ptr(3, 0, "Detector_Readout", 2);
+  BOOST_REQUIRE_EQUAL(frag_ptr->get_trigger_number(), 3);
+  BOOST_REQUIRE_EQUAL(frag_ptr->get_size(), sizeof(dunedaq::daqdataformats::FragmentHeader) + fragment_size);
+  const char* payload = static_cast<const char*>(frag_ptr->get_data());
+  BOOST_REQUIRE(std::all_of(payload, payload + fragment_size, [](char c) { return c == 0; }));
+
+  auto record = h5file_ptr->get_trigger_record(trigger_count, 0);
+  BOOST_REQUIRE_EQUAL(record.get_header_ref().get_trigger_number(), trigger_count);
+  BOOST_REQUIRE_EQUAL(record.get_fragments_ref().size(), components_per_record);
+
+  // clean up the files that were created
+  delete_files_matching_pattern(file_path, hdf5_filename);
+}
+
+BOOST_AUTO_TEST_CASE(SourceIDMapEncodings)
+{
+  std::string file_path(std::filesystem::temp_directory_path());
+  std::string hdf5_filename = "demo" + std::to_string(getpid()) + "_" + std::string(getenv("USER")) + ".hdf5";
+
+  // delete any pre-existing files so that we start with a clean slate
+  delete_files_matching_pattern(file_path, hdf5_filename);
+
+  using dunedaq::daqdataformats::SourceID;
+  const SourceID rh_source_id(SourceID::Subsystem::kTRBuilder, 0);
+  HDF5SourceIDHandler::source_id_path_map_t path_map;
+  HDF5SourceIDHandler::fragment_type_source_id_map_t fragment_type_map;
+  HDF5SourceIDHandler::subdetector_source_id_map_t subdetector_map;
+  HDF5SourceIDHandler::add_source_id_path_to_map(path_map, rh_source_id, "/Record/RawData/header");
+  for (uint32_t idx = 0; idx < 500; ++idx) { // NOLINT(build/unsigned)
+    SourceID source_id(SourceID::Subsystem::kDetectorReadout, idx);
+    HDF5SourceIDHandler::add_source_id_path_to_map(path_map, source_id, "/Record/RawData/" + source_id.to_string());
+    HDF5SourceIDHandler::add_fragment_type_source_id_to_map(
+      fragment_type_map, dunedaq::daqdataformats::FragmentType::kWIB, source_id);
+    HDF5SourceIDHandler::add_subdetector_source_id_to_map(
+      subdetector_map, dunedaq::detdataformats::DetID::Subdetector::kHD_TPC, source_id);
+  }
+
+  // the JSON (up to version 6) and binary (version 7 and later) encodings give back the same maps
+  {
+    HighFive::File h5_file(file_path + "/" + hdf5_filename, HighFive::File::Create);
+    for (uint32_t version : { 5, 7 }) { // NOLINT(build/unsigned)
+      HighFive::Group record_group = h5_file.createGroup("Version" + std::to_string(version));
+      HDF5SourceIDHandler sid_handler(version);
+      sid_handler.store_record_header_source_id(record_group, rh_source_id);
+      sid_handler.store_record_level_path_info(record_group, path_map);
+      sid_handler.store_record_level_fragment_type_map(record_group, fragment_type_map);
+      sid_handler.store_record_level_subdetector_map(record_group, subdetector_map);
+
+      HDF5SourceIDHandler::source_id_path_map_t path_map_read;
+      HDF5SourceIDHandler::fragment_type_source_id_map_t fragment_type_map_read;
+      HDF5SourceIDHandler::subdetector_source_id_map_t subdetector_map_read;
+      BOOST_REQUIRE(sid_handler.fetch_record_header_source_id(record_group) == rh_source_id);
+      sid_handler.fetch_source_id_path_info(record_group, path_map_read);
+      sid_handler.fetch_fragment_type_source_id_info(record_group, fragment_type_map_read);
+      sid_handler.fetch_subdetector_source_id_info(record_group, subdetector_map_read);
+      BOOST_REQUIRE(path_map_read == path_map);
+      BOOST_REQUIRE(fragment_type_map_read == fragment_type_map);
+      BOOST_REQUIRE(subdetector_map_read == subdetector_map);
+    }
+  }
+
+  // clean up the files that were created
+  delete_files_matching_pattern(file_path, hdf5_filename);
+}
+
+BOOST_AUTO_TEST_CASE(RecordDirectory)
+{
+  std::string file_path(std::filesystem::temp_directory_path());
+  std::string hdf5_filename = "demo" + std::to_string(getpid()) + "_" + std::string(getenv("USER")) + ".hdf5";
+  const int trigger_count = 5;
+
+  // delete any pre-existing files so that we start with a clean slate
+  delete_files_matching_pattern(file_path, hdf5_filename);
+
+  // create the file
+  std::unique_ptr<HDF5RawDataFile> h5file_ptr(new HDF5RawDataFile(file_path + "/" + hdf5_filename,
+                                                                  run_number,
+                                                                  file_index,
+                                                                  application_name,
+                                                                  create_file_layout_params(),
+                                                                  create_srcid_geoid_map()));
+
+  std::vector<uint64_t> trigger_timestamps; // NOLINT(build/unsigned)
+  for (int trigger_number = 1; trigger_number <= trigger_count; ++trigger_number) {
+    auto tr = create_trigger_record(trigger_number);
+    trigger_timestamps.push_back(tr.get_header_ref().get_trigger_timestamp());
+    h5file_ptr->write(tr);
+  }
+  BOOST_REQUIRE_EQUAL(h5file_ptr->get_record_directory().size(), trigger_count);
+
+  h5file_ptr.reset(); // explicit destruction
+
+  // open file for reading now; the records are known from the directory
+  h5file_ptr.reset(new HDF5RawDataFile(file_path + "/" + hdf5_filename));
+  auto record_directory = h5file_ptr->get_record_directory();
+  BOOST_REQUIRE_EQUAL(record_directory.size(), trigger_count);
+  for (int idx = 0; idx < trigger_count; ++idx) {
+    BOOST_REQUIRE_EQUAL(record_directory[idx].record_number, idx + 1);
+    BOOST_REQUIRE_EQUAL(record_directory[idx].sequence_number, 0);
+    BOOST_REQUIRE_EQUAL(record_directory[idx].trigger_timestamp, trigger_timestamps[idx]);
+    BOOST_REQUIRE_EQUAL(record_directory[idx].fragment_count, components_per_record);
+    BOOST_REQUIRE_GT(record_directory[idx].size_bytes, components_per_record * fragment_size);
+  }
+
+  auto trigger_record_ids = h5file_ptr->get_all_trigger_record_ids();
+  BOOST_REQUIRE_EQUAL(trigger_count, trigger_record_ids.size());
+
+  // the directory itself is not mistaken for a fragment, or listed with the datasets of the records
+  BOOST_REQUIRE_EQUAL(h5file_ptr->get_all_fragment_dataset_paths().size(), trigger_count * components_per_record);
+  std::string file_level_group_name = h5file_ptr->get_file_layout().get_file_level_group_name();
+  for (auto const& dataset_path : h5file_ptr->get_dataset_paths())
+    BOOST_REQUIRE_EQUAL(dataset_path.find(file_level_group_name), std::string::npos);
+
+  auto trh_ptr = h5file_ptr->get_trh_ptr(h5file_ptr->get_record_header_dataset_path(3, 0));
+  BOOST_REQUIRE_EQUAL(trh_ptr->get_trigger_number(), 3);
+
+  // clean up the files that were created
+  delete_files_matching_pattern(file_path, hdf5_filename);
+}
+
+BOOST_AUTO_TEST_CASE(LiveTail)
+{
+  std::string file_path(std::filesystem::temp_directory_path());
+  std::string hdf5_filename = "demo" + std::to_string(getpid()) + "_" + std::string(getenv("USER")) + ".hdf5";
+  const int trigger_count = 5;
+
+  // delete any pre-existing files so that we start with a clean slate
+  delete_files_matching_pattern(file_path, hdf5_filename);
+  delete_files_matching_pattern(file_path, hdf5_filename + ".writing");
+
+  // the reader runs in another process, since HDF5 would hand a reader in this process the file that the
+  // writer has open, and refresh() would not read the file from disk. The child is started before the file
+  // is opened, so that it does not inherit the open file either.
+  int step_pipe[2];
+  int result_pipe[2];
+  BOOST_REQUIRE_EQUAL(pipe(step_pipe), 0);
+  BOOST_REQUIRE_EQUAL(pipe(result_pipe), 0);
+  pid_t reader_pid = fork();
+  BOOST_REQUIRE_GE(reader_pid, 0);
+  if (reader_pid == 0) {
+    close(step_pipe[1]);
+    close(result_pipe[0]);
+    _exit(follow_live_file(file_path + "/" + hdf5_filename + ".writing", trigger_count, step_pipe[0], result_pipe[1]));
+  }
+  close(step_pipe[0]);
+  close(result_pipe[1]);
+  auto run_reader_step = [&]() {
+    char step = 1;
+    char result = 0;
+    BOOST_REQUIRE_EQUAL(write(step_pipe[1], &step, 1), 1);
+    BOOST_REQUIRE_EQUAL(read(result_pipe[0], &result, 1), 1);
+    return result;
+  };
+
+  hdf5rawdatafile::WriterParams writer_params;
+  writer_params.live_tail = true;
+  writer_params.flush_policy = "per_record";
+
+  // create the file
+  std::unique_ptr<HDF5RawDataFile> h5file_ptr(new HDF5RawDataFile(file_path + "/" + hdf5_filename,
+                                                                  run_number,
+                                                                  file_index,
+                                                                  application_name,
+                                                                  create_file_layout_params(),
+                                                                  create_srcid_geoid_map(),
+                                                                  ".writing",
+                                                                  HighFive::File::Create,
+                                                                  writer_params));
+  h5file_ptr->write(create_trigger_record(1));
+  h5file_ptr->write(create_trigger_record(2));
+
+  // the reader follows the file while it is written
+  BOOST_REQUIRE_EQUAL(run_reader_step(), 1);
+  for (int trigger_number = 3; trigger_number <= trigger_count; ++trigger_number)
+    h5file_ptr->write(create_trigger_record(trigger_number));
+  BOOST_REQUIRE_EQUAL(run_reader_step(), 1);
+  auto statistics = h5file_ptr->get_write_statistics();
+  BOOST_REQUIRE_EQUAL(statistics.get_phase_latency_ns(WritePhase::kRecordDirectory).count, trigger_count);
+
+  // once the writer closes the file, the reader finds it under its final name
+  h5file_ptr.reset();
+  BOOST_REQUIRE_EQUAL(run_reader_step(), 1);
+
+  close(step_pipe[1]);
+  close(result_pipe[0]);
+  int reader_status = 0;
+  BOOST_REQUIRE_EQUAL(waitpid(reader_pid, &reader_status, 0), reader_pid);
+  BOOST_REQUIRE(WIFEXITED(reader_status));
+  BOOST_REQUIRE_EQUAL(WEXITSTATUS(reader_status), 0);
+
+  // clean up the files that were created
+  delete_files_matching_pattern(file_path, hdf5_filename);
+}
+
+BOOST_AUTO_TEST_CASE(CloseAsync)
+{
+  std::string file_path(std::filesystem::temp_directory_path());
+  std::string hdf5_filename = "demo" + std::to_string(getpid()) + "_" + std::string(getenv("USER")) + ".hdf5";
+  const int trigger_count = 5;
+
+  // delete any pre-existing files so that we start with a clean slate
+  delete_files_matching_pattern(file_path, hdf5_filename);
+
+  // create the file
+  std::unique_ptr<HDF5RawDataFile> h5file_ptr(new HDF5RawDataFile(file_path + "/" + hdf5_filename,
+                                                                  run_number,
+                                                                  file_index,
+                                                                  application_name,
+                                                                  create_file_layout_params(),
+                                                                  create_srcid_geoid_map()));
+
+  for (int trigger_number = 1; trigger_number <= trigger_count; ++trigger_number)
+    h5file_ptr->write(create_trigger_record(trigger_number));
+  size_t recorded_size_at_write = h5file_ptr->get_recorded_size();
+
+  std::shared_future<void> close_future = h5file_ptr->close_async();
+  BOOST_REQUIRE(h5file_ptr->is_closed());
+  BOOST_REQUIRE_EXCEPTION(h5file_ptr->write(create_trigger_record(trigger_count + 1)),
+                          FileClosed,
+                          [&](FileClosed) { return true; });
+
+  // the same closing is returned, and waited for by finalize()
+  h5file_ptr->close_async();
+  h5file_ptr->finalize();
+  BOOST_REQUIRE(close_future.wait_for(std::chrono::seconds(0)) == std::future_status::ready);
+  close_future.get();
+  BOOST_REQUIRE(std::filesystem::exists(file_path + "/" + hdf5_filename));
+
+  // the closed file still reports its name and layout
+  BOOST_REQUIRE_EQUAL(h5file_ptr->get_file_name(), file_path + "/" + hdf5_filename);
+  BOOST_REQUIRE_EQUAL(h5file_ptr->get_file_layout().get_record_name_prefix(), "TriggerRecord");
+
+  h5file_ptr.reset(); // nothing is left to do
+
+  // open file for reading now
+  h5file_ptr.reset(new HDF5RawDataFile(file_path + "/" + hdf5_filename));
+  BOOST_REQUIRE_EQUAL(h5file_ptr->get_attribute<size_t>("recorded_size"), recorded_size_at_write);
+  BOOST_REQUIRE_EQUAL(h5file_ptr->get_all_trigger_record_ids().size(), trigger_count);
+  h5file_ptr.reset();
+
+  // clean up the files that were created
+  delete_files_matching_pattern(file_path, hdf5_filename);
+}
+
+BOOST_AUTO_TEST_CASE(CloseWhileQueueing)
+{
+  std::string file_path(std::filesystem::temp_directory_path());
+  std::string hdf5_filename = "demo" + std::to_string(getpid()) + "_" + std::string(getenv("USER")) + ".hdf5";
+  const int max_trigger_count = 1000;
+
+  // delete any pre-existing files so that we start with a clean slate
+  delete_files_matching_pattern(file_path, hdf5_filename);
+
+  auto fl_pars = create_file_layout_params();
+  fl_pars.path_param_list[0].deflate_level = 4;
+
+  hdf5rawdatafile::WriterParams writer_params;
+  writer_params.async_write_queue_depth = 2;
+  writer_params.compression_thread_count = 2;
+  std::unique_ptr<HDF5RawDataFile> h5file_ptr(new HDF5RawDataFile(file_path + "/" + hdf5_filename,
+                                                                  run_number,
+                                                                  file_index,
+                                                                  application_name,
+                                                                  fl_pars,
+                                                                  create_srcid_geoid_map(),
+                                                                  ".writing",
+                                                                  HighFive::File::Create,
+                                                                  writer_params));
+
+  // records are queued until the file is closed under the writing thread
+  std::atomic<int> queued_count{ 0 };
+  std::vector<std::future<void>> completions;
+  std::thread writing_thread([&]() {
+    try {
+      for (int trigger_number = 1; trigger_number <= max_trigger_count; ++trigger_number) {
+        auto tr_ptr = std::make_unique<dunedaq::daqdataformats::TriggerRecord>(create_trigger_record(trigger_number));
+        completions.push_back(h5file_ptr->write_async(std::move(tr_ptr)));
+        ++queued_count;
+      }
+    } catch (FileClosed const&) {
+    }
+  });
+  while (queued_count.load() < 5)
+    std::this_thread::sleep_for(std::chrono::milliseconds(1));
+  h5file_ptr->close_async().get();
+  writing_thread.join();
+
+  // every record that was queued is in the file
+  BOOST_REQUIRE_LT(queued_count.load(), max_trigger_count);
+  for (auto& completion : completions)
+    completion.get();
+  h5file_ptr.reset(new HDF5RawDataFile(file_path + "/" + hdf5_filename));
+  BOOST_REQUIRE_EQUAL(h5file_ptr->get_all_trigger_record_ids().size(), static_cast<size_t>(queued_count.load()));
+  h5file_ptr.reset();
+
+  // clean up the files that were created
+  delete_files_matching_pattern(file_path, hdf5_filename);
+}
+
+BOOST_AUTO_TEST_CASE(FileSequence)
+{
+  std::string file_path(std::filesystem::temp_directory_path());
+  std::string file_prefix = "demo" + std::to_string(getpid()) + "_" + std::string(getenv("USER")) + "_seq";
+  std::string file_pattern = file_prefix + "_[0-9]+\\.hdf5";
+  const int trigger_count = 5;
+
+  // delete any pre-existing files so that we start with a clean slate
+  delete_files_matching_pattern(file_path, file_pattern);
+
+  auto file_name_function = [&](size_t index) {
+    return file_path + "/" + file_prefix + "_" + std::to_string(index) + ".hdf5";
+  };
+
+  hdf5rawdatafile::FileSequenceParams sequence_params;
+  sequence_params.max_records_per_file = 2;
+
+  HDF5RawDataFileSequence file_sequence(file_name_function,
+                                        run_number,
+                                        file_index,
+                                        application_name,
+                                        create_file_layout_params(),
+                                        create_srcid_geoid_map(),
+                                        sequence_params);
+
+  for (int trigger_number = 1; trigger_number <= trigger_count; ++trigger_number)
+    file_sequence.write(create_trigger_record(trigger_number));
+  BOOST_REQUIRE_EQUAL(file_sequence.get_file_count(), 3);
+  BOOST_REQUIRE_EQUAL(file_sequence.get_current_file_index(), 2);
+  BOOST_REQUIRE_EQUAL(file_sequence.get_records_in_current_file(), 1);
+
+  file_sequence.close();
+  BOOST_REQUIRE_EXCEPTION(file_sequence.write(create_trigger_record(trigger_count + 1)),
+                          FileSequenceClosed,
+                          [&](FileSequenceClosed) { return true; });
+
+  // the pre-opened file that received no records was removed
+  BOOST_REQUIRE(!std::filesystem::exists(file_name_function(3)));
+  BOOST_REQUIRE(get_files_matching_pattern(file_path, file_prefix + "_[0-9]+\\.hdf5\\.writing").empty());
+
+  const std::vector<size_t> records_per_file = { 2, 2, 1 };
+  for (size_t index = 0; index < records_per_file.size(); ++index) {
+    HDF5RawDataFile h5file(file_name_function(index));
+    BOOST_REQUIRE_EQUAL(h5file.get_attribute<size_t>("file_index"), index);
+    BOOST_REQUIRE_EQUAL(h5file.get_all_trigger_record_ids().size(), records_per_file[index]);
+  }
+  delete_files_matching_pattern(file_path, file_pattern);
+
+  // the pre-opened file of split files is removed with its metadata file, in another directory, and the link to it
+  std::string metadata_path = file_path + "/" + file_prefix + "_metadata";
+  std::filesystem::remove_all(metadata_path);
+  std::filesystem::create_directory(metadata_path);
+  hdf5rawdatafile::WriterParams writer_params;
+  writer_params.split_files = true;
+  writer_params.split_metadata_directory = metadata_path;
+  {
+    HDF5RawDataFileSequence split_file_sequence(file_name_function,
+                                                run_number,
+                                                file_index,
+                                                application_name,
+                                                create_file_layout_params(),
+                                                create_srcid_geoid_map(),
+                                                sequence_params,
+                                                writer_params);
+    split_file_sequence.write(create_trigger_record(1));
+    split_file_sequence.close();
+  }
+  BOOST_REQUIRE(HDF5RawDataFile::is_split_file(file_name_function(0)));
+  BOOST_REQUIRE(get_files_matching_pattern(file_path, file_prefix + "_1\\.hdf5.*").empty());
+  BOOST_REQUIRE(get_files_matching_pattern(metadata_path, file_prefix + "_1\\.hdf5.*").empty());
+
+  // clean up the files that were created
+  std::filesystem::remove_all(metadata_path);
+  delete_files_matching_pattern(file_path, file_prefix + "_[0-9]+\\.hdf5.*");
+}
+
+BOOST_AUTO_TEST_CASE(StripedFile)
+{
+  std::string file_path(std::filesystem::temp_directory_path());
+  std::string file_prefix = "demo" + std::to_string(getpid()) + "_" + std::string(getenv("USER")) + "_stripe";
+  std::string file_pattern = file_prefix + "_.*";
+  std::string manifest_file_name = file_path + "/" + file_prefix + "_manifest.json";
+  const size_t stripe_count = 3;
+  const int trigger_count = 10;
+
+  // delete any pre-existing files so that we start with a clean slate
+  delete_files_matching_pattern(file_path, file_pattern);
+
+  std::vector<std::string> file_names;
+  for (size_t stripe_index = 0; stripe_index < stripe_count; ++stripe_index)
+    file_names.push_back(file_path + "/" + file_prefix + "_" + std::to_string(stripe_index) + ".hdf5");
+
+  HDF5StripedRawDataFile striped_file(manifest_file_name,
+                                      file_names,
+                                      run_number,
+                                      file_index,
+                                      application_name,
+                                      create_file_layout_params(),
+                                      create_srcid_geoid_map());
+  BOOST_REQUIRE_EQUAL(striped_file.get_stripe_count(), stripe_count);
+
+  std::vector<std::future<void>> completions;
+  for (int trigger_number = trigger_count; trigger_number >= 1; --trigger_number) {
+    auto tr_ptr = std::make_unique<dunedaq::daqdataformats::TriggerRecord>(create_trigger_record(trigger_number));
+    completions.push_back(striped_file.write(std::move(tr_ptr)));
+  }
+  for (auto& completion : completions)
+    completion.get();
+
+  striped_file.close();
+  BOOST_REQUIRE(std::filesystem::exists(manifest_file_name));
+  BOOST_REQUIRE_EXCEPTION(
+    striped_file.write(std::make_unique<dunedaq::daqdataformats::TriggerRecord>(create_trigger_record(1))),
+    StripedFileClosed,
+    [&](StripedFileClosed) { return true; });
+
+  // the records went to the stripes in turn
+  for (size_t stripe_index = 0; stripe_index < stripe_count; ++stripe_index) {
+    HDF5RawDataFile h5file(file_names[stripe_index]);
+    BOOST_REQUIRE_EQUAL(h5file.get_attribute<size_t>("stripe_index"), stripe_index);
+    BOOST_REQUIRE_EQUAL(h5file.get_all_trigger_record_ids().size(),
+                        (trigger_count + stripe_count - 1 - stripe_index) / stripe_count);
+  }
+
+  // the reader gives back the records in the order in which they were written
+  HDF5StripedRawDataFile striped_reader(manifest_file_name);
+  BOOST_REQUIRE_EQUAL(striped_reader.get_stripe_count(), stripe_count);
+  auto const& record_ids = striped_reader.get_record_ids();
+  BOOST_REQUIRE_EQUAL(record_ids.size(), trigger_count);
+  for (size_t record_index = 0; record_index < record_ids.size(); ++record_index) {
+    BOOST_REQUIRE_EQUAL(record_ids[record_index].first, trigger_count - record_index);
+    BOOST_REQUIRE_EQUAL(striped_reader.get_stripe_index(record_ids[record_index]), record_index % stripe_count);
+    auto tr = striped_reader.get_trigger_record(record_ids[record_index]);
+    BOOST_REQUIRE_EQUAL(tr.get_header_ref().get_trigger_number(), record_ids[record_index].first);
+    BOOST_REQUIRE_EQUAL(tr.get_fragments_ref().size(), components_per_record);
+  }
+  striped_reader.close();
+
+  // clean up the files that were created
+  delete_files_matching_pattern(file_path, file_pattern);
+}
+
 BOOST_AUTO_TEST_SUITE_END()